@@ -0,0 +1,357 @@
+/**
+ * @file    ConcurrentParamMap.cc
+ * @Author  Miikka Silfverberg
+ * @brief   Sharded hash table for parameters that are updated by
+ *          several training threads at once.
+ */
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// (C) Copyright 2014, University of Helsinki                                //
+// Licensed under the Apache License, Version 2.0 (the "License");           //
+// you may not use this file except in compliance with the License.          //
+// You may obtain a copy of the License at                                   //
+// http://www.apache.org/licenses/LICENSE-2.0                                //
+// Unless required by applicable law or agreed to in writing, software       //
+// distributed under the License is distributed on an "AS IS" BASIS,         //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  //
+// See the License for the specific language governing permissions and       //
+// limitations under the License.                                            //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+#include "ConcurrentParamMap.hh"
+
+#ifndef TEST_ConcurrentParamMap_cc
+
+// Initial number of slots in each shard.
+static const size_t INITIAL_SHARD_CAPACITY = 16;
+
+ConcurrentParamMap::Table::Table(size_t capacity):
+  slots(capacity),
+  mask(capacity - 1)
+{
+  for (size_t i = 0; i < capacity; ++i)
+    {
+      slots[i].key.store(EMPTY_PARAM_ID, std::memory_order_relaxed);
+      slots[i].value.store(0, std::memory_order_relaxed);
+      slots[i].sum.store(0, std::memory_order_relaxed);
+    }
+}
+
+ConcurrentParamMap::ConcurrentParamMap(void)
+{
+  for (unsigned int i = 0; i < CONCURRENT_SHARD_COUNT; ++i)
+    {
+      shards[i].table.store(new Table(INITIAL_SHARD_CAPACITY));
+      shards[i].entry_count = 0;
+    }
+}
+
+ConcurrentParamMap::~ConcurrentParamMap(void)
+{ reset(); }
+
+unsigned long ConcurrentParamMap::get_hash(long key)
+{ return static_cast<unsigned long>(key) * 0x9E3779B97F4A7C15UL; }
+
+ConcurrentParamMap::Shard &ConcurrentParamMap::get_shard(long key)
+{ return shards[get_hash(key) >> 58]; }
+
+const ConcurrentParamMap::Shard &ConcurrentParamMap::get_shard(long key) const
+{ return shards[get_hash(key) >> 58]; }
+
+ConcurrentParamMap::Slot * ConcurrentParamMap::find_slot(Table * table,
+							  long key)
+{
+  unsigned long h = get_hash(key);
+  size_t i = (h ^ (h >> 32)) & table->mask;
+
+  // At most one pass over the table, so lookups are wait-free.
+  for (size_t n = 0; n <= table->mask; ++n, i = (i + 1) & table->mask)
+    {
+      long slot_key = table->slots[i].key.load(std::memory_order_acquire);
+
+      if (slot_key == key)
+	{ return &table->slots[i]; }
+      else if (slot_key == EMPTY_PARAM_ID)
+	{ return 0; }
+    }
+
+  return 0;
+}
+
+ConcurrentParamMap::Slot * ConcurrentParamMap::insert_slot(Table * table,
+							    long key)
+{
+  unsigned long h = get_hash(key);
+  size_t i = (h ^ (h >> 32)) & table->mask;
+
+  while (table->slots[i].key.load(std::memory_order_relaxed) !=
+	 EMPTY_PARAM_ID)
+    { i = (i + 1) & table->mask; }
+
+  // The value and sum are zero, so publishing the key is enough.
+  table->slots[i].key.store(key, std::memory_order_release);
+  return &table->slots[i];
+}
+
+float ConcurrentParamMap::atomic_add(std::atomic<float> &target, 
+				     float ud, 
+				     float factor)
+{
+  float old_value = target.load(std::memory_order_relaxed);
+  float new_value = (old_value + ud) * factor;
+
+  while (not target.compare_exchange_weak(old_value, new_value,
+					  std::memory_order_relaxed))
+    { new_value = (old_value + ud) * factor; }
+
+  return new_value - old_value;
+}
+
+bool ConcurrentParamMap::find(long key, float &value) const
+{
+  const Shard &shard = get_shard(key);
+  const Slot * slot =
+    find_slot(shard.table.load(std::memory_order_acquire), key);
+
+  if (slot == 0)
+    { return 0; }
+
+  value = slot->value.load(std::memory_order_relaxed);
+  return 1;
+}
+
+void ConcurrentParamMap::add(long key, float value_ud, float sum_ud)
+{ update(key, value_ud, 1, sum_ud); }
+
+float ConcurrentParamMap::add_and_scale(long key, float value_ud, float factor)
+{ return update(key, value_ud, factor, 0); }
+
+float ConcurrentParamMap::update(long key, 
+				 float value_ud, 
+				 float factor, 
+				 float sum_ud)
+{
+  Shard &shard = get_shard(key);
+  Slot * slot = find_slot(shard.table.load(std::memory_order_acquire), key);
+
+  if (slot == 0)
+    {
+      std::lock_guard<std::mutex> lock(shard.insert_mutex);
+
+      slot = find_slot(shard.table.load(std::memory_order_relaxed), key);
+
+      if (slot == 0)
+	{
+	  Table * table = shard.table.load(std::memory_order_relaxed);
+
+	  if ((shard.entry_count + 1) * 4 > (table->mask + 1) * 3)
+	    {
+	      grow(shard);
+	      table = shard.table.load(std::memory_order_relaxed);
+	    }
+
+	  slot = insert_slot(table, key);
+	  ++shard.entry_count;
+	}
+
+      // The shard cannot grow while the lock is held, so this update
+      // is never lost.
+      float change = atomic_add(slot->value, value_ud, factor);
+
+      if (sum_ud != 0)
+	{ atomic_add(slot->sum, sum_ud, 1); }
+
+      return change;
+    }
+
+  float change = atomic_add(slot->value, value_ud, factor);
+
+  if (sum_ud != 0)
+    { atomic_add(slot->sum, sum_ud, 1); }
+
+  return change;
+}
+
+void ConcurrentParamMap::grow(Shard &shard)
+{
+  Table * old_table = shard.table.load(std::memory_order_relaxed);
+  Table * new_table = new Table(2 * (old_table->mask + 1));
+
+  for (size_t i = 0; i <= old_table->mask; ++i)
+    {
+      const Slot &old_slot = old_table->slots[i];
+      long key = old_slot.key.load(std::memory_order_relaxed);
+
+      if (key == EMPTY_PARAM_ID)
+	{ continue; }
+
+      Slot * slot = insert_slot(new_table, key);
+      slot->value.store(old_slot.value.load(std::memory_order_relaxed),
+			std::memory_order_relaxed);
+      slot->sum.store(old_slot.sum.load(std::memory_order_relaxed),
+		      std::memory_order_relaxed);
+    }
+
+  shard.table.store(new_table, std::memory_order_release);
+  shard.retired.push_back(old_table);
+}
+
+void ConcurrentParamMap::assign(const ParamMap &values, const ParamMap &sums)
+{
+  clear();
+
+  for (ParamMap::const_iterator it = values.begin(); it != values.end(); ++it)
+    {
+      ParamMap::const_iterator jt = sums.find(it->first);
+      add(it->first, it->second, jt == sums.end() ? 0 : jt->second);
+    }
+}
+
+void ConcurrentParamMap::get(ParamMap &values, ParamMap * sums) const
+{
+  values.clear();
+  values.reserve(size());
+
+  if (sums != 0)
+    { sums->clear(); }
+
+  for (unsigned int i = 0; i < CONCURRENT_SHARD_COUNT; ++i)
+    {
+      const Table * table = shards[i].table.load(std::memory_order_relaxed);
+
+      for (size_t j = 0; j <= table->mask; ++j)
+	{
+	  const Slot &slot = table->slots[j];
+	  long key = slot.key.load(std::memory_order_relaxed);
+
+	  if (key == EMPTY_PARAM_ID)
+	    { continue; }
+
+	  values[key] = slot.value.load(std::memory_order_relaxed);
+
+	  float sum = slot.sum.load(std::memory_order_relaxed);
+
+	  if (sums != 0 and sum != 0)
+	    { (*sums)[key] = sum; }
+	}
+    }
+}
+
+void ConcurrentParamMap::clear(void)
+{
+  reset();
+
+  for (unsigned int i = 0; i < CONCURRENT_SHARD_COUNT; ++i)
+    { shards[i].table.store(new Table(INITIAL_SHARD_CAPACITY)); }
+}
+
+size_t ConcurrentParamMap::size(void) const
+{
+  size_t res = 0;
+
+  for (unsigned int i = 0; i < CONCURRENT_SHARD_COUNT; ++i)
+    { res += shards[i].entry_count; }
+
+  return res;
+}
+
+void ConcurrentParamMap::reset(void)
+{
+  for (unsigned int i = 0; i < CONCURRENT_SHARD_COUNT; ++i)
+    {
+      delete shards[i].table.load();
+      shards[i].table.store(0);
+      shards[i].entry_count = 0;
+
+      for (unsigned int j = 0; j < shards[i].retired.size(); ++j)
+	{ delete shards[i].retired[j]; }
+
+      shards[i].retired.clear();
+    }
+}
+
+#else // TEST_ConcurrentParamMap_cc
+
+#include <cassert>
+#include <thread>
+
+void add_range(ConcurrentParamMap * m, long begin, long end, float ud)
+{
+  for (long i = begin; i < end; ++i)
+    { m->add(i * 7919, ud, -ud); }
+}
+
+int main(void)
+{
+  ConcurrentParamMap m;
+  float value = 0;
+
+  assert(m.size() == 0);
+  assert(not m.find(0, value));
+
+  // Concurrent inserts of distinct keys.
+  std::vector<std::thread> threads;
+
+  for (long i = 0; i < 4; ++i)
+    { threads.push_back(std::thread(add_range, &m, i * 10000, (i + 1) * 10000, 1)); }
+
+  for (unsigned int i = 0; i < threads.size(); ++i)
+    { threads[i].join(); }
+
+  threads.clear();
+  assert(m.size() == 40000);
+
+  for (long i = 0; i < 40000; ++i)
+    {
+      assert(m.find(i * 7919, value));
+      assert(value == 1);
+    }
+
+  // Concurrent updates of the same existing keys are not lost.
+  for (long i = 0; i < 4; ++i)
+    { threads.push_back(std::thread(add_range, &m, 0, 1000, 2)); }
+
+  for (unsigned int i = 0; i < threads.size(); ++i)
+    { threads[i].join(); }
+
+  assert(m.find(0, value));
+  assert(value == 9);
+  assert(m.find(999 * 7919, value));
+  assert(value == 9);
+  assert(m.find(1000 * 7919, value));
+  assert(value == 1);
+
+  ParamMap values;
+  ParamMap sums;
+  m.get(values, &sums);
+  assert(values.size() == 40000);
+  assert(sums.find(0)->second == -9);
+
+  assert(m.add_and_scale(0, 1, 0.5) == -4);
+  assert(m.find(0, value));
+  assert(value == 5);
+  assert(m.add_and_scale(7, 2, 0.5) == 1);
+  assert(m.find(7, value));
+  assert(value == 1);
+  assert(m.size() == 40001);
+
+  ConcurrentParamMap m_copy;
+  m_copy.assign(values, sums);
+  assert(m_copy.size() == 40000);
+  assert(m_copy.find(0, value));
+  assert(value == 9);
+
+  ParamMap values_copy;
+  ParamMap sums_copy;
+  m_copy.get(values_copy, &sums_copy);
+  assert(values_copy == values);
+  assert(sums_copy == sums);
+
+  m.clear();
+  assert(m.size() == 0);
+  assert(not m.find(0, value));
+}
+
+#endif // TEST_ConcurrentParamMap_cc
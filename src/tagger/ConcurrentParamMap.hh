@@ -0,0 +1,119 @@
+/**
+ * @file    ConcurrentParamMap.hh
+ * @Author  Miikka Silfverberg
+ * @brief   Sharded hash table for parameters that are updated by
+ *          several training threads at once.
+ */
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// (C) Copyright 2014, University of Helsinki                                //
+// Licensed under the Apache License, Version 2.0 (the "License");           //
+// you may not use this file except in compliance with the License.          //
+// You may obtain a copy of the License at                                   //
+// http://www.apache.org/licenses/LICENSE-2.0                                //
+// Unless required by applicable law or agreed to in writing, software       //
+// distributed under the License is distributed on an "AS IS" BASIS,         //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  //
+// See the License for the specific language governing permissions and       //
+// limitations under the License.                                            //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef HEADER_ConcurrentParamMap_hh
+#define HEADER_ConcurrentParamMap_hh
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <cstddef>
+
+#include "ParamMap.hh"
+
+const unsigned int CONCURRENT_SHARD_COUNT = 64;
+
+/**
+ * @brief Map from parameter ids to a value and a running sum (see
+ * ParamTable::set_averaging) for Hogwild style training.
+ *
+ * Lookups are wait-free and adding to an existing entry is a
+ * lock-free compare-and-swap loop. Inserting a new id locks one of
+ * CONCURRENT_SHARD_COUNT shards. A full shard is copied into a table
+ * of twice the size; adds that race with the copy may be lost, which
+ * Hogwild training tolerates. The old tables are freed by clear() and
+ * the destructor, since readers may still be using them.
+ */
+class ConcurrentParamMap
+{
+public:
+  ConcurrentParamMap(void);
+  ~ConcurrentParamMap(void);
+
+  // Store the value for @p key in @p value and return true, or return
+  // false if @p key is missing. Thread safe.
+  bool find(long key, float &value) const;
+
+  // Add @p value_ud to the value and @p sum_ud to the running sum for
+  // @p key, inserting @p key if it is missing. Thread safe.
+  void add(long key, float value_ud, float sum_ud);
+
+  // Add @p value_ud to the value for @p key and multiply the result
+  // by @p factor, inserting @p key if it is missing. Return the change
+  // of the value. Thread safe.
+  float add_and_scale(long key, float value_ud, float factor);
+
+  // The rest of the functions must not run concurrently with any
+  // other function.
+
+  // Replace the contents by @p values and @p sums.
+  void assign(const ParamMap &values, const ParamMap &sums);
+
+  // Copy the values to @p values and the nonzero running sums to
+  // @p sums unless @p sums is 0.
+  void get(ParamMap &values, ParamMap * sums) const;
+
+  void clear(void);
+  size_t size(void) const;
+
+private:
+  ConcurrentParamMap(const ConcurrentParamMap &another);
+  ConcurrentParamMap &operator=(const ConcurrentParamMap &another);
+
+  struct Slot
+  {
+    std::atomic<long> key;
+    std::atomic<float> value;
+    std::atomic<float> sum;
+  };
+
+  struct Table
+  {
+    Table(size_t capacity);
+
+    std::vector<Slot> slots;
+    size_t mask;
+  };
+
+  struct Shard
+  {
+    std::atomic<Table *> table;
+    std::mutex insert_mutex;
+    size_t entry_count;
+    std::vector<Table *> retired;
+  };
+
+  Shard shards[CONCURRENT_SHARD_COUNT];
+
+  static unsigned long get_hash(long key);
+  static Slot * find_slot(Table * table, long key);
+  static Slot * insert_slot(Table * table, long key);
+  static float atomic_add(std::atomic<float> &target, float ud, float factor);
+
+  Shard &get_shard(long key);
+  const Shard &get_shard(long key) const;
+  float update(long key, float value_ud, float factor, float sum_ud);
+  void grow(Shard &shard);
+  void reset(void);
+};
+
+#endif // HEADER_ConcurrentParamMap_hh
@@ -122,7 +122,7 @@ void Data::clear_label_guesses(void)
     { data[i].clear_label_guesses(); }
 }
 
-void Data::predict_lemma(LemmaExtractor &g, const LabelExtractor &e)
+void Data::predict_lemma(const LemmaExtractor &g, const LabelExtractor &e)
 {
   for (unsigned int i = 0; i < data.size(); ++i)
     {
@@ -281,7 +281,7 @@ class SillyLemmaExtractor : public LemmaExtractor
 {
 public:
   std::string get_lemma_candidate(const std::string &word_form, 
-				  const std::string &label)
+				  const std::string &label) const
   { 
     static_cast<void>(word_form);
     static_cast<void>(label);
@@ -99,7 +99,7 @@ class Data
 			 float mass,
 			 int candidate_count = -1);
 
-  void predict_lemma(LemmaExtractor &g, const LabelExtractor &e);
+  void predict_lemma(const LemmaExtractor &g, const LabelExtractor &e);
 
   void unset_lemma(void);
   void unset_label(void);
@@ -0,0 +1,401 @@
+/**
+ * @file    FinnPos.cc
+ * @Author  Miikka Silfverberg
+ * @brief   C interface for embedding the tagger (libfinnpos).
+ */
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// (C) Copyright 2014, University of Helsinki                                //
+// Licensed under the Apache License, Version 2.0 (the "License");           //
+// you may not use this file except in compliance with the License.          //
+// You may obtain a copy of the License at                                   //
+// http://www.apache.org/licenses/LICENSE-2.0                                //
+// Unless required by applicable law or agreed to in writing, software       //
+// distributed under the License is distributed on an "AS IS" BASIS,         //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  //
+// See the License for the specific language governing permissions and       //
+// limitations under the License.                                            //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+
+
+#include "FinnPos.hh"
+
+#include <sstream>
+#include <fstream>
+#include <memory>
+
+#include "Tagger.hh"
+#include "Trellis.hh"
+
+#ifndef TEST_FinnPos_cc
+
+struct finnpos_model
+{
+  finnpos_model(void):
+    tagger(msg_out)
+  {}
+
+  // Messages of the tagger are discarded.
+  std::ostringstream msg_out;
+  Tagger tagger;
+};
+
+struct finnpos_context
+{
+  const finnpos_model * model;
+  std::unique_ptr<Trellis> trellis;
+  WordVector words;
+  std::vector<float> marginals;
+  StringVector lemmas;
+};
+
+finnpos_model * finnpos_load_model(const char * model_file,
+				   const char * options_file)
+{
+  finnpos_model * model = 0;
+
+  try
+    {
+      model = new finnpos_model;
+      model->tagger.load(model_file);
+
+      if (options_file != 0)
+	{
+	  std::ifstream opt_in(options_file);
+
+	  if (not opt_in.good())
+	    { throw ReadFailed(); }
+
+	  unsigned int counter = 0;
+	  TaggerOptions tagger_options(opt_in, counter);
+	  model->tagger.set_options(tagger_options);
+	}
+
+      return model;
+    }
+  catch (...)
+    {
+      delete model;
+      return 0;
+    }
+}
+
+void finnpos_free_model(finnpos_model * model)
+{ delete model; }
+
+unsigned int finnpos_get_feature_id(const finnpos_model * model,
+				    const char * feature)
+{
+  try
+    {
+      unsigned int id = FINNPOS_UNKNOWN_FEATURE;
+
+      if (not model->tagger.find_feat_template(feature, id))
+	{ return FINNPOS_UNKNOWN_FEATURE; }
+
+      return id;
+    }
+  catch (...)
+    { return FINNPOS_UNKNOWN_FEATURE; }
+}
+
+unsigned int finnpos_label_count(const finnpos_model * model)
+{ return model->tagger.get_label_extractor().label_count(); }
+
+const char * finnpos_get_label_string(const finnpos_model * model,
+				      unsigned int label)
+{
+  try
+    { return model->tagger.get_label_extractor().get_label_string(label).c_str(); }
+  catch (...)
+    { return 0; }
+}
+
+finnpos_context * finnpos_new_context(const finnpos_model * model)
+{
+  try
+    {
+      finnpos_context * context = new finnpos_context;
+      context->model = model;
+      context->trellis.reset(model->tagger.new_trellis());
+      return context;
+    }
+  catch (...)
+    { return 0; }
+}
+
+void finnpos_free_context(finnpos_context * context)
+{ delete context; }
+
+// Tag context->words and copy the results to the caller's buffers.
+static void tag_words(finnpos_context * context,
+		      unsigned int * labels,
+		      const char ** lemmas,
+		      float * marginals)
+{
+  const Tagger &tagger = context->model->tagger;
+  Sentence s(context->words, tagger.get_label_extractor());
+
+  tagger.tag_sentence(s, 
+		      *context->trellis, 
+		      lemmas != 0, 
+		      marginals == 0 ? 0 : &context->marginals);
+
+  context->lemmas.resize(context->words.size());
+
+  // The words of s follow two boundary words.
+  for (unsigned int i = 0; i < context->words.size(); ++i)
+    {
+      const Word &w = s.at(i + 2);
+      labels[i] = w.get_label();
+
+      if (lemmas != 0)
+	{
+	  context->lemmas[i] = w.get_lemma();
+	  lemmas[i] = context->lemmas[i].c_str();
+	}
+
+      if (marginals != 0)
+	{ marginals[i] = context->marginals[i + 2]; }
+    }
+}
+
+int finnpos_tag(finnpos_context * context,
+		unsigned int word_count,
+		const char * const * word_forms,
+		const unsigned int * feature_counts,
+		const char * const * features,
+		unsigned int * labels,
+		const char ** lemmas,
+		float * marginals)
+{
+  try
+    {
+      const Tagger &tagger = context->model->tagger;
+      context->words.clear();
+
+      for (unsigned int i = 0; i < word_count; ++i)
+	{
+	  FeatureTemplateVector feat_templates;
+
+	  for (unsigned int j = 0; j < feature_counts[i]; ++j, ++features)
+	    {
+	      unsigned int id = 0;
+
+	      if (tagger.find_feat_template(*features, id))
+		{ feat_templates.push_back(id); }
+	    }
+
+	  context->words.push_back
+	    (Word(word_forms[i], feat_templates, LabelVector(), "_"));
+	}
+
+      if (word_count > 0)
+	{ tag_words(context, labels, lemmas, marginals); }
+
+      return 0;
+    }
+  catch (...)
+    { return -1; }
+}
+
+int finnpos_tag_ids(finnpos_context * context,
+		    unsigned int word_count,
+		    const char * const * word_forms,
+		    const unsigned int * feature_counts,
+		    const unsigned int * feature_ids,
+		    unsigned int * labels,
+		    const char ** lemmas,
+		    float * marginals)
+{
+  try
+    {
+      context->words.clear();
+
+      for (unsigned int i = 0; i < word_count; ++i)
+	{
+	  FeatureTemplateVector feat_templates;
+
+	  for (unsigned int j = 0; j < feature_counts[i]; ++j, ++feature_ids)
+	    {
+	      if (*feature_ids != FINNPOS_UNKNOWN_FEATURE)
+		{ feat_templates.push_back(*feature_ids); }
+	    }
+
+	  context->words.push_back
+	    (Word(word_forms[i], feat_templates, LabelVector(), "_"));
+	}
+
+      if (word_count > 0)
+	{ tag_words(context, labels, lemmas, marginals); }
+
+      return 0;
+    }
+  catch (...)
+    { return -1; }
+}
+
+#else // TEST_FinnPos_cc
+
+#include <cassert>
+#include <cstdio>
+#include <cmath>
+
+int main(void)
+{
+  std::string train_contents("The\tWORD=The\tthe\tDT\t_\n"
+			     "dog\tWORD=dog SUF=og\tdog\tNN\t_\n"
+			     ".\tWORD=.\t.\t.\t_\n"
+			     "\n"
+			     "A\tWORD=A\ta\tDT\t_\n"
+			     "cat\tWORD=cat SUF=at\tcat\tNN\t_\n"
+			     "sleeps\tWORD=sleeps SUF=ps\tsleep\tVB\t_\n"
+			     ".\tWORD=.\t.\t.\t_\n");
+  
+  std::istringstream train_in(train_contents);
+  std::istringstream dev_in(train_contents);
+
+  TaggerOptions tagger_options(AVG_PERC, MAP, 10, 2, 20, 3, 20, -1, -1, -1, NONE, 0, 0, 1);
+  std::ostringstream null_stream;
+  Tagger tagger(tagger_options, null_stream);
+  tagger.train(train_in, dev_in);
+
+  std::string filename = "TEST_FinnPos.tmp";
+  std::ofstream model_out(filename.c_str(), std::ios::binary);
+  tagger.store(model_out);
+  model_out.close();
+
+  finnpos_model * model = finnpos_load_model(filename.c_str(), 0);
+  remove(filename.c_str());
+  assert(model != 0);
+  assert(finnpos_load_model("TEST_FinnPos.missing", 0) == 0);
+
+  assert(finnpos_get_feature_id(model, "WORD=dog") != 
+	 FINNPOS_UNKNOWN_FEATURE);
+  assert(finnpos_get_feature_id(model, "WORD=hog") == 
+	 FINNPOS_UNKNOWN_FEATURE);
+
+  // The same sentence through the API and through label_stream.
+  const char * word_forms[] = { "The", "hog", "sleeps", "." };
+  unsigned int feature_counts[] = { 1, 2, 2, 1 };
+  const char * features[] = { "WORD=The", "WORD=hog", "SUF=og", 
+			      "WORD=sleeps", "SUF=ps", "WORD=." };
+
+  std::istringstream test_in("The\tWORD=The\t_\t_\t_\n"
+			     "hog\tWORD=hog SUF=og\t_\t_\t_\n"
+			     "sleeps\tWORD=sleeps SUF=ps\t_\t_\t_\n"
+			     ".\tWORD=.\t_\t_\t_\n");
+  std::ostringstream test_out;
+  tagger.label_stream(test_in, test_out);
+
+  finnpos_context * context = finnpos_new_context(model);
+  assert(context != 0);
+
+  unsigned int labels[4];
+  const char * lemmas[4];
+  float marginals[4];
+
+  assert(finnpos_tag(context, 4, word_forms, feature_counts, features, 
+		     labels, lemmas, marginals) == 0);
+
+  std::ostringstream api_out;
+
+  for (unsigned int i = 0; i < 4; ++i)
+    {
+      assert(labels[i] < finnpos_label_count(model));
+      assert(marginals[i] > 0 and marginals[i] <= 1.0001);
+      api_out << word_forms[i] << "\t_\t" << lemmas[i] << "\t" 
+	      << finnpos_get_label_string(model, labels[i]) << "\t_\n";
+    }
+
+  api_out << '\n';
+  assert(api_out.str() == test_out.str());
+
+  assert(finnpos_get_label_string(model, finnpos_label_count(model)) == 0);
+
+  // Feature ids give the same labels.
+  unsigned int feature_ids[6];
+
+  for (unsigned int i = 0; i < 6; ++i)
+    { feature_ids[i] = finnpos_get_feature_id(model, features[i]); }
+
+  unsigned int id_labels[4];
+  assert(finnpos_tag_ids(context, 4, word_forms, feature_counts, feature_ids,
+			 id_labels, 0, 0) == 0);
+
+  for (unsigned int i = 0; i < 4; ++i)
+    { assert(id_labels[i] == labels[i]); }
+
+  assert(finnpos_tag(context, 0, 0, 0, 0, 0, 0, 0) == 0);
+
+  finnpos_free_context(context);
+  finnpos_free_model(model);
+
+  // With coarse pruning, requesting marginals does not change the
+  // labels. The label of x depends on the label two words back, so
+  // the first order model that prunes the labels cannot tell P from
+  // Q and pruning changes the label of x in one of the sentences.
+  std::string pruned_contents("a\tWORD=a\ta\tA\t_\n"
+			      "b\tWORD=b\tb\tB\t_\n"
+			      "x\tWORD=x\tx\tP\t_\n"
+			      "\n"
+			      "c\tWORD=c\tc\tC\t_\n"
+			      "b\tWORD=b\tb\tB\t_\n"
+			      "x\tWORD=x\tx\tQ\t_\n");
+
+  std::istringstream pruned_train_in(pruned_contents);
+  std::istringstream pruned_dev_in(pruned_contents);
+
+  TaggerOptions pruned_options(tagger_options);
+  pruned_options.coarse_threshold = 1.1;
+  Tagger pruned_tagger(pruned_options, null_stream);
+  pruned_tagger.train(pruned_train_in, pruned_dev_in);
+
+  model_out.open(filename.c_str(), std::ios::binary);
+  pruned_tagger.store(model_out);
+  model_out.close();
+
+  model = finnpos_load_model(filename.c_str(), 0);
+  remove(filename.c_str());
+  assert(model != 0);
+
+  context = finnpos_new_context(model);
+  assert(context != 0);
+
+  const char * pruned_word_forms[][3] = { { "a", "b", "x" }, 
+					  { "c", "b", "x" } };
+  const char * pruned_features[][3] = { { "WORD=a", "WORD=b", "WORD=x" }, 
+					{ "WORD=c", "WORD=b", "WORD=x" } };
+  unsigned int pruned_feature_counts[] = { 1, 1, 1 };
+  std::string x_labels;
+
+  for (unsigned int i = 0; i < 2; ++i)
+    {
+      unsigned int pruned_labels[3];
+      assert(finnpos_tag(context, 3, pruned_word_forms[i], 
+			 pruned_feature_counts, pruned_features[i], 
+			 pruned_labels, 0, 0) == 0);
+      assert(finnpos_tag(context, 3, pruned_word_forms[i], 
+			 pruned_feature_counts, pruned_features[i], 
+			 labels, 0, marginals) == 0);
+
+      for (unsigned int j = 0; j < 3; ++j)
+	{
+	  assert(labels[j] == pruned_labels[j]);
+	  assert(marginals[j] > 0 and marginals[j] <= 1.0001);
+	}
+
+      x_labels += finnpos_get_label_string(model, labels[2]);
+    }
+
+  // Both sentences get the same label for x, so one of them is wrong.
+  assert(x_labels == "PP" or x_labels == "QQ");
+
+  finnpos_free_context(context);
+  finnpos_free_model(model);
+}
+
+#endif // TEST_FinnPos_cc
@@ -0,0 +1,101 @@
+/**
+ * @file    FinnPos.hh
+ * @Author  Miikka Silfverberg
+ * @brief   C interface for embedding the tagger (libfinnpos).
+ */
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// (C) Copyright 2014, University of Helsinki                                //
+// Licensed under the Apache License, Version 2.0 (the "License");           //
+// you may not use this file except in compliance with the License.          //
+// You may obtain a copy of the License at                                   //
+// http://www.apache.org/licenses/LICENSE-2.0                                //
+// Unless required by applicable law or agreed to in writing, software       //
+// distributed under the License is distributed on an "AS IS" BASIS,         //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  //
+// See the License for the specific language governing permissions and       //
+// limitations under the License.                                            //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+
+
+#ifndef HEADER_FinnPos_hh
+#define HEADER_FinnPos_hh
+
+/**
+ * A model is loaded once and shared by any number of contexts. Each
+ * context decodes one sentence at a time, so threads that tag
+ * concurrently need a context each. Functions that return int return
+ * 0 on success and -1 on failure.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct finnpos_model finnpos_model;
+typedef struct finnpos_context finnpos_context;
+
+// Returned by finnpos_get_feature_id for features missing from the
+// model.
+#define FINNPOS_UNKNOWN_FEATURE 0xffffffffu
+
+// Load @p model_file in either model format. If @p options_file is
+// not NULL, its options replace the options of the model like the
+// conf_file of finnpos-label. Return NULL on failure.
+finnpos_model * finnpos_load_model(const char * model_file,
+				   const char * options_file);
+void finnpos_free_model(finnpos_model * model);
+
+// Return the id of @p feature, which can be passed to
+// finnpos_tag_ids, or FINNPOS_UNKNOWN_FEATURE.
+unsigned int finnpos_get_feature_id(const finnpos_model * model,
+				    const char * feature);
+
+unsigned int finnpos_label_count(const finnpos_model * model);
+
+// Return the label string of label id @p label, or NULL if @p label
+// is not below finnpos_label_count. The string lives as long as
+// @p model.
+const char * finnpos_get_label_string(const finnpos_model * model,
+				      unsigned int label);
+
+finnpos_context * finnpos_new_context(const finnpos_model * model);
+void finnpos_free_context(finnpos_context * context);
+
+// Tag a sentence of @p word_count words. Word i has
+// @p feature_counts[i] feature strings, which follow those of the
+// previous words in @p features. The label id of word i is stored in
+// @p labels[i]. If @p lemmas is not NULL, @p lemmas[i] is set to the
+// lemma of word i, which lives until the next call with @p context.
+// If @p marginals is not NULL, @p marginals[i] is set to the marginal
+// probability of the label of word i. The marginals are computed
+// without coarse pruning, and the labels do not depend on whether
+// they are requested.
+int finnpos_tag(finnpos_context * context,
+		unsigned int word_count,
+		const char * const * word_forms,
+		const unsigned int * feature_counts,
+		const char * const * features,
+		unsigned int * labels,
+		const char ** lemmas,
+		float * marginals);
+
+// Like finnpos_tag but with feature ids from finnpos_get_feature_id.
+// FINNPOS_UNKNOWN_FEATURE ids are skipped.
+int finnpos_tag_ids(finnpos_context * context,
+		    unsigned int word_count,
+		    const char * const * word_forms,
+		    const unsigned int * feature_counts,
+		    const unsigned int * feature_ids,
+		    unsigned int * labels,
+		    const char ** lemmas,
+		    float * marginals);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HEADER_FinnPos_hh
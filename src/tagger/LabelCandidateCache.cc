@@ -0,0 +1,239 @@
+/**
+ * @file    LabelCandidateCache.cc
+ * @Author  Miikka Silfverberg
+ * @brief   Bounded thread safe cache of label candidates by word form.
+ */
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// (C) Copyright 2014, University of Helsinki                                //
+// Licensed under the Apache License, Version 2.0 (the "License");           //
+// you may not use this file except in compliance with the License.          //
+// You may obtain a copy of the License at                                   //
+// http://www.apache.org/licenses/LICENSE-2.0                                //
+// Unless required by applicable law or agreed to in writing, software       //
+// distributed under the License is distributed on an "AS IS" BASIS,         //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  //
+// See the License for the specific language governing permissions and       //
+// limitations under the License.                                            //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+
+
+#include "LabelCandidateCache.hh"
+
+#ifndef TEST_LabelCandidateCache_cc
+
+#include <functional>
+
+LabelCandidateCache::LabelCandidateCache(size_t capacity):
+  shard_capacity((capacity + LABEL_CANDIDATE_CACHE_SHARDS - 1) / 
+		 LABEL_CANDIDATE_CACHE_SHARDS),
+  hit_count(0),
+  miss_count(0)
+{
+  for (unsigned int i = 0; i < LABEL_CANDIDATE_CACHE_SHARDS; ++i)
+    { shards[i].hand = 0; }
+}
+
+LabelCandidateCache::Shard &LabelCandidateCache::get_shard
+(const std::string &word_form)
+{ 
+  return shards[std::hash<std::string>()(word_form) % 
+		LABEL_CANDIDATE_CACHE_SHARDS]; 
+}
+
+bool LabelCandidateCache::find(const std::string &word_form,
+			       bool use_lexicon,
+			       float mass,
+			       int candidate_count,
+			       LabelVector &target)
+{
+  Shard &shard = get_shard(word_form);
+
+  {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    EntryIndex::const_iterator it = shard.index.find(word_form);
+
+    if (it != shard.index.end())
+      {
+	Entry &entry = shard.entries[it->second];
+
+	if (entry.use_lexicon == use_lexicon and 
+	    entry.mass == mass and 
+	    entry.candidate_count == candidate_count)
+	  {
+	    entry.referenced = 1;
+	    target = entry.labels;
+	    hit_count.fetch_add(1, std::memory_order_relaxed);
+	    return 1;
+	  }
+      }
+  }
+
+  miss_count.fetch_add(1, std::memory_order_relaxed);
+  return 0;
+}
+
+void LabelCandidateCache::insert(const std::string &word_form,
+				 bool use_lexicon,
+				 float mass,
+				 int candidate_count,
+				 const LabelVector &labels)
+{
+  if (shard_capacity == 0)
+    { return; }
+
+  Shard &shard = get_shard(word_form);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+
+  size_t i = 0;
+  EntryIndex::const_iterator it = shard.index.find(word_form);
+
+  if (it != shard.index.end())
+    { i = it->second; }
+  else if (shard.entries.size() < shard_capacity)
+    {
+      i = shard.entries.size();
+      shard.entries.push_back(Entry());
+      shard.index[word_form] = i;
+    }
+  else
+    {
+      while (shard.entries[shard.hand].referenced)
+	{
+	  shard.entries[shard.hand].referenced = 0;
+	  shard.hand = (shard.hand + 1) % shard.entries.size();
+	}
+
+      i = shard.hand;
+      shard.hand = (shard.hand + 1) % shard.entries.size();
+
+      shard.index.erase(shard.entries[i].word_form);
+      shard.index[word_form] = i;
+    }
+
+  Entry &entry = shard.entries[i];
+  entry.word_form = word_form;
+  entry.use_lexicon = use_lexicon;
+  entry.mass = mass;
+  entry.candidate_count = candidate_count;
+  entry.labels = labels;
+  entry.referenced = 0;
+}
+
+unsigned long LabelCandidateCache::get_hit_count(void) const
+{ return hit_count.load(std::memory_order_relaxed); }
+
+unsigned long LabelCandidateCache::get_miss_count(void) const
+{ return miss_count.load(std::memory_order_relaxed); }
+
+size_t LabelCandidateCache::size(void) const
+{
+  size_t res = 0;
+
+  for (unsigned int i = 0; i < LABEL_CANDIDATE_CACHE_SHARDS; ++i)
+    {
+      std::lock_guard<std::mutex> lock(shards[i].mutex);
+      res += shards[i].entries.size();
+    }
+
+  return res;
+}
+
+#else // TEST_LabelCandidateCache_cc
+
+#include <cassert>
+#include <sstream>
+#include <thread>
+
+void lookup_range(LabelCandidateCache * cache, unsigned int begin, 
+		  unsigned int end)
+{
+  LabelVector labels;
+
+  for (unsigned int i = begin; i < end; ++i)
+    {
+      std::ostringstream wf;
+      wf << "w" << i % 100;
+
+      if (cache->find(wf.str(), 0, 0.99, -1, labels))
+	{ assert(labels == LabelVector(1, i % 100)); }
+      else
+	{ cache->insert(wf.str(), 0, 0.99, -1, LabelVector(1, i % 100)); }
+    }
+}
+
+int main(void)
+{
+  LabelCandidateCache cache(2 * LABEL_CANDIDATE_CACHE_SHARDS);
+  LabelVector labels;
+
+  assert(not cache.find("dog", 0, 0.99, -1, labels));
+  assert(cache.get_miss_count() == 1);
+
+  LabelVector dog_labels;
+  dog_labels.push_back(1);
+  dog_labels.push_back(2);
+  cache.insert("dog", 0, 0.99, -1, dog_labels);
+
+  assert(cache.find("dog", 0, 0.99, -1, labels));
+  assert(labels == dog_labels);
+  assert(cache.get_hit_count() == 1);
+
+  // Other arguments miss and replace the entry.
+  assert(not cache.find("dog", 1, 0.99, -1, labels));
+  assert(not cache.find("dog", 0, 0.5, -1, labels));
+  assert(not cache.find("dog", 0, 0.99, 3, labels));
+  cache.insert("dog", 0, 0.99, 3, LabelVector(1, 1));
+  assert(cache.size() == 1);
+  assert(cache.find("dog", 0, 0.99, 3, labels));
+  assert(labels == LabelVector(1, 1));
+  assert(not cache.find("dog", 0, 0.99, -1, labels));
+
+  // The cache stays bounded.
+  for (unsigned int i = 0; i < 1000; ++i)
+    {
+      std::ostringstream wf;
+      wf << i;
+      cache.insert(wf.str(), 0, 0.99, -1, LabelVector(1, i));
+    }
+
+  assert(cache.size() <= 2 * LABEL_CANDIDATE_CACHE_SHARDS);
+
+  // An entry that is hit between inserts is never evicted.
+  LabelCandidateCache clock_cache(2 * LABEL_CANDIDATE_CACHE_SHARDS);
+  clock_cache.insert("dog", 0, 0.99, -1, dog_labels);
+
+  for (unsigned int i = 0; i < 1000; ++i)
+    {
+      assert(clock_cache.find("dog", 0, 0.99, -1, labels));
+
+      std::ostringstream wf;
+      wf << i;
+      clock_cache.insert(wf.str(), 0, 0.99, -1, LabelVector(1, i));
+    }
+
+  assert(clock_cache.find("dog", 0, 0.99, -1, labels));
+
+  LabelCandidateCache no_cache(0);
+  no_cache.insert("dog", 0, 0.99, -1, dog_labels);
+  assert(not no_cache.find("dog", 0, 0.99, -1, labels));
+
+  // Concurrent lookups and inserts.
+  LabelCandidateCache shared_cache(64);
+  std::vector<std::thread> threads;
+
+  for (unsigned int i = 0; i < 4; ++i)
+    { threads.push_back(std::thread(lookup_range, &shared_cache, 0, 10000)); }
+
+  for (unsigned int i = 0; i < threads.size(); ++i)
+    { threads[i].join(); }
+
+  assert(shared_cache.get_hit_count() + shared_cache.get_miss_count() == 
+	 40000);
+  assert(shared_cache.size() <= 64);
+}
+
+#endif // TEST_LabelCandidateCache_cc
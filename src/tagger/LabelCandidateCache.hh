@@ -0,0 +1,111 @@
+/**
+ * @file    LabelCandidateCache.hh
+ * @Author  Miikka Silfverberg
+ * @brief   Bounded thread safe cache of label candidates by word form.
+ */
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// (C) Copyright 2014, University of Helsinki                                //
+// Licensed under the Apache License, Version 2.0 (the "License");           //
+// you may not use this file except in compliance with the License.          //
+// You may obtain a copy of the License at                                   //
+// http://www.apache.org/licenses/LICENSE-2.0                                //
+// Unless required by applicable law or agreed to in writing, software       //
+// distributed under the License is distributed on an "AS IS" BASIS,         //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  //
+// See the License for the specific language governing permissions and       //
+// limitations under the License.                                            //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+
+
+#ifndef HEADER_LabelCandidateCache_hh
+#define HEADER_LabelCandidateCache_hh
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cstddef>
+//#include <unordered_map>
+#include "UnorderedMapSet.hh"
+
+#include "SuffixLabelMap.hh"
+
+const unsigned int LABEL_CANDIDATE_CACHE_SHARDS = 16;
+
+// Default number of word forms cached by LabelExtractor.
+const size_t LABEL_CANDIDATE_CACHE_SIZE = 1 << 16;
+
+/**
+ * @brief Map from the arguments of LabelExtractor::set_label_candidates
+ * to the candidates it produced, holding at most a fixed number of
+ * word forms.
+ *
+ * Entries are indexed by word form, so a lookup does not allocate. A
+ * lookup with other arguments than those of the cached entry is a
+ * miss and the following insert replaces the entry. Each of
+ * LABEL_CANDIDATE_CACHE_SHARDS shards has its own lock and evicts
+ * with the CLOCK algorithm: hits set the reference bit of an entry
+ * and eviction passes over referenced entries once, clearing the bit.
+ */
+class LabelCandidateCache
+{
+public:
+  LabelCandidateCache(size_t capacity);
+
+  // Copy the candidates cached for the arguments to @p target and
+  // return true, or return false. Thread safe.
+  bool find(const std::string &word_form,
+	    bool use_lexicon,
+	    float mass,
+	    int candidate_count,
+	    LabelVector &target);
+
+  // Cache @p labels for the arguments. Thread safe.
+  void insert(const std::string &word_form,
+	      bool use_lexicon,
+	      float mass,
+	      int candidate_count,
+	      const LabelVector &labels);
+
+  unsigned long get_hit_count(void) const;
+  unsigned long get_miss_count(void) const;
+  size_t size(void) const;
+
+private:
+  LabelCandidateCache(const LabelCandidateCache &another);
+  LabelCandidateCache &operator=(const LabelCandidateCache &another);
+
+  struct Entry
+  {
+    std::string word_form;
+    bool use_lexicon;
+    float mass;
+    int candidate_count;
+    LabelVector labels;
+    bool referenced;
+  };
+
+  typedef std::unordered_map<std::string, size_t> EntryIndex;
+
+  struct Shard
+  {
+    mutable std::mutex mutex;
+    std::vector<Entry> entries;
+    EntryIndex index;
+    size_t hand;
+  };
+
+  size_t shard_capacity;
+  Shard shards[LABEL_CANDIDATE_CACHE_SHARDS];
+
+  std::atomic<unsigned long> hit_count;
+  std::atomic<unsigned long> miss_count;
+
+  Shard &get_shard(const std::string &word_form);
+};
+
+#endif // HEADER_LabelCandidateCache_hh
@@ -33,15 +33,17 @@ std::string get_suffix(const std::string &wf, unsigned int length);
 #define PADDING "^^^^^^^^^^" 
 #define PADDING_LEN 10 
 
-int LabelExtractor::all_time_word_count = 0;
-int LabelExtractor::all_time_guess_count = 0;
+std::atomic<int> LabelExtractor::all_time_word_count(0);
+std::atomic<int> LabelExtractor::all_time_guess_count(0);
 
 LabelExtractor::LabelExtractor(unsigned int max_suffix_len,
 			       unsigned int min_guess_count):
   max_suffix_len(max_suffix_len),
-  max_guesses(50)
+  max_guesses(50),
+  candidate_cache_size(LABEL_CANDIDATE_CACHE_SIZE)
 {
   static_cast<void>(get_label("_#_"));
+  reset_candidate_cache();
 
   for (unsigned int i = 0; i < max_suffix_len + 1; ++i)
     { 
@@ -51,9 +53,11 @@ LabelExtractor::LabelExtractor(unsigned int max_suffix_len,
 
 LabelExtractor::LabelExtractor(const TaggerOptions &tagger_options):
   max_suffix_len(tagger_options.suffix_length),
-  max_guesses(tagger_options.guess_count_limit)
+  max_guesses(tagger_options.guess_count_limit),
+  candidate_cache_size(LABEL_CANDIDATE_CACHE_SIZE)
 {
   static_cast<void>(get_label("_#_"));
+  reset_candidate_cache();
 
   for (unsigned int i = 0; i < max_suffix_len + 1; ++i)
     { 
@@ -71,34 +75,42 @@ unsigned int LabelExtractor::get_boundary_label(void) const
 
 unsigned int LabelExtractor::get_label(const std::string &label_string)
 {
-  if (label_map.find(label_string) == label_map.end())
-    {
-      unsigned int id = label_map.size();
-      label_map[label_string] = id;
-      string_map.push_back(label_string);
+  // Known labels are looked up without modifying the maps, so
+  // sentences can be parsed concurrently (see Tagger::label_stream).
+  std::unordered_map<std::string, unsigned int>::const_iterator it = 
+    label_map.find(label_string);
 
-      if (label_string.find('|') != std::string::npos)
-	{
-	  StringVector sub_label_strings;
-	  split(label_string, sub_label_strings, '|');
-	  LabelVector &sub_labels = sub_label_map[id];
+  if (it != label_map.end())
+    { return it->second; }
 
-	  assert(sub_labels.empty());
+  unsigned int id = label_map.size();
+  label_map[label_string] = id;
+  string_map.push_back(label_string);
 
-	  for (unsigned int i = 0; i < sub_label_strings.size(); ++i)
-	    {
-	      sub_labels.push_back(get_label("SL:" + sub_label_strings[i]));
-	    }
-	}
-      /*      else
+  if (label_string.find('|') != std::string::npos)
+    {
+      StringVector sub_label_strings;
+      split(label_string, sub_label_strings, '|');
+      LabelVector &sub_labels = sub_label_map[id];
+
+      assert(sub_labels.empty());
+
+      for (unsigned int i = 0; i < sub_label_strings.size(); ++i)
 	{
-	  sub_label_map[id].push_back(id);
-	  }*/
+	  sub_labels.push_back(get_label("SL:" + sub_label_strings[i]));
+	}
     }
+  /*      else
+    {
+      sub_label_map[id].push_back(id);
+      }*/
 
-  return label_map[label_string];
+  return id;
 }
 
+bool LabelExtractor::has_label(const std::string &label_string) const
+{ return label_map.count(label_string) != 0; }
+
 LabelVector no_sub_labels;
 
 const LabelVector &LabelExtractor::sub_labels(unsigned int label) const
@@ -221,6 +233,8 @@ void LabelExtractor::train(Data &data)
 	    }
 	} 
     }  
+
+  reset_candidate_cache();
 }
 
 bool LabelExtractor::is_oov(const std::string &wf) const
@@ -243,6 +257,33 @@ void LabelExtractor::set_label_candidates(const std::string &word_form,
 
   all_time_word_count += 1;
 
+  // Otherwise the candidates depend on the labels in target.
+  if (target.empty() and candidate_cache_size != 0)
+    {
+      if (not candidate_cache->find(word_form, use_lexicon, mass, 
+				    candidate_count, target))
+	{
+	  compute_label_candidates(word_form, use_lexicon, mass, target, 
+				   candidate_count);
+	  candidate_cache->insert(word_form, use_lexicon, mass, 
+				  candidate_count, target);
+	}
+    }
+  else
+    { 
+      compute_label_candidates(word_form, use_lexicon, mass, target, 
+			       candidate_count); 
+    }
+
+  all_time_guess_count += target.size();
+}
+
+void LabelExtractor::compute_label_candidates(const std::string &word_form, 
+					      bool use_lexicon,
+					      float mass, 
+					      LabelVector &target,
+					      int candidate_count) const
+{
   if (use_lexicon and lexicon.count(word_form) != 0)
     {
       target.clear();
@@ -250,21 +291,14 @@ void LabelExtractor::set_label_candidates(const std::string &word_form,
       SubstringLabelMap::const_iterator it = lexicon.find(word_form);
       label_set.insert(it->second.begin(), it->second.end());
       target.assign(label_set.begin(), label_set.end());
-      all_time_guess_count += target.size();
       return;
     }
 
   if (use_lexicon and not target.empty())
-    { 
-      all_time_guess_count += target.size();
-      return; 
-    }
+    { return; }
 
   if (mass == 0 and not target.empty())
-    {
-      all_time_guess_count += target.size(); 
-      return; 
-    }
+    { return; }
 
   int wf_len = 
     (word_form.size() < max_suffix_len ? word_form.size() : max_suffix_len); 
@@ -287,13 +321,32 @@ void LabelExtractor::set_label_candidates(const std::string &word_form,
     {
       target.erase(target.begin() + max_guesses, target.end()); 
     }
-  all_time_guess_count += target.size();
 }
 
 void LabelExtractor::set_options(TaggerOptions &tagger_options)
 {
   max_suffix_len = tagger_options.suffix_length;
   max_guesses = tagger_options.guess_count_limit;
+  reset_candidate_cache();
+}
+
+void LabelExtractor::set_candidate_cache_size(size_t size)
+{
+  candidate_cache_size = size;
+  reset_candidate_cache();
+}
+
+unsigned long LabelExtractor::get_candidate_cache_hits(void) const
+{ return candidate_cache->get_hit_count(); }
+
+unsigned long LabelExtractor::get_candidate_cache_misses(void) const
+{ return candidate_cache->get_miss_count(); }
+
+void LabelExtractor::reset_candidate_cache(void)
+{
+  // Copies of this extractor keep the old cache, which is still
+  // valid for their model.
+  candidate_cache.reset(new LabelCandidateCache(candidate_cache_size));
 }
 
 const std::string &LabelExtractor::get_label_string(unsigned int label) const
@@ -349,6 +402,8 @@ void LabelExtractor::load(std::istream &in, bool reverse_bytes)
 
   read_map(in, oov_words, reverse_bytes);
   read_map(in, open_classes, reverse_bytes);
+
+  reset_candidate_cache();
 }
 
 bool LabelExtractor::operator==(const LabelExtractor &another) const
@@ -428,6 +483,20 @@ int main(void)
   le.set_label_candidates("dog", 1, 5, dog_labels);
   assert(dog_labels.size() == 1);
 
+  // Repeated word forms come from the candidate cache.
+  unsigned long hits = le.get_candidate_cache_hits();
+  LabelVector cached_labels;
+  le.set_label_candidates("hog", 0, 1.01, cached_labels);
+  assert(cached_labels == labels2);
+  assert(le.get_candidate_cache_hits() == hits + 1);
+
+  le.set_candidate_cache_size(0);
+  LabelVector uncached_labels;
+  le.set_label_candidates("hog", 0, 1.01, uncached_labels);
+  assert(uncached_labels == labels2);
+  assert(le.get_candidate_cache_hits() == 0);
+  assert(le.get_candidate_cache_misses() == 0);
+
   std::ostringstream le_out;
   le.store(le_out);
   std::istringstream le_in(le_out.str());
@@ -24,12 +24,15 @@
 
 #include <string>
 #include <vector>
+#include <atomic>
+#include <memory>
 //#include <unordered_map>
 #include "UnorderedMapSet.hh"
 
 #include "io.hh"
 #include "exceptions.hh"
 #include "SuffixLabelMap.hh"
+#include "LabelCandidateCache.hh"
 #include "TaggerOptions.hh"
 
 class Data;
@@ -37,22 +40,33 @@ class Data;
 class LabelExtractor
 {
  public:
-  static int all_time_word_count;
-  static int all_time_guess_count;
+  // Updated by concurrent label_stream workers.
+  static std::atomic<int> all_time_word_count;
+  static std::atomic<int> all_time_guess_count;
 
   LabelExtractor(unsigned int max_suffix_len=10,
 		 unsigned int min_guess_count = 20);
   LabelExtractor(const TaggerOptions &tagger_options);
   virtual ~LabelExtractor(void);
 
+  // The candidates for an empty @p target are cached (see
+  // set_candidate_cache_size).
   virtual void set_label_candidates(const std::string &word_form,
 				    bool use_lexicon,
 				    float mass, 
 				    LabelVector &target,
 				    int candidate_count = -1) const;
+
+  // Cache the label candidates of at most @p size word forms. 0
+  // disables the cache. The cache is cleared whenever the model
+  // changes.
+  void set_candidate_cache_size(size_t size);
+  unsigned long get_candidate_cache_hits(void) const;
+  unsigned long get_candidate_cache_misses(void) const;
   void train(Data &data);
   unsigned int get_boundary_label(void) const;
   unsigned int get_label(const std::string &label_string);
+  bool has_label(const std::string &label_string) const;
   LabelVector get_labels(const StringVector &label_strings);
   const std::string &get_label_string(unsigned int label) const;
   unsigned int label_count(void) const;
@@ -84,6 +98,16 @@ private:
   SubLabelMap sub_label_map;
   std::unordered_map<std::string, unsigned int> oov_words;
   LabelCountMap open_classes;
+
+  size_t candidate_cache_size;
+  std::shared_ptr<LabelCandidateCache> candidate_cache;
+
+  void compute_label_candidates(const std::string &word_form,
+				bool use_lexicon,
+				float mass, 
+				LabelVector &target,
+				int candidate_count) const;
+  void reset_candidate_cache(void);
 };
 
 #endif // HEADER_LabelExtractor_hh
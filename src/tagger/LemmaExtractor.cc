@@ -46,6 +46,7 @@ bool has_upper(const std::string &word);
 
 #include "PerceptronTrainer.hh"
 #include "Word.hh"
+#include "MappedModel.hh"
 
 #define PADDING "^^^^^^^^^^" 
 
@@ -232,6 +233,45 @@ unsigned int LemmaExtractor::get_class_number(const std::string &word,
 void LemmaExtractor::store(std::ostream &out) const
 {
   param_table.store(out);
+  store_dicts(out);
+}
+
+void LemmaExtractor::load(std::istream &in, bool reverse_bytes)
+{
+  param_table.load(in, reverse_bytes);
+  load_dicts(in, reverse_bytes);
+
+  param_table.set_label_extractor(dummy_extractor);
+  param_table.compile();
+}
+
+void LemmaExtractor::store_mapped(MappedModelWriter &writer) const
+{
+  std::ostringstream param_out;
+  param_table.store_mapped(param_out);
+  writer.add_section(LEMMA_PARAM_SECTION, param_out.str());
+
+  std::ostringstream dict_out;
+  store_dicts(dict_out);
+  writer.add_section(LEMMA_EXTRACTOR_SECTION, dict_out.str());
+}
+
+void LemmaExtractor::load_mapped(const MappedModel &model)
+{
+  size_t size;
+  const char * data = model.get_section(LEMMA_PARAM_SECTION, size);
+  param_table.load_mapped(data, size);
+
+  data = model.get_section(LEMMA_EXTRACTOR_SECTION, size);
+  MemoryInputBuffer buffer(data, size);
+  std::istream in(&buffer);
+  load_dicts(in, false);
+
+  param_table.set_label_extractor(dummy_extractor);
+}
+
+void LemmaExtractor::store_dicts(std::ostream &out) const
+{
   write_val(out, class_count);
   write_map(out, lemma_lexicon);
   write_map<std::string, std::string, unsigned int>
@@ -242,9 +282,8 @@ void LemmaExtractor::store(std::ostream &out) const
   write_val(out, max_passes);
 }
 
-void LemmaExtractor::load(std::istream &in, bool reverse_bytes)
+void LemmaExtractor::load_dicts(std::istream &in, bool reverse_bytes)
 {
-  param_table.load(in, reverse_bytes);
   read_val<unsigned int>(in, class_count, reverse_bytes);
   read_map(in, lemma_lexicon, reverse_bytes);
   read_map<std::string, std::string, unsigned int>
@@ -253,8 +292,6 @@ void LemmaExtractor::load(std::istream &in, bool reverse_bytes)
   read_map(in, feat_dict, reverse_bytes);
   read_map(in, word_form_dict, reverse_bytes);
   read_val<size_t>(in, max_passes, reverse_bytes);
-
-  param_table.set_label_extractor(dummy_extractor);
 }
 
 bool LemmaExtractor::operator==(const LemmaExtractor &another) const
@@ -387,15 +424,14 @@ std::string get_feats(const std::string &label)
     { return label.substr(label.find('|')); }
 }
 
-Word * LemmaExtractor::extract_feats(const std::string &word_form, 
-				     const std::string &label,
-				     bool use_label)
+void LemmaExtractor::get_feat_strings(const std::string &word_form, 
+				      const std::string &label,
+				      bool use_label,
+				      StringVector &feats) const
 {
   std::string word = lowercase(word_form);
 
-  FeatureTemplateVector feats;
-  
-  feats.push_back( get_feat_id("WORD=" + /*word_form*/word) );
+  feats.push_back("WORD=" + /*word_form*/word);
 
   std::string padded_word_form = PADDING + /*word_form*/word;
 
@@ -405,9 +441,9 @@ Word * LemmaExtractor::extract_feats(const std::string &word_form,
        i <= padded_word_form.size();
        ++i)
     {
-      feats.push_back( get_feat_id("SUFFIX=" + padded_word_form.substr(i)) );
-      feats.push_back( get_feat_id("SUFFIX=" + padded_word_form.substr(i) + " LABEL=" + label) );
-      //      feats.push_back( get_feat_id("SUFFIX=" + padded_word_form.substr(i) + " MAIN_LABEL=" + main_label) );
+      feats.push_back("SUFFIX=" + padded_word_form.substr(i));
+      feats.push_back("SUFFIX=" + padded_word_form.substr(i) + " LABEL=" + label);
+      //      feats.push_back("SUFFIX=" + padded_word_form.substr(i) + " MAIN_LABEL=" + main_label);
     }
 
   //  padded_word_form = /*word_form*/word + PADDING;
@@ -418,38 +454,70 @@ Word * LemmaExtractor::extract_feats(const std::string &word_form,
       if (i > padded_word_form.size() - 1)
 	{ break; }
 
-      feats.push_back( get_feat_id("PREFIX=" + padded_word_form.substr(0,i)));
-      feats.push_back( get_feat_id("PREFIX=" + padded_word_form.substr(0,i) + " LABEL=" + label) );
-      //      feats.push_back( get_feat_id("PREFIX=" + padded_word_form.substr(0,i) + " MAIN_LABEL=" + main_label) );
+      feats.push_back("PREFIX=" + padded_word_form.substr(0,i));
+      feats.push_back("PREFIX=" + padded_word_form.substr(0,i) + " LABEL=" + label);
+      //      feats.push_back("PREFIX=" + padded_word_form.substr(0,i) + " MAIN_LABEL=" + main_label);
     }
   
-  feats.push_back(get_feat_id("INFIX4=" + padded_word_form.substr(0, padded_word_form.size() - 2).substr(padded_word_form.size() - 4)));
-  feats.push_back(get_feat_id("INFIX4=" + padded_word_form.substr(0, padded_word_form.size() - 2).substr(padded_word_form.size() - 4) 
-			      + " LABEL=" + label));
+  feats.push_back("INFIX4=" + padded_word_form.substr(0, padded_word_form.size() - 2).substr(padded_word_form.size() - 4));
+  feats.push_back("INFIX4=" + padded_word_form.substr(0, padded_word_form.size() - 2).substr(padded_word_form.size() - 4) 
+		  + " LABEL=" + label);
 
-  feats.push_back(get_feat_id("INFIX5=" + padded_word_form.substr(0, padded_word_form.size() - 3).substr(padded_word_form.size() - 5)));
-  feats.push_back(get_feat_id("INFIX5=" + padded_word_form.substr(0, padded_word_form.size() - 3).substr(padded_word_form.size() - 5) 
-			      + " LABEL=" + label));
+  feats.push_back("INFIX5=" + padded_word_form.substr(0, padded_word_form.size() - 3).substr(padded_word_form.size() - 5));
+  feats.push_back("INFIX5=" + padded_word_form.substr(0, padded_word_form.size() - 3).substr(padded_word_form.size() - 5) 
+		  + " LABEL=" + label);
 
-  feats.push_back(get_feat_id("INFIX6=" + padded_word_form.substr(0, padded_word_form.size() - 4).substr(padded_word_form.size() - 6)));
-  feats.push_back(get_feat_id("INFIX6=" + padded_word_form.substr(0, padded_word_form.size() - 4).substr(padded_word_form.size() - 6)
-			      + " LABEL=" + label));
+  feats.push_back("INFIX6=" + padded_word_form.substr(0, padded_word_form.size() - 4).substr(padded_word_form.size() - 6));
+  feats.push_back("INFIX6=" + padded_word_form.substr(0, padded_word_form.size() - 4).substr(padded_word_form.size() - 6)
+		  + " LABEL=" + label);
 
   if (use_label)
     {
-      feats.push_back( get_feat_id("LABEL=" + label) );  
-      feats.push_back( get_feat_id("MFEATS=" + get_feats(label)) );  
-      //feats.push_back( get_feat_id("MAIN_LABEL=" + get_main_label(label)) );
+      feats.push_back("LABEL=" + label);  
+      feats.push_back("MFEATS=" + get_feats(label));  
+      //feats.push_back("MAIN_LABEL=" + get_main_label(label));
     }
 
   if (has_upper(word_form))
-    { feats.push_back( get_feat_id("UC") ); }
+    { feats.push_back("UC"); }
 
   if (has_digit(word_form))
-    { feats.push_back( get_feat_id("DIGIT") ); }
+    { feats.push_back("DIGIT"); }
+
+}
+
+Word * LemmaExtractor::extract_feats(const std::string &word_form, 
+				     const std::string &label,
+				     bool use_label)
+{
+  StringVector feat_strings;
+  get_feat_strings(word_form, label, use_label, feat_strings);
+
+  FeatureTemplateVector feats;
+
+  for (unsigned int i = 0; i < feat_strings.size(); ++i)
+    { feats.push_back(get_feat_id(feat_strings[i])); }
+
+  return new Word(word_form, feats, LabelVector(), "");
+}
+
+Word * LemmaExtractor::extract_known_feats(const std::string &word_form, 
+					   const std::string &label) const
+{
+  StringVector feat_strings;
+  get_feat_strings(word_form, label, true, feat_strings);
+
+  FeatureTemplateVector feats;
+
+  for (unsigned int i = 0; i < feat_strings.size(); ++i)
+    {
+      ClassIDMap::const_iterator it = feat_dict.find(feat_strings[i]);
+
+      if (it != feat_dict.end())
+	{ feats.push_back(it->second); }
+    }
 
   return new Word(word_form, feats, LabelVector(), "");
-  static_cast<void>(label);
 }
 
 unsigned int LemmaExtractor::get_feat_id(const std::string &feat_string)
@@ -493,7 +561,7 @@ std::string LemmaExtractor::get_lemma(const std::string &word_form,
 }
 
 unsigned int LemmaExtractor::get_lemma_candidate_class(const Word &w,
-						       ParamTable * pt)
+						       const ParamTable * pt) const
 {
   if (pt == 0)
     { pt = &param_table; }
@@ -522,9 +590,9 @@ unsigned int LemmaExtractor::get_lemma_candidate_class(const Word &w,
 
 unsigned int LemmaExtractor::get_lemma_candidate_class
 (const std::string &word_form, 
- const std::string &label)
+ const std::string &label) const
 {
-  Word * w = extract_feats(word_form, label);
+  Word * w = extract_known_feats(word_form, label);
 
   unsigned int klass = get_lemma_candidate_class(*w);
 
@@ -534,18 +602,19 @@ unsigned int LemmaExtractor::get_lemma_candidate_class
 }
 
 std::string LemmaExtractor::get_lemma_candidate(const std::string &word_form, 
-						const std::string &label)
+						const std::string &label) const
 {
-  std::string lexicon_entry = word_form + "<W+LA>" + label;
+  LemmaLexicon::const_iterator it = 
+    lemma_lexicon.find(word_form + "<W+LA>" + label);
 
-  if (lemma_lexicon.count(lexicon_entry) != 0)
-    { return lemma_lexicon[lexicon_entry]; }
+  if (it != lemma_lexicon.end())
+    { return it->second; }
 
   // FIXME
-  lexicon_entry = word_form + "<W>";
+  it = lemma_lexicon.find(word_form + "<W>");
 
-  if (lemma_lexicon.count(lexicon_entry) != 0)
-    { return lemma_lexicon[lexicon_entry]; }
+  if (it != lemma_lexicon.end())
+    { return it->second; }
 
   return get_lemma(word_form, 
 		   get_lemma_candidate_class(word_form, 
@@ -39,6 +39,8 @@ typedef std::vector<unsigned int> LemmaVector;
 class Word;
 class Data;
 class PerceptronTrainer;
+class MappedModel;
+class MappedModelWriter;
 
 std::string lowercase(const std::string &word);
 
@@ -56,7 +58,7 @@ class LemmaExtractor
 	     const TaggerOptions &options);
 
   virtual std::string get_lemma_candidate(const std::string &word_form, 
-					  const std::string &label);
+					  const std::string &label) const;
 
   virtual bool is_known_wf(const std::string &word_form) const;
 
@@ -66,6 +68,8 @@ class LemmaExtractor
 
   void store(std::ostream &out) const;
   void load(std::istream &in, bool reverse_bytes);
+  void store_mapped(MappedModelWriter &writer) const;
+  void load_mapped(const MappedModel &model);
   bool operator==(const LemmaExtractor &another) const;
 protected:
   typedef std::pair<std::string, std::string> StringPair;
@@ -88,6 +92,9 @@ protected:
 
   void extract_classes(const Data &data, const LabelExtractor &le);
 
+  void store_dicts(std::ostream &out) const;
+  void load_dicts(std::istream &in, bool reverse_bytes);
+
   unsigned int get_feat_id(const std::string &feat_string);
 
   unsigned int get_class_number(const std::string &word, 
@@ -99,14 +106,26 @@ protected:
   void set_class_candidates(const std::string &word,
 			    LabelVector &class_vector) const;
 
+  void get_feat_strings(const std::string &word_form, 
+			const std::string &label,
+			bool use_label,
+			StringVector &feat_strings) const;
+
   Word *  extract_feats(const std::string &word_form, 
 			const std::string &label,
 			bool use_label = true);
+
+  // Like extract_feats but skips features missing from feat_dict
+  // instead of adding them. They have no parameters, so the scores
+  // are the same.
+  Word *  extract_known_feats(const std::string &word_form, 
+			      const std::string &label) const;
   
   unsigned int get_lemma_candidate_class(const std::string &word_form, 
-					 const std::string &label);
+					 const std::string &label) const;
 
-  unsigned int get_lemma_candidate_class(const Word &w, ParamTable * pt = 0);
+  unsigned int get_lemma_candidate_class(const Word &w, 
+					 const ParamTable * pt = 0) const;
 
 
   std::string get_lemma(const std::string &word_form, 
@@ -0,0 +1,296 @@
+/**
+ * @file    LogSumExp.cc
+ * @Author  Miikka Silfverberg
+ * @brief   Log-sum-exp of score rows with SSE2 and AVX2 kernels.
+ */
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// (C) Copyright 2014, University of Helsinki                                //
+// Licensed under the Apache License, Version 2.0 (the "License");           //
+// you may not use this file except in compliance with the License.          //
+// You may obtain a copy of the License at                                   //
+// http://www.apache.org/licenses/LICENSE-2.0                                //
+// Unless required by applicable law or agreed to in writing, software       //
+// distributed under the License is distributed on an "AS IS" BASIS,         //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  //
+// See the License for the specific language governing permissions and       //
+// limitations under the License.                                            //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+#include "LogSumExp.hh"
+
+#include <cfloat>
+#include <cmath>
+
+#if defined(__SSE2__) and not defined(SCALAR_LOGSUMEXP)
+#define SIMD_LOGSUMEXP
+#include <immintrin.h>
+#endif
+
+#ifndef TEST_LogSumExp_cc
+
+typedef float (*LogSumExpKernel)(const float * scores, unsigned int count);
+
+#ifndef SIMD_LOGSUMEXP
+
+static float scalar_log_sum_exp(const float * scores, unsigned int count)
+{
+  float max = -FLT_MAX;
+
+  for (unsigned int i = 0; i < count; ++i)
+    { max = (scores[i] > max ? scores[i] : max); }
+
+  if (max == -FLT_MAX)
+    { return -FLT_MAX; }
+
+  float sum = 0;
+
+  for (unsigned int i = 0; i < count; ++i)
+    { sum += exp(scores[i] - max); }
+
+  return max + log(sum);
+}
+
+#else // SIMD_LOGSUMEXP
+
+// The SIMD kernels compute exp(x) for x <= 0 like Cephes expf: x =
+// n * log(2) + r with |r| <= log(2) / 2 and exp(r) is a polynomial.
+// Inputs below -87 are clamped, which changes the sum by less than
+// 1e-37 since the largest term is 1.
+
+static const float EXP_MIN_ARG = -87.0f;
+static const float LOG2E = 1.44269504088896341f;
+static const float EXP_C1 = 0.693359375f;
+static const float EXP_C2 = -2.12194440e-4f;
+static const float EXP_P0 = 1.9875691500e-4f;
+static const float EXP_P1 = 1.3981999507e-3f;
+static const float EXP_P2 = 8.3334519073e-3f;
+static const float EXP_P3 = 4.1665795894e-2f;
+static const float EXP_P4 = 1.6666665459e-1f;
+static const float EXP_P5 = 5.0000001201e-1f;
+
+static inline __m128 sse2_exp(__m128 x)
+{
+  x = _mm_max_ps(x, _mm_set1_ps(EXP_MIN_ARG));
+
+  __m128i n = _mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(LOG2E)));
+  __m128 nf = _mm_cvtepi32_ps(n);
+
+  x = _mm_sub_ps(x, _mm_mul_ps(nf, _mm_set1_ps(EXP_C1)));
+  x = _mm_sub_ps(x, _mm_mul_ps(nf, _mm_set1_ps(EXP_C2)));
+
+  __m128 y = _mm_set1_ps(EXP_P0);
+  y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(EXP_P1));
+  y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(EXP_P2));
+  y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(EXP_P3));
+  y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(EXP_P4));
+  y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(EXP_P5));
+  y = _mm_add_ps(_mm_mul_ps(y, _mm_mul_ps(x, x)), x);
+  y = _mm_add_ps(y, _mm_set1_ps(1.0f));
+
+  __m128i pow2n = _mm_slli_epi32(_mm_add_epi32(n, _mm_set1_epi32(127)), 23);
+  return _mm_mul_ps(y, _mm_castsi128_ps(pow2n));
+}
+
+static float sse2_log_sum_exp(const float * scores, unsigned int count)
+{
+  unsigned int vector_count = count & ~3U;
+  __m128 max4 = _mm_set1_ps(-FLT_MAX);
+
+  for (unsigned int i = 0; i < vector_count; i += 4)
+    { max4 = _mm_max_ps(max4, _mm_loadu_ps(scores + i)); }
+
+  float lanes[4];
+  _mm_storeu_ps(lanes, max4);
+
+  float max = -FLT_MAX;
+
+  for (unsigned int i = 0; i < 4; ++i)
+    { max = (lanes[i] > max ? lanes[i] : max); }
+
+  for (unsigned int i = vector_count; i < count; ++i)
+    { max = (scores[i] > max ? scores[i] : max); }
+
+  if (max == -FLT_MAX)
+    { return -FLT_MAX; }
+
+  __m128 m = _mm_set1_ps(max);
+  __m128 sum4 = _mm_setzero_ps();
+
+  for (unsigned int i = 0; i < vector_count; i += 4)
+    { 
+      sum4 = _mm_add_ps(sum4, 
+			sse2_exp(_mm_sub_ps(_mm_loadu_ps(scores + i), m))); 
+    }
+
+  _mm_storeu_ps(lanes, sum4);
+
+  float sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+
+  for (unsigned int i = vector_count; i < count; ++i)
+    { sum += exp(scores[i] - max); }
+
+  return max + log(sum);
+}
+
+__attribute__((target("avx2,fma")))
+static inline __m256 avx2_exp(__m256 x)
+{
+  x = _mm256_max_ps(x, _mm256_set1_ps(EXP_MIN_ARG));
+
+  __m256i n = _mm256_cvtps_epi32(_mm256_mul_ps(x, _mm256_set1_ps(LOG2E)));
+  __m256 nf = _mm256_cvtepi32_ps(n);
+
+  x = _mm256_fnmadd_ps(nf, _mm256_set1_ps(EXP_C1), x);
+  x = _mm256_fnmadd_ps(nf, _mm256_set1_ps(EXP_C2), x);
+
+  __m256 y = _mm256_set1_ps(EXP_P0);
+  y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(EXP_P1));
+  y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(EXP_P2));
+  y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(EXP_P3));
+  y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(EXP_P4));
+  y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(EXP_P5));
+  y = _mm256_fmadd_ps(y, _mm256_mul_ps(x, x), x);
+  y = _mm256_add_ps(y, _mm256_set1_ps(1.0f));
+
+  __m256i pow2n = 
+    _mm256_slli_epi32(_mm256_add_epi32(n, _mm256_set1_epi32(127)), 23);
+  return _mm256_mul_ps(y, _mm256_castsi256_ps(pow2n));
+}
+
+__attribute__((target("avx2,fma")))
+static float avx2_log_sum_exp(const float * scores, unsigned int count)
+{
+  unsigned int vector_count = count & ~7U;
+  __m256 max8 = _mm256_set1_ps(-FLT_MAX);
+
+  for (unsigned int i = 0; i < vector_count; i += 8)
+    { max8 = _mm256_max_ps(max8, _mm256_loadu_ps(scores + i)); }
+
+  float lanes[8];
+  _mm256_storeu_ps(lanes, max8);
+
+  float max = -FLT_MAX;
+
+  for (unsigned int i = 0; i < 8; ++i)
+    { max = (lanes[i] > max ? lanes[i] : max); }
+
+  for (unsigned int i = vector_count; i < count; ++i)
+    { max = (scores[i] > max ? scores[i] : max); }
+
+  if (max == -FLT_MAX)
+    { return -FLT_MAX; }
+
+  __m256 m = _mm256_set1_ps(max);
+  __m256 sum8 = _mm256_setzero_ps();
+
+  for (unsigned int i = 0; i < vector_count; i += 8)
+    { 
+      sum8 = _mm256_add_ps(sum8, 
+			   avx2_exp(_mm256_sub_ps(_mm256_loadu_ps(scores + i), 
+						  m))); 
+    }
+
+  _mm256_storeu_ps(lanes, sum8);
+
+  float sum = 0;
+
+  for (unsigned int i = 0; i < 8; ++i)
+    { sum += lanes[i]; }
+
+  for (unsigned int i = vector_count; i < count; ++i)
+    { sum += exp(scores[i] - max); }
+
+  return max + log(sum);
+}
+
+#endif // SIMD_LOGSUMEXP
+
+static LogSumExpKernel select_kernel(const char ** name)
+{
+#ifdef SIMD_LOGSUMEXP
+  __builtin_cpu_init();
+
+  if (__builtin_cpu_supports("avx2") and __builtin_cpu_supports("fma"))
+    {
+      *name = "avx2";
+      return avx2_log_sum_exp;
+    }
+
+  *name = "sse2";
+  return sse2_log_sum_exp;
+#else
+  *name = "scalar";
+  return scalar_log_sum_exp;
+#endif
+}
+
+static const char * kernel_name = 0;
+static const LogSumExpKernel kernel = select_kernel(&kernel_name);
+
+float log_sum_exp(const float * scores, unsigned int count)
+{ return kernel(scores, count); }
+
+const char * get_log_sum_exp_kernel(void)
+{ return kernel_name; }
+
+#else // TEST_LogSumExp_cc
+
+#include <cassert>
+#include <iostream>
+#include <vector>
+
+float reference_log_sum_exp(const std::vector<float> &scores)
+{
+  float max = -FLT_MAX;
+
+  for (unsigned int i = 0; i < scores.size(); ++i)
+    { max = (scores[i] > max ? scores[i] : max); }
+
+  if (max == -FLT_MAX)
+    { return -FLT_MAX; }
+
+  double sum = 0;
+
+  for (unsigned int i = 0; i < scores.size(); ++i)
+    { sum += exp(static_cast<double>(scores[i]) - max); }
+
+  return max + log(sum);
+}
+
+int main(void)
+{
+  std::cerr << "Kernel: " << get_log_sum_exp_kernel() << std::endl;
+
+  assert(log_sum_exp(0, 0) == -FLT_MAX);
+
+  std::vector<float> scores(1, -FLT_MAX);
+  assert(log_sum_exp(&scores[0], 1) == -FLT_MAX);
+
+  scores[0] = 3.5;
+  assert(log_sum_exp(&scores[0], 1) == 3.5);
+
+  scores.assign(2, log(0.5));
+  assert(fabs(log_sum_exp(&scores[0], 2)) < 1e-6);
+
+  // Rows of every length up to a few vector widths, with large,
+  // small and missing (-FLT_MAX) scores.
+  for (unsigned int count = 1; count < 40; ++count)
+    {
+      scores.clear();
+
+      for (unsigned int i = 0; i < count; ++i)
+	{ 
+	  float score = (i % 7 == 3 ? -FLT_MAX : 
+			 static_cast<float>((i * 37) % 101) - 50.5f);
+	  scores.push_back(1000 + score); 
+	}
+
+      float res = log_sum_exp(&scores[0], count);
+      assert(fabs(res - reference_log_sum_exp(scores)) < 1e-3);
+    }
+}
+
+#endif // TEST_LogSumExp_cc
@@ -1,7 +1,7 @@
 /**
- * @file    TrellisCell.hh                                                   
- * @Author  Miikka Silfverberg                                               
- * @brief   Represents one entry in a TrellisColumn.                           
+ * @file    LogSumExp.hh
+ * @Author  Miikka Silfverberg
+ * @brief   Log-sum-exp of score rows with SSE2 and AVX2 kernels.
  */
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -19,27 +19,17 @@
 //                                                                           //
 ///////////////////////////////////////////////////////////////////////////////
 
-#ifndef HEADER_TrellisCell_hh
-#define HEADER_TrellisCell_hh
+#ifndef HEADER_LogSumExp_hh
+#define HEADER_LogSumExp_hh
 
-#include <vector>
+// Return log(exp(scores[0]) + ... + exp(scores[count - 1])), or
+// -FLT_MAX if @p count is 0. The kernel is chosen at start-up
+// according to the CPU. Building with -DSCALAR_LOGSUMEXP (make
+// LOGSUMEXP=scalar) leaves out the SSE2 and AVX2 kernels.
+float log_sum_exp(const float * scores, unsigned int count);
 
-struct TrellisCell
-{
-  TrellisCell(void);
+// Name of the kernel used by log_sum_exp: "avx2", "sse2" or
+// "scalar".
+const char * get_log_sum_exp_kernel(void);
 
-  float fw;
-  float bw;
-  float viterbi;
-  float marginal;
-  unsigned int label;
-  unsigned int label_index;
-  TrellisCell * pcell;
-};
-
-struct CmpTrellisCell
-{
-  bool operator() (const TrellisCell * tc1, const TrellisCell * tc2) const;
-};
-
-#endif // HEADER_TrellisCell_hh
+#endif // HEADER_LogSumExp_hh
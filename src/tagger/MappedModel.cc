@@ -0,0 +1,297 @@
+/**
+ * @file    MappedModel.cc                                                   
+ * @Author  Miikka Silfverberg                                               
+ * @brief   Section indexed model files used through mmap.                    
+ */
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// (C) Copyright 2014, University of Helsinki                                //
+// Licensed under the Apache License, Version 2.0 (the "License");           //
+// you may not use this file except in compliance with the License.          //
+// You may obtain a copy of the License at                                   //
+// http://www.apache.org/licenses/LICENSE-2.0                                //
+// Unless required by applicable law or agreed to in writing, software       //
+// distributed under the License is distributed on an "AS IS" BASIS,         //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  //
+// See the License for the specific language governing permissions and       //
+// limitations under the License.                                            //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+
+#include "MappedModel.hh"
+#include "exceptions.hh"
+#include "io.hh"
+
+#ifndef TEST_MappedModel_cc
+
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static const size_t MAPPED_HEADER_SIZE = 
+  sizeof(MAPPED_MODEL_ID_STRING) + sizeof(unsigned int) + sizeof(int) + 
+  sizeof(unsigned long);
+
+static const size_t MAPPED_SECTION_ENTRY_SIZE = 3 * sizeof(unsigned long);
+
+static size_t get_aligned(size_t offset)
+{
+  return 
+    (offset + MAPPED_SECTION_ALIGNMENT - 1) / 
+    MAPPED_SECTION_ALIGNMENT * MAPPED_SECTION_ALIGNMENT;
+}
+
+MappedModel::MappedModel(const std::string &filename):
+  data(0),
+  data_size(0)
+{
+  int fd = open(filename.c_str(), O_RDONLY);
+
+  if (fd == -1)
+    { throw ReadFailed(); }
+
+  struct stat file_stat;
+
+  if (fstat(fd, &file_stat) == -1 or 
+      static_cast<size_t>(file_stat.st_size) < MAPPED_HEADER_SIZE)
+    {
+      close(fd);
+      throw ReadFailed();
+    }
+
+  data_size = file_stat.st_size;
+  void * addr = mmap(0, data_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if (addr == MAP_FAILED)
+    { throw ReadFailed(); }
+
+  data = static_cast<const char *>(addr);
+
+  unsigned int version;
+  int marker;
+  memcpy(&version, data + sizeof(MAPPED_MODEL_ID_STRING), 
+	 sizeof(unsigned int));
+  memcpy(&marker, data + sizeof(MAPPED_MODEL_ID_STRING) + sizeof(unsigned int),
+	 sizeof(int));
+
+  if (memcmp(data, MAPPED_MODEL_ID_STRING, sizeof(MAPPED_MODEL_ID_STRING)) != 0 or
+      version != MAPPED_MODEL_VERSION or
+      marker != MAPPED_ENDIANNESS_MARKER)
+    {
+      munmap(const_cast<char *>(data), data_size);
+      throw BadBinary();
+    }
+}
+
+MappedModel::~MappedModel(void)
+{ munmap(const_cast<char *>(data), data_size); }
+
+bool MappedModel::is_mapped_model(std::istream &in)
+{
+  char id_string[sizeof(MAPPED_MODEL_ID_STRING)];
+  std::streampos pos = in.tellg();
+
+  in.read(id_string, sizeof(id_string));
+  bool res = 
+    (not in.fail() and 
+     memcmp(id_string, MAPPED_MODEL_ID_STRING, sizeof(id_string)) == 0);
+
+  in.clear();
+  in.seekg(pos);
+
+  return res;
+}
+
+const char * MappedModel::get_section(unsigned int id, size_t &size) const
+{
+  unsigned long section_count;
+  memcpy(&section_count, data + MAPPED_HEADER_SIZE - sizeof(unsigned long),
+	 sizeof(unsigned long));
+
+  // Compared by division and subtraction, so corrupt counts, offsets
+  // and sizes cannot overflow.
+  if (section_count > 
+      (data_size - MAPPED_HEADER_SIZE) / MAPPED_SECTION_ENTRY_SIZE)
+    { throw BadBinary(); }
+
+  for (unsigned long i = 0; i < section_count; ++i)
+    {
+      unsigned long entry[3];
+      memcpy(entry, data + MAPPED_HEADER_SIZE + i * MAPPED_SECTION_ENTRY_SIZE,
+	     MAPPED_SECTION_ENTRY_SIZE);
+
+      if (entry[0] != id)
+	{ continue; }
+
+      if (entry[1] > data_size or entry[2] > data_size - entry[1])
+	{ throw BadBinary(); }
+
+      size = entry[2];
+      return data + entry[1];
+    }
+
+  throw BadBinary();
+}
+
+void MappedModelWriter::add_section(unsigned int id, 
+				    const std::string &section_data)
+{
+  ids.push_back(id);
+  sections.push_back(section_data);
+}
+
+void MappedModelWriter::write(std::ostream &out) const
+{
+  out.write(MAPPED_MODEL_ID_STRING, sizeof(MAPPED_MODEL_ID_STRING));
+  write_val<unsigned int>(out, MAPPED_MODEL_VERSION);
+  write_val<int>(out, MAPPED_ENDIANNESS_MARKER);
+  write_val<unsigned long>(out, sections.size());
+
+  size_t offset = 
+    get_aligned(MAPPED_HEADER_SIZE + 
+		sections.size() * MAPPED_SECTION_ENTRY_SIZE);
+
+  for (unsigned int i = 0; i < sections.size(); ++i)
+    {
+      write_val<unsigned long>(out, ids[i]);
+      write_val<unsigned long>(out, offset);
+      write_val<unsigned long>(out, sections[i].size());
+      offset = get_aligned(offset + sections[i].size());
+    }
+
+  size_t pos = MAPPED_HEADER_SIZE + sections.size() * MAPPED_SECTION_ENTRY_SIZE;
+
+  for (unsigned int i = 0; i < sections.size(); ++i)
+    {
+      std::string padding(get_aligned(pos) - pos, '\0');
+      out.write(padding.data(), padding.size());
+      out.write(sections[i].data(), sections[i].size());
+      pos = get_aligned(pos) + sections[i].size();
+    }
+
+  if (out.fail())
+    { throw WriteFailed(); }
+}
+
+MemoryInputBuffer::MemoryInputBuffer(const char * data, size_t size)
+{
+  char * begin = const_cast<char *>(data);
+  setg(begin, begin, begin + size);
+}
+
+#else // TEST_MappedModel_cc
+
+#include <cassert>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+int main(void)
+{
+  MappedModelWriter writer;
+  writer.add_section(OPTIONS_SECTION, "foo");
+  writer.add_section(TAGGER_PARAM_SECTION, std::string(100, 'a'));
+
+  std::string filename = "TEST_MappedModel.tmp";
+
+  {
+    std::ofstream out(filename.c_str());
+    writer.write(out);
+  }
+
+  {
+    std::ifstream in(filename.c_str());
+    assert(MappedModel::is_mapped_model(in));
+    assert(in.tellg() == 0);
+  }
+
+  {
+    MappedModel model(filename);
+
+    size_t size;
+    const char * section = model.get_section(OPTIONS_SECTION, size);
+    assert(size == 3);
+    assert(std::string(section, size) == "foo");
+    
+    section = model.get_section(TAGGER_PARAM_SECTION, size);
+    assert(size == 100);
+    assert(reinterpret_cast<size_t>(section) % MAPPED_SECTION_ALIGNMENT == 0);
+    assert(std::string(section, size) == std::string(100, 'a'));
+
+    MemoryInputBuffer buffer(section, size);
+    std::istream in(&buffer);
+    std::string line;
+    std::getline(in, line);
+    assert(line == std::string(100, 'a'));
+
+    try
+      {
+	model.get_section(LEMMA_PARAM_SECTION, size);
+	assert(0);
+      }
+    catch (BadBinary &e)
+      { /* EXPECTED FAIL */ }
+  }
+
+  // Section counts, offsets and sizes that overflow when added or
+  // multiplied are rejected.
+  std::string contents;
+
+  {
+    std::ifstream in(filename.c_str());
+    contents.assign(std::istreambuf_iterator<char>(in), 
+		    std::istreambuf_iterator<char>());
+  }
+
+  size_t count_offset = 
+    sizeof(MAPPED_MODEL_ID_STRING) + sizeof(unsigned int) + sizeof(int);
+  size_t entry_offset = count_offset + sizeof(unsigned long);
+  unsigned long corrupt_count = ULONG_MAX / (3 * sizeof(unsigned long)) + 1;
+  unsigned long corrupt_size = ULONG_MAX;
+
+  for (unsigned int i = 0; i < 2; ++i)
+    {
+      std::string corrupt = contents;
+
+      if (i == 0)
+	{ 
+	  memcpy(&corrupt[count_offset], &corrupt_count, 
+		 sizeof(unsigned long)); 
+	}
+      else
+	{ 
+	  memcpy(&corrupt[entry_offset + 2 * sizeof(unsigned long)], 
+		 &corrupt_size, sizeof(unsigned long)); 
+	}
+
+      {
+	std::ofstream out(filename.c_str());
+	out.write(corrupt.data(), corrupt.size());
+      }
+
+      MappedModel model(filename);
+      size_t size;
+
+      try
+	{
+	  model.get_section(OPTIONS_SECTION, size);
+	  assert(0);
+	}
+      catch (BadBinary &e)
+	{ /* EXPECTED FAIL */ }
+    }
+
+  std::istringstream not_mapped_in(std::string("FinnPosModel\0", 13));
+  assert(not MappedModel::is_mapped_model(not_mapped_in));
+
+  remove(filename.c_str());
+}
+
+#endif // TEST_MappedModel_cc
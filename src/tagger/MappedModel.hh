@@ -0,0 +1,106 @@
+/**
+ * @file    MappedModel.hh
+ * @Author  Miikka Silfverberg
+ * @brief   Section indexed model files that are used through mmap.
+ */
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// (C) Copyright 2014, University of Helsinki                                //
+// Licensed under the Apache License, Version 2.0 (the "License");           //
+// you may not use this file except in compliance with the License.          //
+// You may obtain a copy of the License at                                   //
+// http://www.apache.org/licenses/LICENSE-2.0                                //
+// Unless required by applicable law or agreed to in writing, software       //
+// distributed under the License is distributed on an "AS IS" BASIS,         //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  //
+// See the License for the specific language governing permissions and       //
+// limitations under the License.                                            //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef HEADER_MappedModel_hh
+#define HEADER_MappedModel_hh
+
+#include <iostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+// File layout:
+//
+//   char[16]       MAPPED_MODEL_ID_STRING
+//   unsigned int   MAPPED_MODEL_VERSION
+//   int            MAPPED_ENDIANNESS_MARKER
+//   unsigned long  section count
+//   { unsigned long id, offset, size } for each section
+//   section data, each section aligned to MAPPED_SECTION_ALIGNMENT
+//
+// Mapped models are only read on platforms with the same endianness
+// as the one that wrote them. Use finnpos-convert-model to create
+// them from ordinary models.
+
+const char MAPPED_MODEL_ID_STRING[16] = "FinnPosModelMap";
+const unsigned int MAPPED_MODEL_VERSION = 1;
+const int MAPPED_ENDIANNESS_MARKER = 1;
+const size_t MAPPED_SECTION_ALIGNMENT = 64;
+
+enum ModelSection
+  { OPTIONS_SECTION = 1,
+    LABEL_EXTRACTOR_SECTION,
+    LEMMA_EXTRACTOR_SECTION,
+    LEMMA_PARAM_SECTION,
+    TAGGER_PARAM_SECTION };
+
+/**
+ * @brief Read-only memory mapping of a model file. Pages are shared
+ * by all processes that map the same file.
+ */
+class MappedModel
+{
+public:
+  // Map @p filename. Throws ReadFailed and BadBinary.
+  MappedModel(const std::string &filename);
+  ~MappedModel(void);
+
+  // Return true if @p in starts with MAPPED_MODEL_ID_STRING. Does not
+  // move the read position of @p in.
+  static bool is_mapped_model(std::istream &in);
+
+  // Return the start of section @p id and store its size in
+  // @p size. Throws BadBinary if the section is missing.
+  const char * get_section(unsigned int id, size_t &size) const;
+
+private:
+  MappedModel(const MappedModel &another);
+  MappedModel &operator=(const MappedModel &another);
+
+  const char * data;
+  size_t data_size;
+};
+
+/**
+ * @brief Collects sections and writes them in the mapped model
+ * format.
+ */
+class MappedModelWriter
+{
+public:
+  void add_section(unsigned int id, const std::string &section_data);
+  void write(std::ostream &out) const;
+
+private:
+  std::vector<unsigned int> ids;
+  std::vector<std::string> sections;
+};
+
+/**
+ * @brief Stream buffer for reading a section in place.
+ */
+class MemoryInputBuffer : public std::streambuf
+{
+public:
+  MemoryInputBuffer(const char * data, size_t size);
+};
+
+#endif // HEADER_MappedModel_hh
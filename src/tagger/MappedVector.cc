@@ -0,0 +1,160 @@
+/**
+ * @file    MappedVector.cc
+ * @Author  Miikka Silfverberg
+ * @brief   Arrays read in place from memory mapped model files.
+ */
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// (C) Copyright 2014, University of Helsinki                                //
+// Licensed under the Apache License, Version 2.0 (the "License");           //
+// you may not use this file except in compliance with the License.          //
+// You may obtain a copy of the License at                                   //
+// http://www.apache.org/licenses/LICENSE-2.0                                //
+// Unless required by applicable law or agreed to in writing, software       //
+// distributed under the License is distributed on an "AS IS" BASIS,         //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  //
+// See the License for the specific language governing permissions and       //
+// limitations under the License.                                            //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+
+#include "MappedVector.hh"
+#include "exceptions.hh"
+#include "io.hh"
+
+#include <cstring>
+
+#ifndef TEST_MappedVector_cc
+
+static size_t get_padded_size(size_t size)
+{ return size + (8 - size % 8) % 8; }
+
+void write_mapped_array(std::ostream &out,
+			const void * data,
+			size_t count,
+			size_t element_size)
+{
+  write_val<unsigned long>(out, count);
+
+  std::vector<char> buffer(get_padded_size(count * element_size), 0);
+
+  if (count > 0)
+    { memcpy(buffer.data(), data, count * element_size); }
+
+  out.write(buffer.data(), buffer.size());
+
+  if (out.fail())
+    { throw WriteFailed(); }
+}
+
+const char * get_mapped_array(const char * data,
+			      const char * data_end,
+			      size_t element_size,
+			      const char * &elements,
+			      size_t &count)
+{
+  if (reinterpret_cast<size_t>(data) % 8 != 0 or
+      data > data_end or
+      static_cast<size_t>(data_end - data) < sizeof(unsigned long))
+    { throw BadBinary(); }
+
+  unsigned long mapped_count;
+  memcpy(&mapped_count, data, sizeof(unsigned long));
+  data += sizeof(unsigned long);
+
+  // Compared by division, so a corrupt count cannot overflow.
+  size_t available = data_end - data;
+
+  if (mapped_count > available / element_size or
+      get_padded_size(mapped_count * element_size) > available)
+    { throw BadBinary(); }
+
+  elements = data;
+  count = mapped_count;
+
+  return data + get_padded_size(mapped_count * element_size);
+}
+
+#else // TEST_MappedVector_cc
+
+#include <cassert>
+#include <sstream>
+
+int main(void)
+{
+  MappedVector<unsigned short> v;
+  assert(v.empty());
+
+  for (unsigned short i = 0; i < 5; ++i)
+    { v.push_back(i * 3); }
+
+  assert(v.size() == 5);
+  assert(v[4] == 12);
+
+  std::ostringstream out;
+  v.store_mapped(out);
+  v.store_mapped(out);
+
+  // Both arrays are padded to 8 bytes.
+  assert(out.str().size() == 2 * (8 + 16));
+
+  std::vector<long> mapped_data(out.str().size() / sizeof(long));
+  memcpy(mapped_data.data(), out.str().data(), out.str().size());
+  const char * begin = reinterpret_cast<const char *>(mapped_data.data());
+  const char * end = begin + out.str().size();
+
+  MappedVector<unsigned short> mapped;
+  const char * next = mapped.load_mapped(begin, end);
+  assert(next == begin + out.str().size() / 2);
+  assert(mapped.size() == 5);
+  assert(mapped.data() == reinterpret_cast<const unsigned short *>(begin + 8));
+
+  const MappedVector<unsigned short> &const_mapped = mapped;
+
+  for (unsigned short i = 0; i < 5; ++i)
+    { assert(const_mapped[i] == i * 3); }
+
+  // A copy of a view is a view and the first modification copies the
+  // elements.
+  MappedVector<unsigned short> mapped_copy = mapped;
+  assert(mapped_copy.data() == mapped.data());
+
+  mapped_copy[0] = 7;
+  assert(mapped_copy.data() != mapped.data());
+  assert(mapped_copy[0] == 7);
+  assert(const_mapped[0] == 0);
+
+  mapped_copy.push_back(1);
+  assert(mapped_copy.size() == 6);
+
+  next = mapped.load_mapped(next, end);
+  assert(next == end);
+  assert(mapped.size() == 5);
+
+  // A truncated or misaligned array is rejected.
+  for (const char * p = begin; p < begin + out.str().size() / 2; p += 8)
+    {
+      try
+	{
+	  mapped.load_mapped(begin, p);
+	  assert(false);
+	}
+      catch (const BadBinary &e)
+	{}
+    }
+
+  try
+    {
+      mapped.load_mapped(begin + 1, end);
+      assert(false);
+    }
+  catch (const BadBinary &e)
+    {}
+
+  mapped.clear();
+  assert(mapped.empty());
+}
+
+#endif // TEST_MappedVector_cc
@@ -0,0 +1,137 @@
+/**
+ * @file    MappedVector.hh
+ * @Author  Miikka Silfverberg
+ * @brief   Array that is either owned or read in place from a memory
+ *          mapped model file.
+ */
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// (C) Copyright 2014, University of Helsinki                                //
+// Licensed under the Apache License, Version 2.0 (the "License");           //
+// you may not use this file except in compliance with the License.          //
+// You may obtain a copy of the License at                                   //
+// http://www.apache.org/licenses/LICENSE-2.0                                //
+// Unless required by applicable law or agreed to in writing, software       //
+// distributed under the License is distributed on an "AS IS" BASIS,         //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  //
+// See the License for the specific language governing permissions and       //
+// limitations under the License.                                            //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef HEADER_MappedVector_hh
+#define HEADER_MappedVector_hh
+
+#include <vector>
+#include <cstddef>
+#include <iostream>
+
+// Write @p count elements of @p element_size bytes at @p data in the
+// layout expected by get_mapped_array: the count as an unsigned long
+// and the elements padded to a multiple of 8 bytes.
+void write_mapped_array(std::ostream &out,
+			const void * data,
+			size_t count,
+			size_t element_size);
+
+// Read the element count of an array written by write_mapped_array
+// at @p data into @p count. Return a pointer past the array and store
+// the start of the elements in @p elements. Throws BadBinary if
+// @p data is not 8-byte aligned or the array does not end by
+// @p data_end.
+const char * get_mapped_array(const char * data,
+			      const char * data_end,
+			      size_t element_size,
+			      const char * &elements,
+			      size_t &count);
+
+/**
+ * @brief The subset of std::vector used for the compiled parameter
+ * rows of ParamTable. The elements are either owned or a read-only
+ * view of an array in a memory mapped model file (see
+ * load_mapped). Like ParamMap, the first modification copies a view
+ * into private storage. Copies of a view are views of the same array.
+ */
+template<class T> class MappedVector
+{
+public:
+  MappedVector(void): view(0), view_size(0)
+  {}
+
+  size_t size(void) const
+  { return view != 0 ? view_size : elements.size(); }
+
+  bool empty(void) const
+  { return size() == 0; }
+
+  const T * data(void) const
+  { return view != 0 ? view : elements.data(); }
+
+  const T &operator[](size_t i) const
+  { return data()[i]; }
+
+  T &operator[](size_t i)
+  {
+    copy_view();
+    return elements[i];
+  }
+
+  void push_back(const T &t)
+  {
+    copy_view();
+    elements.push_back(t);
+  }
+
+  void assign(size_t n, const T &t)
+  {
+    view = 0;
+    view_size = 0;
+    elements.assign(n, t);
+  }
+
+  void clear(void)
+  {
+    view = 0;
+    view_size = 0;
+    elements.clear();
+  }
+
+  // Write the elements in the layout expected by load_mapped.
+  void store_mapped(std::ostream &out) const
+  { write_mapped_array(out, data(), size(), sizeof(T)); }
+
+  // Use the array written by store_mapped at @p data in place. @p data
+  // has to be 8-byte aligned and stay valid for as long as the vector
+  // and its copies are used. Return a pointer past the array. Throws
+  // BadBinary if the array does not end by @p data_end.
+  const char * load_mapped(const char * data, const char * data_end)
+  {
+    const char * mapped_elements;
+    size_t count;
+    data = get_mapped_array(data, data_end, sizeof(T), mapped_elements, count);
+
+    elements.clear();
+    view = count == 0 ? 0 : reinterpret_cast<const T *>(mapped_elements);
+    view_size = count;
+
+    return data;
+  }
+
+private:
+  std::vector<T> elements;
+  const T * view;
+  size_t view_size;
+
+  void copy_view(void)
+  {
+    if (view == 0)
+      { return; }
+
+    elements.assign(view, view + view_size);
+    view = 0;
+    view_size = 0;
+  }
+};
+
+#endif // HEADER_MappedVector_hh
@@ -0,0 +1,227 @@
+/**
+ * @file    OutputBuffer.cc
+ * @Author  Miikka Silfverberg
+ * @brief   Buffered output to a file descriptor with a flush policy.
+ */
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// (C) Copyright 2014, University of Helsinki                                //
+// Licensed under the Apache License, Version 2.0 (the "License");           //
+// you may not use this file except in compliance with the License.          //
+// You may obtain a copy of the License at                                   //
+// http://www.apache.org/licenses/LICENSE-2.0                                //
+// Unless required by applicable law or agreed to in writing, software       //
+// distributed under the License is distributed on an "AS IS" BASIS,         //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  //
+// See the License for the specific language governing permissions and       //
+// limitations under the License.                                            //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+
+#include "OutputBuffer.hh"
+
+#include <unistd.h>
+#include <sys/stat.h>
+
+#ifndef TEST_OutputBuffer_cc
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+OutputBuffer::OutputBuffer(std::ostream &stream, int fd, size_t flush_size):
+  stream(stream),
+  stream_buffer(stream.rdbuf()),
+  fd(fd),
+  flush_size(flush_size),
+  buffer(OUTPUT_BUFFER_SIZE)
+{
+  setp(&buffer[0], &buffer[0] + buffer.size());
+  stream.flush();
+  stream.rdbuf(this);
+}
+
+OutputBuffer::~OutputBuffer(void)
+{
+  write_buffer();
+  stream.rdbuf(stream_buffer);
+}
+
+bool OutputBuffer::write_buffer(void)
+{
+  const char * begin = pbase();
+  const char * end = pptr();
+
+  while (begin < end)
+    {
+      ssize_t count = write(fd, begin, end - begin);
+
+      if (count < 0 and errno == EINTR)
+	{ continue; }
+
+      if (count <= 0)
+	{ return 0; }
+
+      begin += count;
+    }
+
+  setp(&buffer[0], &buffer[0] + buffer.size());
+  return 1;
+}
+
+OutputBuffer::int_type OutputBuffer::overflow(int_type c)
+{
+  if (not write_buffer())
+    { return traits_type::eof(); }
+
+  if (not traits_type::eq_int_type(c, traits_type::eof()))
+    {
+      *pptr() = traits_type::to_char_type(c);
+      pbump(1);
+    }
+
+  return traits_type::not_eof(c);
+}
+
+int OutputBuffer::sync(void)
+{
+  if (pptr() == pbase() or 
+      static_cast<size_t>(pptr() - pbase()) < flush_size)
+    { return 0; }
+
+  return write_buffer() ? 0 : -1;
+}
+
+static size_t parse_flush_kb(const char * str)
+{
+  char * end = 0;
+  errno = 0;
+  long kb = std::strtol(str, &end, 10);
+
+  if (end == str or *end != 0 or errno != 0 or kb < 0 or 
+      static_cast<unsigned long>(kb) > SIZE_MAX / 1024)
+    { return INVALID_FLUSH_SIZE; }
+
+  return 1024 * static_cast<size_t>(kb);
+}
+
+size_t get_flush_size(int fd, int &argc, char * argv[])
+{
+  for (int i = 1; i < argc; ++i)
+    {
+      if (std::string(argv[i]) == "--flush-kb")
+	{
+	  if (i + 1 == argc)
+	    { return INVALID_FLUSH_SIZE; }
+
+	  size_t flush_size = parse_flush_kb(argv[i + 1]);
+
+	  for (int j = i; j + 2 <= argc; ++j)
+	    { argv[j] = argv[j + 2]; }
+
+	  argc -= 2;
+	  return flush_size;
+	}
+    }
+
+  struct stat st;
+
+  if (fstat(fd, &st) == 0 and S_ISREG(st.st_mode))
+    { return BATCH_FLUSH_SIZE; }
+
+  return 0;
+}
+
+#else // TEST_OutputBuffer_cc
+
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+
+off_t get_file_size(int fd)
+{
+  struct stat st;
+  assert(fstat(fd, &st) == 0);
+  return st.st_size;
+}
+
+int main(void)
+{
+  FILE * file = tmpfile();
+  assert(file != 0);
+  int fd = fileno(file);
+
+  std::ostringstream stream;
+  stream << "x";
+
+  {
+    // Records are written when they add up to 4 bytes.
+    OutputBuffer buffer(stream, fd, 4);
+    stream << "ab" << std::flush;
+    assert(get_file_size(fd) == 0);
+    stream << "cd" << std::endl;
+    assert(get_file_size(fd) == 5);
+    stream << "e" << std::flush;
+    assert(get_file_size(fd) == 5);
+  }
+
+  // The destructor writes the rest and restores the buffer.
+  assert(get_file_size(fd) == 6);
+  stream << "y";
+  assert(stream.str() == "xy");
+
+  {
+    // Every record is written.
+    OutputBuffer buffer(stream, fd, 0);
+    stream << "f" << std::flush;
+    assert(get_file_size(fd) == 7);
+
+    // Output longer than the buffer.
+    stream << std::string(OUTPUT_BUFFER_SIZE + 10, 'g') << std::flush;
+    assert(get_file_size(fd) == static_cast<off_t>(OUTPUT_BUFFER_SIZE + 17));
+  }
+
+  char contents[8] = "";
+  assert(pread(fd, contents, 7, 0) == 7);
+  assert(std::strcmp(contents, "abcd\nef") == 0);
+
+  char prog[] = "prog";
+  char flag[] = "--flush-kb";
+  char size[] = "8";
+  char model[] = "model";
+  char * argv[] = { prog, flag, size, model, 0 };
+  int argc = 4;
+
+  assert(get_flush_size(fd, argc, argv) == 8 * 1024);
+  assert(argc == 2);
+  assert(std::string(argv[1]) == "model");
+  assert(get_flush_size(fd, argc, argv) == BATCH_FLUSH_SIZE);
+
+  const char * bad_sizes[] = { "abc", "-1", "8k", "", 
+			       "99999999999999999999" };
+
+  for (unsigned int i = 0; i < 5; ++i)
+    {
+      std::string bad_size = bad_sizes[i];
+      char * bad_argv[] = { prog, flag, &bad_size[0], model, 0 };
+      int bad_argc = 4;
+      assert(get_flush_size(fd, bad_argc, bad_argv) == INVALID_FLUSH_SIZE);
+    }
+
+  char zero[] = "0";
+  char * zero_argv[] = { prog, flag, zero, model, 0 };
+  int zero_argc = 4;
+  assert(get_flush_size(fd, zero_argc, zero_argv) == 0);
+
+  char * last_argv[] = { prog, model, flag, 0 };
+  int last_argc = 3;
+  assert(get_flush_size(fd, last_argc, last_argv) == INVALID_FLUSH_SIZE);
+
+  fclose(file);
+}
+
+#endif // TEST_OutputBuffer_cc
@@ -0,0 +1,84 @@
+/**
+ * @file    OutputBuffer.hh
+ * @Author  Miikka Silfverberg
+ * @brief   Buffered output to a file descriptor with a flush policy.
+ */
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// (C) Copyright 2014, University of Helsinki                                //
+// Licensed under the Apache License, Version 2.0 (the "License");           //
+// you may not use this file except in compliance with the License.          //
+// You may obtain a copy of the License at                                   //
+// http://www.apache.org/licenses/LICENSE-2.0                                //
+// Unless required by applicable law or agreed to in writing, software       //
+// distributed under the License is distributed on an "AS IS" BASIS,         //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  //
+// See the License for the specific language governing permissions and       //
+// limitations under the License.                                            //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef HEADER_OutputBuffer_hh
+#define HEADER_OutputBuffer_hh
+
+#include <iostream>
+#include <streambuf>
+#include <vector>
+#include <cstddef>
+
+// Size of the buffer of an OutputBuffer.
+const size_t OUTPUT_BUFFER_SIZE = 1 << 16;
+
+// Flush size used for regular files by get_flush_size.
+const size_t BATCH_FLUSH_SIZE = 1 << 16;
+
+// Returned by get_flush_size for an invalid --flush-kb argument.
+const size_t INVALID_FLUSH_SIZE = static_cast<size_t>(-1);
+
+/**
+ * @brief Stream buffer that writes to a file descriptor with write().
+ *
+ * Flushing the stream (std::flush or std::endl) marks the end of a
+ * record. The buffered output is written only if at least flush_size
+ * bytes are buffered, so with flush_size 0 every record is written
+ * at once and a larger flush_size writes records in batches. Output
+ * is always written when the buffer is full and in the destructor.
+ * The destructor can not report write errors, so callers should call
+ * write_buffer() and check the stream before it runs.
+ */
+class OutputBuffer : public std::streambuf
+{
+public:
+  // Write to @p fd instead of the buffer of @p stream until the
+  // OutputBuffer is destroyed.
+  OutputBuffer(std::ostream &stream, int fd, size_t flush_size);
+  ~OutputBuffer(void);
+
+  // Write all buffered output. Return false on error.
+  bool write_buffer(void);
+
+protected:
+  int_type overflow(int_type c);
+  int sync(void);
+
+private:
+  OutputBuffer(const OutputBuffer &another);
+  OutputBuffer &operator=(const OutputBuffer &another);
+
+  std::ostream &stream;
+  std::streambuf * stream_buffer;
+  int fd;
+  size_t flush_size;
+  std::vector<char> buffer;
+};
+
+// Return BATCH_FLUSH_SIZE if @p fd is a regular file and 0 (flush
+// every record) otherwise, e.g. for terminals and pipes. An argument
+// "--flush-kb N" sets the flush size to N kilobytes instead; it is
+// removed from @p argv. Return INVALID_FLUSH_SIZE if N is missing or
+// not a non-negative integer.
+size_t get_flush_size(int fd, int &argc, char * argv[]);
+
+#endif // HEADER_OutputBuffer_hh
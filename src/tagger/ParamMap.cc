@@ -0,0 +1,290 @@
+/**
+ * @file    ParamMap.cc                                                      
+ * @Author  Miikka Silfverberg                                               
+ * @brief   Open addressing hash table for parameters.                       
+ */
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// (C) Copyright 2014, University of Helsinki                                //
+// Licensed under the Apache License, Version 2.0 (the "License");           //
+// you may not use this file except in compliance with the License.          //
+// You may obtain a copy of the License at                                   //
+// http://www.apache.org/licenses/LICENSE-2.0                                //
+// Unless required by applicable law or agreed to in writing, software       //
+// distributed under the License is distributed on an "AS IS" BASIS,         //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  //
+// See the License for the specific language governing permissions and       //
+// limitations under the License.                                            //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+
+#include "ParamMap.hh"
+#include "io.hh"
+
+#include <cstring>
+
+#ifndef TEST_ParamMap_cc
+
+ParamMap::ParamMap(void):
+  view(0),
+  capacity(0),
+  entry_count(0),
+  mask(0)
+{}
+
+void ParamMap::reserve(size_t n)
+{
+  size_t new_capacity = 16;
+
+  while (new_capacity * 3 < n * 4)
+    { new_capacity *= 2; }
+
+  if (new_capacity > capacity)
+    { rehash(new_capacity); }
+}
+
+void ParamMap::clear(void)
+{
+  std::vector<value_type>().swap(slots);
+  view = 0;
+  capacity = 0;
+  entry_count = 0;
+  mask = 0;
+}
+
+void ParamMap::rehash(size_t new_capacity)
+{
+  std::vector<value_type> old_slots(new_capacity, 
+				    value_type(EMPTY_PARAM_ID, 0));
+  old_slots.swap(slots);
+  capacity = new_capacity;
+  mask = capacity - 1;
+
+  for (size_t i = 0; i < old_slots.size(); ++i)
+    {
+      if (old_slots[i].first == EMPTY_PARAM_ID)
+	{ continue; }
+
+      size_t j = get_slot_index(old_slots[i].first);
+
+      while (slots[j].first != EMPTY_PARAM_ID)
+	{ j = (j + 1) & mask; }
+
+      slots[j] = old_slots[i];
+    }
+}
+
+void ParamMap::copy_view(void)
+{
+  slots.assign(view, view + capacity);
+  view = 0;
+
+  // The entry count of a mapped slot array is not trusted, since
+  // operator[] relies on it to keep empty slots.
+  entry_count = 0;
+
+  for (size_t i = 0; i < capacity; ++i)
+    { entry_count += (slots[i].first != EMPTY_PARAM_ID); }
+}
+
+// A slot is stored as an 8 byte key, a 4 byte value and 4 bytes of
+// padding, which is the layout of value_type on LP64 platforms.
+static const size_t MAPPED_SLOT_SIZE = 16;
+
+void ParamMap::store_mapped(std::ostream &out) const
+{
+  write_val<unsigned long>(out, capacity);
+  write_val<unsigned long>(out, entry_count);
+
+  std::vector<char> buffer(capacity * MAPPED_SLOT_SIZE, 0);
+  const value_type * data = get_data();
+
+  for (size_t i = 0; i < capacity; ++i)
+    {
+      memcpy(&buffer[i * MAPPED_SLOT_SIZE], &data[i].first, sizeof(long));
+      memcpy(&buffer[i * MAPPED_SLOT_SIZE + sizeof(long)], &data[i].second, 
+	     sizeof(float));
+    }
+
+  out.write(buffer.data(), buffer.size());
+
+  if (out.fail())
+    { throw WriteFailed(); }
+}
+
+const char * ParamMap::load_mapped(const char * data, const char * data_end)
+{
+  if (sizeof(value_type) != MAPPED_SLOT_SIZE or 
+      sizeof(long) != 8 or
+      reinterpret_cast<size_t>(data) % 8 != 0 or
+      data > data_end or
+      static_cast<size_t>(data_end - data) < 2 * sizeof(unsigned long))
+    { throw BadBinary(); }
+
+  unsigned long mapped_capacity;
+  unsigned long mapped_entry_count;
+  memcpy(&mapped_capacity, data, sizeof(unsigned long));
+  memcpy(&mapped_entry_count, data + sizeof(unsigned long), 
+	 sizeof(unsigned long));
+  data += 2 * sizeof(unsigned long);
+
+  // Compared by division, so a corrupt capacity cannot overflow. The
+  // entry count is bounded by the capacity before it is multiplied.
+  if ((mapped_capacity & (mapped_capacity - 1)) != 0 or
+      mapped_capacity > static_cast<size_t>(data_end - data) / MAPPED_SLOT_SIZE or
+      mapped_entry_count > mapped_capacity or
+      mapped_entry_count * 4 > mapped_capacity * 3)
+    { throw BadBinary(); }
+
+  slots.clear();
+  view = mapped_capacity == 0 ? 0 : reinterpret_cast<const value_type *>(data);
+  capacity = mapped_capacity;
+  entry_count = mapped_entry_count;
+  mask = capacity == 0 ? 0 : capacity - 1;
+
+  return data + capacity * MAPPED_SLOT_SIZE;
+}
+
+bool ParamMap::operator==(const ParamMap &another) const
+{
+  if (size() != another.size())
+    { return false; }
+
+  for (const_iterator it = begin(); it != end(); ++it)
+    {
+      const_iterator jt = another.find(it->first);
+
+      if (jt == another.end() or jt->second != it->second)
+	{ return false; }
+    }
+
+  return true;
+}
+
+bool ParamMap::operator!=(const ParamMap &another) const
+{ return not (*this == another); }
+
+#else // TEST_ParamMap_cc
+
+#include <cassert>
+
+int main(void)
+{
+  ParamMap m;
+
+  assert(m.empty());
+  assert(m.count(0) == 0);
+  assert(m.find(0) == m.end());
+  assert(m.begin() == m.end());
+
+  for (long i = 0; i < 1000; ++i)
+    { m[i * 7919] += i; }
+
+  assert(m.size() == 1000);
+
+  for (long i = 0; i < 1000; ++i)
+    {
+      assert(m.count(i * 7919) == 1);
+      assert(m.find(i * 7919)->second == i);
+    }
+
+  assert(m.count(1) == 0);
+
+  float total = 0;
+  size_t entries = 0;
+
+  for (ParamMap::const_iterator it = m.begin(); it != m.end(); ++it)
+    { 
+      total += it->second; 
+      ++entries;
+    }
+
+  assert(entries == 1000);
+  assert(total == 999 * 1000 / 2);
+
+  ParamMap m_copy = m;
+  assert(m_copy == m);
+
+  m_copy[1] = 0;
+  assert(m_copy != m);
+
+  ParamMap m_reserved;
+  m_reserved.reserve(1000);
+
+  for (ParamMap::const_iterator it = m.begin(); it != m.end(); ++it)
+    { m_reserved[it->first] = it->second; }
+
+  assert(m_reserved == m);
+
+  std::ostringstream mapped_out;
+  m.store_mapped(mapped_out);
+  std::vector<long> mapped_data(mapped_out.str().size() / sizeof(long) + 1);
+  memcpy(mapped_data.data(), mapped_out.str().data(), mapped_out.str().size());
+
+  ParamMap m_mapped;
+  const char * mapped_begin = reinterpret_cast<const char *>(mapped_data.data());
+  const char * mapped_end = 
+    m_mapped.load_mapped(mapped_begin, mapped_begin + mapped_out.str().size());
+  assert(static_cast<size_t>(mapped_end - mapped_begin) == 
+	 mapped_out.str().size());
+
+  // A truncated slot array is rejected before it is used.
+  ParamMap m_truncated;
+
+  for (size_t size = 0; size < mapped_out.str().size(); size += 8)
+    {
+      try
+	{
+	  m_truncated.load_mapped(mapped_begin, mapped_begin + size);
+	  assert(false);
+	}
+      catch (const BadBinary &e)
+	{}
+    }
+
+  // A slot array without empty slots is rejected if its entry count
+  // says so, and otherwise probed at most once around.
+  std::vector<long> full_data(2 + 2 * 16, 0);
+  full_data[0] = 16;
+  full_data[1] = 16;
+
+  for (long i = 0; i < 16; ++i)
+    { full_data[2 + 2 * i] = 1000 + i; }
+
+  const char * full_begin = reinterpret_cast<const char *>(full_data.data());
+  const char * full_end = full_begin + full_data.size() * sizeof(long);
+  ParamMap m_full;
+
+  try
+    {
+      m_full.load_mapped(full_begin, full_end);
+      assert(false);
+    }
+  catch (const BadBinary &e)
+    {}
+
+  full_data[1] = 12;
+  m_full.load_mapped(full_begin, full_end);
+  assert(m_full.find(7919) == m_full.end());
+  assert(m_full.count(1015) == 1);
+
+  m_full[7919] = 1;
+  assert(m_full.size() == 17);
+  assert(m_full.find(7919)->second == 1);
+
+  assert(m_mapped == m);
+  assert(m_mapped.find(7919)->second == 1);
+
+  m_mapped[7919] += 1;
+  assert(m_mapped.find(7919)->second == 2);
+  assert(m.find(7919)->second == 1);
+  assert(m_mapped.size() == m.size());
+
+  m.clear();
+  assert(m.empty());
+  assert(m.count(0) == 0);
+}
+
+#endif // TEST_ParamMap_cc
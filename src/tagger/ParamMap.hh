@@ -0,0 +1,232 @@
+/**
+ * @file    ParamMap.hh
+ * @Author  Miikka Silfverberg
+ * @brief   Open addressing hash table from parameter ids to parameter
+ *          values.
+ */
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// (C) Copyright 2014, University of Helsinki                                //
+// Licensed under the Apache License, Version 2.0 (the "License");           //
+// you may not use this file except in compliance with the License.          //
+// You may obtain a copy of the License at                                   //
+// http://www.apache.org/licenses/LICENSE-2.0                                //
+// Unless required by applicable law or agreed to in writing, software       //
+// distributed under the License is distributed on an "AS IS" BASIS,         //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  //
+// See the License for the specific language governing permissions and       //
+// limitations under the License.                                            //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef HEADER_ParamMap_hh
+#define HEADER_ParamMap_hh
+
+#include <vector>
+#include <utility>
+#include <cstddef>
+#include <iostream>
+
+// Marks an unused slot. Parameter ids are never negative.
+const long EMPTY_PARAM_ID = -1;
+
+/**
+ * @brief Map from non-negative parameter ids to float values. Keys
+ * and values are stored inline in one array and collisions are
+ * resolved by linear probing, so a lookup usually touches one cache
+ * line. Entries cannot be erased.
+ *
+ * The interface is the subset of std::unordered_map used by
+ * ParamTable. Two maps that see the same sequence of insertions have
+ * the same iteration order. A map can also be a read-only view of a
+ * slot array in a memory mapped model file (see load_mapped).
+ */
+class ParamMap
+{
+public:
+  typedef long key_type;
+  typedef float mapped_type;
+  typedef std::pair<long, float> value_type;
+
+  template<class T> class Iterator
+  {
+  public:
+    Iterator(void): pos(0), end(0)
+    {}
+
+    Iterator(T * pos, T * end): pos(pos), end(end)
+    { skip_empty(); }
+
+    template<class S> Iterator(const Iterator<S> &another):
+      pos(another.pos), end(another.end)
+    {}
+
+    T &operator*(void) const
+    { return *pos; }
+
+    T * operator->(void) const
+    { return pos; }
+
+    Iterator &operator++(void)
+    {
+      ++pos;
+      skip_empty();
+      return *this;
+    }
+
+    bool operator==(const Iterator &another) const
+    { return pos == another.pos; }
+
+    bool operator!=(const Iterator &another) const
+    { return pos != another.pos; }
+
+  private:
+    template<class S> friend class Iterator;
+
+    T * pos;
+    T * end;
+
+    void skip_empty(void)
+    {
+      while (pos != end and pos->first == EMPTY_PARAM_ID)
+	{ ++pos; }
+    }
+  };
+
+  typedef Iterator<value_type> iterator;
+  typedef Iterator<const value_type> const_iterator;
+
+  ParamMap(void);
+
+  iterator begin(void)
+  { return iterator(get_data(), get_data() + capacity); }
+
+  iterator end(void)
+  { return iterator(get_data() + capacity, get_data() + capacity); }
+
+  const_iterator begin(void) const
+  { return const_iterator(get_data(), get_data() + capacity); }
+
+  const_iterator end(void) const
+  { return const_iterator(get_data() + capacity, get_data() + capacity); }
+
+  iterator find(long key)
+  {
+    value_type * slot = find_slot(key);
+    return slot == 0 ? end() : iterator(slot, get_data() + capacity);
+  }
+
+  const_iterator find(long key) const
+  {
+    const value_type * slot = find_slot(key);
+    return slot == 0 ? end() : const_iterator(slot, get_data() + capacity);
+  }
+
+  size_t count(long key) const
+  { return find_slot(key) != 0; }
+
+  // Return the value for @p key, inserting 0 if @p key is missing.
+  float &operator[](long key)
+  {
+    if (view != 0)
+      { copy_view(); }
+
+    if ((entry_count + 1) * 4 > capacity * 3)
+      { rehash(capacity == 0 ? 16 : 2 * capacity); }
+
+    size_t i = get_slot_index(key);
+
+    while (slots[i].first != key)
+      {
+	if (slots[i].first == EMPTY_PARAM_ID)
+	  {
+	    slots[i].first = key;
+	    slots[i].second = 0;
+	    ++entry_count;
+	    break;
+	  }
+
+	i = (i + 1) & mask;
+      }
+
+    return slots[i].second;
+  }
+
+  size_t size(void) const
+  { return entry_count; }
+
+  bool empty(void) const
+  { return entry_count == 0; }
+
+  // Make room for @p n entries without rehashing.
+  void reserve(size_t n);
+
+  void clear(void);
+
+  // Write the slot array in the layout expected by load_mapped.
+  void store_mapped(std::ostream &out) const;
+
+  // Use the slot array written by store_mapped at @p data in place. 
+  // @p data has to be 8-byte aligned and stay valid for as long as
+  // the map and its copies are used. The first operator[] call copies
+  // the slots into private storage; iterators must not be used for
+  // writing before that. Return a pointer past the slot array. Throws
+  // BadBinary if the slot array does not end by @p data_end or is
+  // fuller than the maps that store_mapped writes.
+  const char * load_mapped(const char * data, const char * data_end);
+
+  bool operator==(const ParamMap &another) const;
+  bool operator!=(const ParamMap &another) const;
+
+private:
+  std::vector<value_type> slots;
+  const value_type * view;
+  size_t capacity;
+  size_t entry_count;
+  size_t mask;
+
+  value_type * get_data(void)
+  { return view != 0 ? const_cast<value_type *>(view) : slots.data(); }
+
+  const value_type * get_data(void) const
+  { return view != 0 ? view : slots.data(); }
+
+  size_t get_slot_index(long key) const
+  {
+    unsigned long h = static_cast<unsigned long>(key) * 0x9E3779B97F4A7C15UL;
+    return (h ^ (h >> 32)) & mask;
+  }
+
+  const value_type * find_slot(long key) const
+  {
+    if (capacity == 0)
+      { return 0; }
+
+    const value_type * data = get_data();
+    size_t i = get_slot_index(key);
+
+    // Bounded by capacity, since a mapped slot array may have no
+    // empty slot.
+    for (size_t n = 0; n < capacity; ++n, i = (i + 1) & mask)
+      {
+	if (data[i].first == key)
+	  { return data + i; }
+	else if (data[i].first == EMPTY_PARAM_ID)
+	  { return 0; }
+      }
+
+    return 0;
+  }
+
+  value_type * find_slot(long key)
+  {
+    return const_cast<value_type *>
+      (static_cast<const ParamMap *>(this)->find_slot(key));
+  }
+
+  void rehash(size_t new_capacity);
+  void copy_view(void);
+};
+
+#endif // HEADER_ParamMap_hh
@@ -26,10 +26,121 @@
 
 #include "Word.hh"
 #include <cassert>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+
+#include "MappedModel.hh"
+
+// Conversions between float and IEEE 754 half precision. Rounds to
+// nearest even.
+static unsigned short float_to_half(float f)
+{
+  unsigned int bits;
+  memcpy(&bits, &f, sizeof(float));
+
+  unsigned int sign = (bits >> 16) & 0x8000;
+  int exponent = static_cast<int>((bits >> 23) & 0xff) - 127 + 15;
+  unsigned int mantissa = bits & 0x7fffff;
+
+  if (((bits >> 23) & 0xff) == 0xff)
+    { return sign | 0x7c00 | (mantissa != 0 ? 0x200 : 0); }
+  else if (exponent >= 31)
+    { return sign | 0x7c00; }
+  else if (exponent <= 0)
+    {
+      if (exponent < -10)
+	{ return sign; }
+
+      mantissa |= 0x800000;
+
+      unsigned int shift = 14 - exponent;
+      unsigned int half = mantissa >> shift;
+      unsigned int rest = mantissa & ((1 << shift) - 1);
+      unsigned int halfway = 1 << (shift - 1);
+
+      if (rest > halfway or (rest == halfway and (half & 1)))
+	{ ++half; }
+
+      return sign | half;
+    }
+
+  unsigned int half = sign | (exponent << 10) | (mantissa >> 13);
+  unsigned int rest = mantissa & 0x1fff;
+
+  if (rest > 0x1000 or (rest == 0x1000 and (half & 1)))
+    { ++half; }
+
+  return half;
+}
+
+static float half_to_float(unsigned short half)
+{
+  unsigned int sign = (half & 0x8000) << 16;
+  unsigned int exponent = (half >> 10) & 0x1f;
+  unsigned int mantissa = half & 0x3ff;
+  unsigned int bits;
+
+  if (exponent == 0)
+    {
+      float f = mantissa / 16777216.0;
+      return sign != 0 ? -f : f;
+    }
+  else if (exponent == 31)
+    { bits = sign | 0x7f800000 | (mantissa << 13); }
+  else
+    { bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13); }
+
+  float f;
+  memcpy(&f, &bits, sizeof(float));
+  return f;
+}
+
+// Return the scale of a feature template whose largest absolute
+// parameter value is @p max_abs. Codes times the scale give the
+// parameter values.
+static float get_scale(float max_abs, Quantization quantization)
+{ return quantization == INT8 ? max_abs / 127 : max_abs; }
+
+static signed char get_int8_code(float param, float scale)
+{
+  if (scale == 0)
+    { return 0; }
+
+  float code = roundf(param / scale);
+  return static_cast<signed char>(std::max<float>(-127, std::min<float>(127, code)));
+}
+
+static unsigned short get_fp16_code(float param, float scale)
+{ return float_to_half(scale == 0 ? 0 : param / scale); }
+
+// The summed value of a parameter whose running sum is in @p sums.
+static float get_summed_param(long id, float param, 
+			      const ParamMap &sums, float time)
+{
+  ParamMap::const_iterator it = sums.find(id);
+  return (time + 1) * param + (it == sums.end() ? 0 : it->second);
+}
 
 ParamTable::ParamTable(void):
   label_extractor(0),
   trained(0),
+  feature_hash_buckets(0),
+  averaging(0),
+  averaged_reads(0),
+  time(0),
+  l1_penalty(0),
+  concurrent(0),
+  compiled(0),
+  quantization(NO_QUANT),
+  compiled_quantization(NO_QUANT),
+  unstruct_released(0),
+  struct_compiled(0),
+  compiled_sublabel_order(NODEG),
+  compiled_model_order(NODEG),
+  compiled_label_count(0),
   update_threshold(0),
   avg_mass_threshold(0),
   filter_type(NO_FILTER)
@@ -43,17 +154,73 @@ ParamTable &ParamTable::operator=(const ParamTable &another)
   if (this == &another)
     { return *this; }
 
+  copy_settings(another);
+
+  averaging         = another.averaging;
+  l1_penalty        = another.l1_penalty;
+  unstruct_l1_table = another.unstruct_l1_table;
+  struct_l1_table   = another.struct_l1_table;
+  struct_l2_scales  = another.struct_l2_scales;
+
+  if (another.concurrent)
+    {
+      another.concurrent_unstruct_table->get(unstruct_param_table, 
+					      &unstruct_sum_table);
+      another.concurrent_struct_table->get(struct_param_table, 
+					    &struct_sum_table);
+    }
+  else
+    {
+      unstruct_param_table = another.unstruct_param_table;
+      struct_param_table   = another.struct_param_table;
+      unstruct_sum_table   = another.unstruct_sum_table;
+      struct_sum_table     = another.struct_sum_table;
+    }
+
+  return *this;
+}
+
+void ParamTable::copy_settings(const ParamTable &another)
+{
   update_count_map     = another.update_count_map;
   trained              = another.trained;
   feature_template_map = another.feature_template_map;
-  unstruct_param_table = another.unstruct_param_table;
-  struct_param_table   = another.struct_param_table;
+  feature_hash_buckets = another.feature_hash_buckets;
+  averaging            = 0;
+  averaged_reads       = 0;
+  time                 = another.time;
+  unstruct_sum_table.clear();
+  struct_sum_table.clear();
+  l1_penalty           = 0;
+  unstruct_l1_table.clear();
+  struct_l1_table.clear();
+  struct_l2_scales.clear();
+  concurrent           = 0;
+  concurrent_unstruct_table.reset();
+  concurrent_struct_table.reset();
+  compiled             = another.compiled;
+  unstruct_rows        = another.unstruct_rows;
+  unstruct_labels      = another.unstruct_labels;
+  unstruct_weights     = another.unstruct_weights;
+  quantization         = another.quantization;
+  compiled_quantization = another.compiled_quantization;
+  unstruct_released    = another.unstruct_released;
+  unstruct_scales      = another.unstruct_scales;
+  unstruct_int8_weights = another.unstruct_int8_weights;
+  unstruct_fp16_weights = another.unstruct_fp16_weights;
+  struct_compiled      = another.struct_compiled;
+  compiled_sublabel_order = another.compiled_sublabel_order;
+  compiled_model_order = another.compiled_model_order;
+  compiled_label_count = another.compiled_label_count;
+  struct1_scores       = another.struct1_scores;
+  struct2_scores       = another.struct2_scores;
+  struct3_rows         = another.struct3_rows;
+  struct3_full_labels  = another.struct3_full_labels;
+  struct3_scores       = another.struct3_scores;
   update_threshold     = another.update_threshold;
   avg_mass_threshold   = another.avg_mass_threshold;
   filter_type          = another.filter_type;  
   train_iters          = another.train_iters;
-  update_count_map     = another.update_count_map;
-  return *this;
 }
 
 void ParamTable::set_trained(void)
@@ -61,6 +228,555 @@ void ParamTable::set_trained(void)
   trained = 1;
 }
 
+void ParamTable::compile(void)
+{
+  apply_l2_scales();
+  clear_compiled();
+
+  if (averaged_reads)
+    { return; }
+
+  unsigned int row_count = 0;
+
+  for (ParamMap::const_iterator it = unstruct_param_table.begin();
+       it != unstruct_param_table.end();
+       ++it)
+    {
+      unsigned int row = it->first / (MAX_LABEL + 1);
+      row_count = std::max(row_count, row + 1);
+    }
+
+  std::vector<std::vector<std::pair<unsigned int, float> > > rows(row_count);
+
+  for (ParamMap::const_iterator it = unstruct_param_table.begin();
+       it != unstruct_param_table.end();
+       ++it)
+    {
+      float param = get_filtered_param(it->first, it->second);
+
+      if (param == 0)
+	{ continue; }
+
+      rows[it->first / (MAX_LABEL + 1)].push_back
+	(std::pair<unsigned int, float>(it->first % (MAX_LABEL + 1), param));
+    }
+
+  unstruct_rows.push_back(0);
+
+  if (quantization != NO_QUANT)
+    { unstruct_scales.assign(rows.size(), 0); }
+
+  for (unsigned int i = 0; i < rows.size(); ++i)
+    {
+      std::sort(rows[i].begin(), rows[i].end());
+
+      if (quantization != NO_QUANT)
+	{
+	  for (unsigned int j = 0; j < rows[i].size(); ++j)
+	    { 
+	      unstruct_scales[i] = 
+		std::max<float>(unstruct_scales[i], fabs(rows[i][j].second)); 
+	    }
+
+	  unstruct_scales[i] = get_scale(unstruct_scales[i], quantization);
+	}
+
+      for (unsigned int j = 0; j < rows[i].size(); ++j)
+	{
+	  unstruct_labels.push_back(rows[i][j].first);
+
+	  float param = rows[i][j].second;
+
+	  if (quantization == INT8)
+	    { 
+	      unstruct_int8_weights.push_back
+		(get_int8_code(param, unstruct_scales[i])); 
+	    }
+	  else if (quantization == FP16)
+	    { 
+	      unstruct_fp16_weights.push_back
+		(get_fp16_code(param, unstruct_scales[i])); 
+	    }
+	  else
+	    { unstruct_weights.push_back(param); }
+	}
+
+      unstruct_rows.push_back(unstruct_labels.size());
+    }
+
+  compiled = 1;
+  compiled_quantization = quantization;
+
+  // The compiled rows are the only copy of the parameters that is
+  // kept in memory. restore_unstruct_map rebuilds the map from them
+  // when it is needed again.
+  unstruct_param_table.clear();
+  unstruct_released = 1;
+}
+
+void ParamTable::compile_struct(Degree sublabel_order, Degree model_order)
+{
+  if (struct_compiled and 
+      compiled_sublabel_order == sublabel_order and
+      compiled_model_order == model_order)
+    { return; }
+
+  apply_l2_scales();
+
+  struct_compiled = 0;
+  struct1_scores.clear();
+  struct2_scores.clear();
+  struct3_rows.clear();
+  struct3_scores.clear();
+  struct3_full_labels.clear();
+
+  if (label_extractor == 0 or averaged_reads)
+    { return; }
+
+  unsigned int label_count = 
+    std::min<long>(label_extractor->label_count(), MAX_LABEL);
+
+  // Give each sub label a local index in [0, sub_label_count).
+  std::vector<int> sub_index(label_count, -1);
+  unsigned int sub_label_count = 0;
+
+  for (unsigned int l = 0; l < label_count; ++l)
+    {
+      const LabelVector &sub_labels = label_extractor->sub_labels(l);
+
+      for (unsigned int i = 0; i < sub_labels.size(); ++i)
+	{
+	  if (sub_labels[i] < label_count and sub_index[sub_labels[i]] == -1)
+	    { sub_index[sub_labels[i]] = sub_label_count++; }
+	}
+    }
+
+  struct1_scores.assign(label_count, 0);
+
+  for (unsigned int l = 0; l < label_count; ++l)
+    { struct1_scores[l] = get_struct1(l, sublabel_order); }
+
+  const long bigram_offset = 
+    (MAX_LABEL + 1) * (MAX_LABEL + 1) * (MAX_LABEL + 1);
+  const long unigram_offset = bigram_offset + (MAX_LABEL + 1) * (MAX_LABEL + 1);
+
+  if (model_order > ZEROTH and 
+      static_cast<long>(label_count) * label_count <= MAX_COMPILED_STRUCT_SIZE)
+    {
+      struct2_scores.assign(label_count * label_count, 0);
+
+      // Sub label bigram weights, dense over local sub label indices.
+      std::vector<float> sub_scores;
+
+      if (sublabel_order > ZEROTH and 
+	  static_cast<long>(sub_label_count) * sub_label_count <= 
+	  MAX_COMPILED_STRUCT_SIZE)
+	{ sub_scores.assign(sub_label_count * sub_label_count, 0); }
+
+      for (ParamMap::const_iterator it = struct_param_table.begin();
+	   it != struct_param_table.end();
+	   ++it)
+	{
+	  if (it->first < bigram_offset or it->first >= unigram_offset)
+	    { continue; }
+
+	  long id = it->first - bigram_offset;
+	  unsigned int plabel = id / (MAX_LABEL + 1);
+	  unsigned int label  = id % (MAX_LABEL + 1);
+
+	  if (plabel >= label_count or label >= label_count)
+	    { continue; }
+
+	  float param = get_filtered_param(it->first, it->second);
+
+	  struct2_scores[plabel * label_count + label] += param;
+
+	  if (not sub_scores.empty() and 
+	      sub_index[plabel] != -1 and sub_index[label] != -1)
+	    { 
+	      sub_scores[sub_index[plabel] * sub_label_count + 
+			 sub_index[label]] += param; 
+	    }
+	}
+
+      if (sublabel_order > ZEROTH and sub_scores.empty())
+	{
+	  for (unsigned int pl = 0; pl < label_count; ++pl)
+	    {
+	      for (unsigned int l = 0; l < label_count; ++l)
+		{ struct2_scores[pl * label_count + l] = get_struct2(pl, l, sublabel_order); }
+	    }
+	}
+      else if (sublabel_order > ZEROTH)
+	{
+	  std::vector<float> psub_scores(sub_label_count);
+
+	  for (unsigned int pl = 0; pl < label_count; ++pl)
+	    {
+	      const LabelVector &psub_labels = label_extractor->sub_labels(pl);
+
+	      if (psub_labels.empty())
+		{ continue; }
+
+	      psub_scores.assign(sub_label_count, 0);
+
+	      for (unsigned int i = 0; i < psub_labels.size(); ++i)
+		{
+		  const float * row = 
+		    &sub_scores[sub_index[psub_labels[i]] * sub_label_count];
+
+		  for (unsigned int j = 0; j < sub_label_count; ++j)
+		    { psub_scores[j] += row[j]; }
+		}
+
+	      for (unsigned int l = 0; l < label_count; ++l)
+		{
+		  const LabelVector &sub_labels = label_extractor->sub_labels(l);
+
+		  for (unsigned int i = 0; i < sub_labels.size(); ++i)
+		    { 
+		      struct2_scores[pl * label_count + l] += 
+			psub_scores[sub_index[sub_labels[i]]]; 
+		    }
+		}
+	    }
+	}
+    }
+
+  if (model_order > FIRST and not struct2_scores.empty())
+    {
+      typedef std::vector<std::pair<unsigned int, float> > LabelWeightVector;
+
+      // Trigram weights grouped by (pplabel, plabel). Sub label
+      // trigram weights are also stored densely over the last sub label.
+      std::unordered_map<long, LabelWeightVector> pair_weights;
+      std::unordered_map<long, std::vector<float> > sub_pair_weights;
+
+      for (ParamMap::const_iterator it = struct_param_table.begin();
+	   it != struct_param_table.end();
+	   ++it)
+	{
+	  if (it->first >= bigram_offset)
+	    { continue; }
+
+	  unsigned int pplabel = it->first / ((MAX_LABEL + 1) * (MAX_LABEL + 1));
+	  unsigned int plabel  = (it->first / (MAX_LABEL + 1)) % (MAX_LABEL + 1);
+	  unsigned int label   = it->first % (MAX_LABEL + 1);
+
+	  if (pplabel >= label_count or plabel >= label_count or 
+	      label >= label_count)
+	    { continue; }
+
+	  float param = get_filtered_param(it->first, it->second);
+	  long pair_id = pplabel * (MAX_LABEL + 1) + plabel;
+
+	  // Pairs of sub labels are never decoded, so they get no rows.
+	  if (sub_index[pplabel] == -1 and sub_index[plabel] == -1)
+	    {
+	      pair_weights[pair_id].push_back
+		(std::pair<unsigned int, float>(label, param)); 
+	    }
+	  else if (sublabel_order > FIRST and sub_index[pplabel] != -1 and 
+		   sub_index[plabel] != -1 and sub_index[label] != -1)
+	    {
+	      std::vector<float> &v = sub_pair_weights[pair_id];
+	      
+	      if (v.empty())
+		{ v.assign(sub_label_count, 0); }
+	      
+	      v[sub_index[label]] += param;
+	    }
+	}
+
+      // Rows are built for the label pairs with trigram weights, of
+      // full labels or of their sub labels, with the most weights
+      // first. The row budget grows with the size of the model. If it
+      // runs out, the remaining pairs are scored by get_struct3, which
+      // loops over their sub label triples.
+      size_t max_rows = 
+	std::max<size_t>(label_count, 
+			 STRUCT3_FLOATS_PER_PARAM * struct_param_table.size() / 
+			 label_count);
+      std::vector<std::pair<size_t, long> > pairs;
+      bool complete = 1;
+
+      if (sub_pair_weights.empty() or 
+	  static_cast<long>(sub_label_count) * sub_label_count > 
+	  MAX_COMPILED_STRUCT_SIZE)
+	{
+	  complete = sub_pair_weights.empty();
+
+	  for (std::unordered_map<long, LabelWeightVector>::const_iterator it = 
+		 pair_weights.begin();
+	       it != pair_weights.end();
+	       ++it)
+	    { pairs.push_back(std::pair<size_t, long>(it->second.size(), it->first)); }
+	}
+      else
+	{
+	  // Number of nonzero trigram weights of each sub label pair.
+	  std::vector<size_t> sub_pair_counts(sub_label_count * sub_label_count, 0);
+
+	  for (std::unordered_map<long, std::vector<float> >::const_iterator it = 
+		 sub_pair_weights.begin();
+	       it != sub_pair_weights.end();
+	       ++it)
+	    {
+	      unsigned int ppsub = sub_index[it->first / (MAX_LABEL + 1)];
+	      unsigned int psub  = sub_index[it->first % (MAX_LABEL + 1)];
+
+	      for (unsigned int m = 0; m < sub_label_count; ++m)
+		{ sub_pair_counts[ppsub * sub_label_count + psub] += (it->second[m] != 0); }
+	    }
+
+	  std::vector<unsigned int> full_labels;
+
+	  for (unsigned int l = 0; l < label_count; ++l)
+	    {
+	      if (sub_index[l] == -1)
+		{ full_labels.push_back(l); }
+	    }
+
+	  // Keep the max_rows pairs with the most weights in a min heap.
+	  std::greater<std::pair<size_t, long> > cmp;
+
+	  for (unsigned int i = 0; i < full_labels.size(); ++i)
+	    {
+	      unsigned int pplabel = full_labels[i];
+	      const LabelVector &ppsub_labels = label_extractor->sub_labels(pplabel);
+
+	      for (unsigned int j = 0; j < full_labels.size(); ++j)
+		{
+		  unsigned int plabel = full_labels[j];
+		  const LabelVector &psub_labels = label_extractor->sub_labels(plabel);
+		  long pair_id = pplabel * (MAX_LABEL + 1) + plabel;
+		  size_t count = 0;
+
+		  for (unsigned int k = 0; k < ppsub_labels.size(); ++k)
+		    {
+		      for (unsigned int m = 0; m < psub_labels.size(); ++m)
+			{
+			  count += sub_pair_counts[sub_index[ppsub_labels[k]] * sub_label_count + 
+						   sub_index[psub_labels[m]]];
+			}
+		    }
+
+		  std::unordered_map<long, LabelWeightVector>::const_iterator it = 
+		    pair_weights.find(pair_id);
+
+		  if (it != pair_weights.end())
+		    { count += it->second.size(); }
+
+		  if (count == 0)
+		    { continue; }
+
+		  pairs.push_back(std::pair<size_t, long>(count, pair_id));
+		  std::push_heap(pairs.begin(), pairs.end(), cmp);
+
+		  if (pairs.size() > max_rows)
+		    {
+		      std::pop_heap(pairs.begin(), pairs.end(), cmp);
+		      pairs.pop_back();
+		      complete = 0;
+		    }
+		}
+	    }
+	}
+
+      std::sort(pairs.begin(), pairs.end());
+      std::reverse(pairs.begin(), pairs.end());
+
+      if (pairs.size() > max_rows)
+	{
+	  pairs.resize(max_rows);
+	  complete = 0;
+	}
+
+      std::vector<float> sub_label_scores(sub_label_count);
+
+      struct3_rows.assign(label_count * label_count, NO_STRUCT3_ROW);
+
+      for (unsigned int i = 0; i < pairs.size(); ++i)
+	{
+	  long pair_id = pairs[i].second;
+	  unsigned int pplabel = pair_id / (MAX_LABEL + 1);
+	  unsigned int plabel  = pair_id % (MAX_LABEL + 1);
+
+	  unsigned int offset = struct3_scores.size();
+	  struct3_rows[pplabel * label_count + plabel] = offset;
+
+	  struct3_scores.insert(struct3_scores.end(), 
+				struct2_scores.begin() + plabel * label_count,
+				struct2_scores.begin() + (plabel + 1) * label_count);
+
+	  float * row = &struct3_scores[offset];
+
+	  for (unsigned int l = 0; l < label_count; ++l)
+	    { row[l] += struct1_scores[l]; }
+
+	  std::unordered_map<long, LabelWeightVector>::const_iterator 
+	    weights = pair_weights.find(pair_id);
+
+	  if (weights != pair_weights.end())
+	    {
+	      for (unsigned int j = 0; j < weights->second.size(); ++j)
+		{ row[weights->second[j].first] += weights->second[j].second; }
+	    }
+
+	  if (sub_pair_weights.empty())
+	    { continue; }
+
+	  const LabelVector &ppsub_labels = label_extractor->sub_labels(pplabel);
+	  const LabelVector &psub_labels = label_extractor->sub_labels(plabel);
+
+	  bool found = 0;
+	  sub_label_scores.assign(sub_label_count, 0);
+
+	  for (unsigned int j = 0; j < ppsub_labels.size(); ++j)
+	    {
+	      for (unsigned int k = 0; k < psub_labels.size(); ++k)
+		{
+		  std::unordered_map<long, std::vector<float> >::const_iterator 
+		    it = sub_pair_weights.find(ppsub_labels[j] * (MAX_LABEL + 1) + 
+					       psub_labels[k]);
+
+		  if (it == sub_pair_weights.end())
+		    { continue; }
+
+		  found = 1;
+
+		  for (unsigned int m = 0; m < sub_label_count; ++m)
+		    { sub_label_scores[m] += it->second[m]; }
+		}
+	    }
+
+	  if (not found)
+	    { continue; }
+
+	  for (unsigned int l = 0; l < label_count; ++l)
+	    {
+	      const LabelVector &sub_labels = label_extractor->sub_labels(l);
+
+	      for (unsigned int j = 0; j < sub_labels.size(); ++j)
+		{ row[l] += sub_label_scores[sub_index[sub_labels[j]]]; }
+	    }
+	}
+
+      if (complete)
+	{
+	  struct3_full_labels.resize(label_count);
+
+	  for (unsigned int l = 0; l < label_count; ++l)
+	    { struct3_full_labels[l] = (sub_index[l] == -1); }
+	}
+    }
+
+  struct_compiled = 1;
+  compiled_sublabel_order = sublabel_order;
+  compiled_model_order = model_order;
+  compiled_label_count = label_count;
+}
+
+bool ParamTable::is_compiled(void) const
+{ return compiled; }
+
+bool ParamTable::is_struct_compiled(void) const
+{ return struct_compiled; }
+
+void ParamTable::clear_compiled(void)
+{
+  if (unstruct_released)
+    { restore_unstruct_map(); }
+
+  compiled = 0;
+  unstruct_rows.clear();
+  unstruct_labels.clear();
+  unstruct_weights.clear();
+  unstruct_scales.clear();
+  unstruct_int8_weights.clear();
+  unstruct_fp16_weights.clear();
+
+  struct_compiled = 0;
+  struct1_scores.clear();
+  struct2_scores.clear();
+  struct3_rows.clear();
+  struct3_scores.clear();
+  struct3_full_labels.clear();
+}
+
+bool ParamTable::is_struct_compiled(Degree sublabel_order, 
+				    Degree model_order) const
+{
+  return (struct_compiled and 
+	  sublabel_order == compiled_sublabel_order and 
+	  model_order <= compiled_model_order);
+}
+
+float ParamTable::get_compiled_struct(unsigned int pplabel, 
+				      unsigned int plabel, 
+				      unsigned int label) const
+{
+  if (compiled_model_order > FIRST)
+    { return get_folded_struct<SECOND>(pplabel, plabel, label); }
+  else if (compiled_model_order > ZEROTH)
+    { return get_folded_struct<FIRST>(pplabel, plabel, label); }
+
+  return get_folded_struct<ZEROTH>(pplabel, plabel, label);
+}
+
+float ParamTable::get_compiled_unstruct(unsigned int row,
+					unsigned int row_begin,
+					unsigned int row_end,
+					unsigned int label) const
+{
+  const unsigned short * begin = unstruct_labels.data() + row_begin;
+  const unsigned short * end   = unstruct_labels.data() + row_end;
+  const unsigned short * it    = std::lower_bound(begin, end, label);
+
+  if (it == end or *it != label)
+    { return 0; }
+
+  return get_compiled_weight(row, it - unstruct_labels.data());
+}
+
+float ParamTable::get_compiled_weight(unsigned int row, unsigned int i) const
+{
+  if (compiled_quantization == INT8)
+    { return unstruct_int8_weights[i] * unstruct_scales[row]; }
+  else if (compiled_quantization == FP16)
+    { return half_to_float(unstruct_fp16_weights[i]) * unstruct_scales[row]; }
+  
+  return unstruct_weights[i];
+}
+
+const ParamMap &ParamTable::get_unstruct_map(ParamMap &buffer) const
+{
+  if (not unstruct_released)
+    { return unstruct_param_table; }
+
+  buffer.clear();
+  buffer.reserve(unstruct_labels.size());
+
+  for (unsigned int row = 0; row + 1 < unstruct_rows.size(); ++row)
+    {
+      for (unsigned int i = unstruct_rows[row]; i < unstruct_rows[row + 1]; ++i)
+	{ 
+	  buffer[get_unstruct_param_id(row, unstruct_labels[i])] = 
+	    get_compiled_weight(row, i); 
+	}
+    }
+
+  return buffer;
+}
+
+void ParamTable::restore_unstruct_map(void)
+{
+  ParamMap buffer;
+  get_unstruct_map(buffer);
+  unstruct_param_table = buffer;
+  unstruct_released = 0;
+}
+
 void ParamTable::set_param_filter(const TaggerOptions &options)
 {
   if (options.filter_type == UPDATE_COUNT)
@@ -75,16 +791,57 @@ void ParamTable::set_param_filter(const TaggerOptions &options)
     }
 }
 
+unsigned int ParamTable::get_hashed_feat_template
+(const std::string &feat_template_string) const
+{
+  // 64-bit FNV-1a. The bucket ids are stored in models, so the hash
+  // has to be the same on every platform.
+  uint64_t hash = UINT64_C(14695981039346656037);
+
+  for (unsigned int i = 0; i < feat_template_string.size(); ++i)
+    {
+      hash ^= static_cast<unsigned char>(feat_template_string[i]);
+      hash *= UINT64_C(1099511628211);
+    }
+
+  return hash % feature_hash_buckets;
+}
+
+bool ParamTable::find_feat_template(const std::string &feat_template_string,
+				    unsigned int &feat_template) const
+{
+  if (feature_hash_buckets != 0)
+    {
+      feat_template = get_hashed_feat_template(feat_template_string);
+      return 1;
+    }
+
+  FeatureTemplateMap::const_iterator it = 
+    feature_template_map.find(feat_template_string);
+
+  if (it == feature_template_map.end())
+    { return 0; }
+
+  feat_template = it->second;
+  return 1;
+}
+
 unsigned int ParamTable::get_feat_template
 (const std::string &feat_template_string)
 {
-  if (feature_template_map.find(feat_template_string) == 
-      feature_template_map.end())
-    { 
-      feature_template_map[feat_template_string] = feature_template_map.size();
-    }
+  if (feature_hash_buckets != 0)
+    { return get_hashed_feat_template(feat_template_string); }
+
+  FeatureTemplateMap::const_iterator it = 
+    feature_template_map.find(feat_template_string);
+
+  if (it != feature_template_map.end())
+    { return it->second; }
+
+  unsigned int id = feature_template_map.size();
+  feature_template_map[feat_template_string] = id;
 
-  return feature_template_map[feat_template_string];
+  return id;
 }
 
 FeatureTemplateVector ParamTable::get_feat_templates
@@ -94,7 +851,8 @@ FeatureTemplateVector ParamTable::get_feat_templates
 
   for (unsigned int i = 0; i < feat_template_strings.size(); ++i)
     {
-      if (trained and feature_template_map.count(feat_template_strings[i]) == 0)
+      if (trained and feature_hash_buckets == 0 and
+	  feature_template_map.count(feat_template_strings[i]) == 0)
 	{ 
 	  continue; 
 	}
@@ -158,7 +916,16 @@ std::string ParamTable::get_unstruct_feat_repr(long feat_id,
   long label = feat_id % (MAX_LABEL + 1);
   long feat_template = (feat_id - label) / (MAX_LABEL + 1);
   std::string label_string = label_extractor->get_label_string(label);
-  std::string feat_template_string = m[feat_template];
+  std::string feat_template_string;
+
+  if (feat_template < static_cast<long>(m.size()))
+    { feat_template_string = m[feat_template]; }
+  else
+    {
+      std::ostringstream bucket_out;
+      bucket_out << "BUCKET:" << feat_template;
+      feat_template_string = bucket_out.str();
+    }
 
   return feat_template_string + " " + label_string;
 }
@@ -222,28 +989,24 @@ float ParamTable::get_filtered_param(long param_id, float param) const
 float ParamTable::get_unstruct(unsigned int feature_template, 
 			       unsigned int label) const
 {
-  long id = get_unstruct_param_id(feature_template, label);
-  
-  ParamMap::const_iterator it = unstruct_param_table.find(id);
+  if (compiled)
+    {
+      if (feature_template + 1 >= unstruct_rows.size())
+	{ return 0; }
 
-  if (it == unstruct_param_table.end())
-    { return 0; }
+      return get_compiled_unstruct(feature_template,
+				   unstruct_rows[feature_template],
+				   unstruct_rows[feature_template + 1],
+				   label);
+    }
 
-  return get_filtered_param(id, it->second);
+  return get_param(UNSTRUCT_PARAM, 
+		   get_unstruct_param_id(feature_template, label));
 }
 
 float ParamTable::get_struct1(unsigned int label, Degree sublabel_order) const
 {
-  long id = get_struct_param_id(label);
-  
-  ParamMap::const_iterator it = struct_param_table.find(id);
-
-  float res = 0;
-  
-  if (it != struct_param_table.end())
-    { 
-      res += get_filtered_param(id, it->second); 
-    }
+  float res = get_param(STRUCT_PARAM, get_struct_param_id(label));
 
   if (label_extractor != 0 and sublabel_order > NODEG)
     {
@@ -251,13 +1014,7 @@ float ParamTable::get_struct1(unsigned int label, Degree sublabel_order) const
 
       for (unsigned int j = 0; j < sub_labels.size(); ++j)
 	{
-	  id = get_struct_param_id(sub_labels[j]);	      
-	  it = struct_param_table.find(id);
-
-	  if (it != struct_param_table.end())
-	    { 
-	      res += get_filtered_param(id, it->second);
-	    }
+	  res += get_param(STRUCT_PARAM, get_struct_param_id(sub_labels[j]));
 	}
     }
 
@@ -266,16 +1023,7 @@ float ParamTable::get_struct1(unsigned int label, Degree sublabel_order) const
 
 float ParamTable::get_struct2(unsigned int plabel, unsigned int label, Degree sublabel_order) const
 {
-  long id = get_struct_param_id(plabel, label);
-  
-  ParamMap::const_iterator it = struct_param_table.find(id);
-
-  float res = 0;
-
-  if (it != struct_param_table.end())
-    {
-      res += get_filtered_param(id, it->second);
-    }
+  float res = get_param(STRUCT_PARAM, get_struct_param_id(plabel, label));
 
   if (label_extractor != 0 and sublabel_order > ZEROTH)
     {
@@ -286,13 +1034,8 @@ float ParamTable::get_struct2(unsigned int plabel, unsigned int label, Degree su
 	{
 	  for (unsigned int j = 0; j < sub_labels.size(); ++j)
 	    {
-	      id = get_struct_param_id(psub_labels[i], sub_labels[j]);	      
-	      it = struct_param_table.find(id);
-
-	      if (it != struct_param_table.end())
-		{ 
-		  res += get_filtered_param(id, it->second);
-		}
+	      res += get_param(STRUCT_PARAM, 
+			       get_struct_param_id(psub_labels[i], sub_labels[j]));
 	    }
 	}
     }
@@ -305,16 +1048,8 @@ float ParamTable::get_struct3(unsigned int pplabel,
 			      unsigned int label,
 			      Degree sublabel_order) const
 {
-  long id = get_struct_param_id(pplabel, plabel, label);
-  
-  ParamMap::const_iterator it = struct_param_table.find(id);
-
-  float total = 0;
-
-  if (it != struct_param_table.end())
-    { 
-      total += get_filtered_param(id, it->second);
-    }
+  float total = 
+    get_param(STRUCT_PARAM, get_struct_param_id(pplabel, plabel, label));
 
   if (label_extractor != 0 and sublabel_order > FIRST)
     {
@@ -328,13 +1063,10 @@ float ParamTable::get_struct3(unsigned int pplabel,
 	    {
 	      for (unsigned int k = 0; k < sub_labels.size(); ++k)
 		{
-		  size_t id = get_struct_param_id(ppsub_labels[i], psub_labels[j], sub_labels[k]);
-		  it = struct_param_table.find(id);
-
-		  if (it != struct_param_table.end())
-		    {
-		      total += get_filtered_param(id, it->second);
-		    }
+		  total += get_param(STRUCT_PARAM, 
+				     get_struct_param_id(ppsub_labels[i], 
+							 psub_labels[j], 
+							 sub_labels[k]));
 		}
 	    }
 	}
@@ -343,10 +1075,67 @@ float ParamTable::get_struct3(unsigned int pplabel,
   return total;
 }
 
+// Sub label list for get_compiled_all_unstruct<true> without a label
+// extractor.
+static const LabelVector NO_SUB_LABELS;
+
+template <bool SUBLABELS>
+float ParamTable::get_compiled_all_unstruct(const Word &word, 
+					    unsigned int label) const
+{
+  const LabelVector &sub_labels = 
+    (SUBLABELS and label_extractor != 0 ? 
+     label_extractor->sub_labels(label) : 
+     NO_SUB_LABELS);
+
+  float res = 0;
+
+  for (unsigned int i = 0; i < word.get_feature_template_count(); ++i)
+    {
+      unsigned int feature_template = word.get_feature_template(i);
+
+      if (feature_template + 1 >= unstruct_rows.size())
+	{ continue; }
+
+      unsigned int row_begin = unstruct_rows[feature_template];
+      unsigned int row_end   = unstruct_rows[feature_template + 1];
+
+      if (row_begin == row_end)
+	{ continue; }
+
+      res += get_compiled_unstruct(feature_template, row_begin, row_end, label);
+
+      if (not SUBLABELS)
+	{ continue; }
+
+      for (unsigned int j = 0; j < sub_labels.size(); ++j)
+	{ 
+	  res += get_compiled_unstruct(feature_template, row_begin, row_end, 
+				       sub_labels[j]); 
+	}
+    }
+
+  return res;
+}
+
+template float ParamTable::get_compiled_all_unstruct<false>
+(const Word &word, unsigned int label) const;
+
+template float ParamTable::get_compiled_all_unstruct<true>
+(const Word &word, unsigned int label) const;
+
 float ParamTable::get_all_unstruct(const Word &word, unsigned int label, Degree sub_label_order) const
 {
   float res = 0;
 
+  if (compiled)
+    {
+      if (sub_label_order > NODEG)
+	{ return get_compiled_all_unstruct<true>(word, label); }
+
+      return get_compiled_all_unstruct<false>(word, label);
+    }
+
   for (unsigned int i = 0; i < word.get_feature_template_count(); ++i)
     {
       res += get_unstruct(word.get_feature_template(i), label);
@@ -374,6 +1163,23 @@ float ParamTable::get_all_struct_fw(unsigned int pplabel,
 				    Degree sublabel_order,
 				    Degree model_order) const
 {
+  if (struct_compiled                            and 
+      sublabel_order == compiled_sublabel_order  and 
+      model_order == compiled_model_order        and
+      pplabel < compiled_label_count             and 
+      plabel < compiled_label_count              and
+      label < compiled_label_count)
+    { return get_compiled_struct(pplabel, plabel, label); }
+
+  // The compiled tables of a second order model also hold the scores
+  // of the first order model that is used for coarse-to-fine
+  // decoding.
+  if (model_order == FIRST                       and
+      is_struct_compiled(sublabel_order, FIRST)  and
+      plabel < compiled_label_count              and
+      label < compiled_label_count)
+    { return get_folded_struct<FIRST>(pplabel, plabel, label); }
+
   return 
     (model_order >  FIRST ? get_struct3(pplabel, plabel, label, sublabel_order) : 0) +
     (model_order > ZEROTH ? get_struct2(plabel, label, sublabel_order) : 0) +
@@ -386,230 +1192,289 @@ float ParamTable::get_all_struct_bw(unsigned int pplabel,
 				    Degree sublabel_order,
 				    Degree model_order) const
 {
+  if (struct_compiled                            and 
+      sublabel_order == compiled_sublabel_order  and 
+      model_order == compiled_model_order        and
+      pplabel < compiled_label_count             and 
+      plabel < compiled_label_count              and
+      label < compiled_label_count)
+    { return get_compiled_struct(pplabel, plabel, label); }
+
   return 
     (model_order > FIRST ? get_struct3(pplabel, plabel, label, sublabel_order) : 0) +
     (model_order > ZEROTH ? get_struct2(plabel, label, sublabel_order) : 0) +
     get_struct1(label, sublabel_order);
 }
 
-void ParamTable::update_unstruct(unsigned int feature_template, 
-				 unsigned int label, 
-				 float ud)
+void ParamTable::update_param(ParamType type, long id, float ud, float sigma)
 {
-  size_t id = get_unstruct_param_id(feature_template, label);
-  if (unstruct_param_table.count(id) == 0)
-    { unstruct_param_table[id] = 0; }
+  if (concurrent)
+    {
+      ConcurrentParamMap &table = (type == UNSTRUCT_PARAM ? 
+				   *concurrent_unstruct_table : 
+				   *concurrent_struct_table);
+      if (sigma == 0)
+	{
+	  table.add(id, ud, averaging ? -time * ud : 0);
+	  return;
+	}
+
+      float change = table.add_and_scale(id, ud, 1 - sigma);
+
+      if (averaging)
+	{ table.add(id, 0, -time * change); }
+
+      return;
+    }
 
   if (filter_type == UPDATE_COUNT)
-    { ++update_count_map[id]; }
+    { update_count_map[id] += (sigma == 0 ? 1 : 2); }
+
+  double scale = get_l2_scale(type, id);
+  float &param = (type == UNSTRUCT_PARAM ? 
+		 unstruct_param_table[id] : 
+		 struct_param_table[id]);
+  float value = param * scale + ud;
 
-  unstruct_param_table[get_unstruct_param_id(feature_template, label)] += ud;
+  if (sigma != 0)
+    { 
+      float shrinkage = value * sigma;
+      value -= shrinkage;
+      ud -= shrinkage;
+    }
+
+  if (l1_penalty != 0)
+    { 
+      apply_l1_penalty(value, (type == UNSTRUCT_PARAM ? 
+			       unstruct_l1_table[id] : 
+			       struct_l1_table[id]));
+    }
+
+  param = (scale == 1 ? value : value / scale);
+
+  if (averaging)
+    { 
+      ParamMap &sum_table = (type == UNSTRUCT_PARAM ? 
+			     unstruct_sum_table : 
+			     struct_sum_table);
+      sum_table[id] += -time * ud; 
+    }
 }
 
-void ParamTable::update_struct1(unsigned int label, float ud, Degree sublabel_order)
+// Factors below this are applied to the parameters, so the stored
+// parameters stay well inside the range of float.
+static const double MIN_L2_SCALE = 1e-15;
+
+double ParamTable::get_l2_scale(ParamType type, long id) const
 {
-  size_t id = get_struct_param_id(label);
-  
-  if (struct_param_table.count(id) == 0)
-    { struct_param_table[id] = 0; }
+  if (type == UNSTRUCT_PARAM or struct_l2_scales.empty())
+    { return 1; }
 
-  if (filter_type == UPDATE_COUNT)
-    { ++update_count_map[id]; }
+  size_t label = id % (MAX_LABEL + 1);
+
+  return label < struct_l2_scales.size() ? struct_l2_scales[label] : 1;
+}
+
+void ParamTable::scale_l2(unsigned int label, float sigma)
+{
+  if (label >= struct_l2_scales.size())
+    { struct_l2_scales.resize(label + 1, 1); }
+
+  struct_l2_scales[label] *= 1 - sigma;
+
+  if (struct_l2_scales[label] < MIN_L2_SCALE)
+    { apply_l2_scales(); }
+}
+
+void ParamTable::shrink_unstruct(const Word &word, 
+				 unsigned int label, 
+				 float sigma)
+{
+  for (unsigned int i = 0; i < word.get_feature_template_count(); ++i)
+    {
+      ParamMap::iterator it = unstruct_param_table.find
+	(get_unstruct_param_id(word.get_feature_template(i), label));
+
+      if (it != unstruct_param_table.end())
+	{ it->second *= 1 - sigma; }
+    }
+}
+
+void ParamTable::regularize_l2_unstruct(const Word &word, 
+					unsigned int label,
+					float sigma,
+					Degree sublabel_order)
+{
+  if (compiled)
+    { clear_compiled(); }
 
-  struct_param_table[get_struct_param_id(label)] += ud;
+  shrink_unstruct(word, label, sigma);
 
   if (label_extractor != 0 and sublabel_order > NODEG)
     {
       const LabelVector &sub_labels = label_extractor->sub_labels(label);
 
       for (unsigned int i = 0; i < sub_labels.size(); ++i)
-	{
-	  size_t id = get_struct_param_id(sub_labels[i]);
-  
-	  if (struct_param_table.count(id) == 0)
-	    { struct_param_table[id] = 0; }
-
-	  if (filter_type == UPDATE_COUNT)
-	    { ++update_count_map[id]; }
-
-	  struct_param_table[get_struct_param_id(sub_labels[i])] += ud;
-	}
+	{ shrink_unstruct(word, sub_labels[i], sigma); }
     }
 }
 
-void ParamTable::regularize_struct1(unsigned int label, float sigma, Degree sublabel_order)
+void ParamTable::regularize_l2_struct(unsigned int label, 
+				      float sigma, 
+				      Degree sublabel_order)
 {
-  size_t id = get_struct_param_id(label);
-  
-  if (struct_param_table.count(id) == 0)
-    { struct_param_table[id] = 0; }
-
-  if (filter_type == UPDATE_COUNT)
-    { ++update_count_map[id]; }
+  if (struct_compiled)
+    { clear_compiled(); }
 
-  float ud = -1 * struct_param_table[id] * sigma;
-  struct_param_table[id] += ud;
+  scale_l2(label, sigma);
 
   if (label_extractor != 0 and sublabel_order > NODEG)
     {
       const LabelVector &sub_labels = label_extractor->sub_labels(label);
 
       for (unsigned int i = 0; i < sub_labels.size(); ++i)
-	{
-	  size_t id = get_struct_param_id(sub_labels[i]);
-  
-	  if (struct_param_table.count(id) == 0)
-	    { struct_param_table[id] = 0; }
+	{ scale_l2(sub_labels[i], sigma); }
+    }
+}
 
-	  if (filter_type == UPDATE_COUNT)
-	    { ++update_count_map[id]; }
+void ParamTable::apply_l2_scales(void)
+{
+  if (not struct_l2_scales.empty())
+    {
+      for (ParamMap::iterator it = struct_param_table.begin();
+	   it != struct_param_table.end();
+	   ++it)
+	{ it->second *= get_l2_scale(STRUCT_PARAM, it->first); }
 
-	  float ud = -1 * struct_param_table[id] * sigma;
-	  struct_param_table[id] += ud;
-	}
+      struct_l2_scales.clear();
     }
 }
 
-void ParamTable::update_struct2(unsigned int plabel, 
-				unsigned int label, 
-				float ud,
-				Degree sublabel_order)
+void ParamTable::apply_l1_penalty(float &param, 
+				  float &received_penalty) const
 {
-  size_t id = get_struct_param_id(plabel, label);
-  
-  if (struct_param_table.count(id) == 0)
-    { struct_param_table[id] = 0; }
+  float value = param;
+  float old_value = value;
 
-  if (filter_type == UPDATE_COUNT)
-    { ++update_count_map[id]; }
+  if (value > 0)
+    { value = std::max<float>(0, value - (l1_penalty + received_penalty)); }
+  else if (value < 0)
+    { value = std::min<float>(0, value + (l1_penalty - received_penalty)); }
 
-  struct_param_table[get_struct_param_id(plabel, label)] += ud;
+  received_penalty += value - old_value;
+  param = value;
+}
 
-  if (label_extractor != 0 and sublabel_order > ZEROTH)
+float ParamTable::get_param(ParamType type, long id) const
+{
+  float param = 0;
+
+  if (concurrent)
     {
-      const LabelVector &sub_labels = label_extractor->sub_labels(label);
-      const LabelVector &psub_labels = label_extractor->sub_labels(plabel);
+      const ConcurrentParamMap &table = (type == UNSTRUCT_PARAM ? 
+					 *concurrent_unstruct_table : 
+					 *concurrent_struct_table);
+      if (not table.find(id, param))
+	{ return 0; }
+    }
+  else
+    {
+      const ParamMap &table = (type == UNSTRUCT_PARAM ? 
+			       unstruct_param_table : 
+			       struct_param_table);
+      ParamMap::const_iterator it = table.find(id);
 
-      for (unsigned int i = 0; i < psub_labels.size(); ++i)
-	{
-	  for (unsigned int j = 0; j < sub_labels.size(); ++j)
-	    {
-	      size_t id = get_struct_param_id(psub_labels[i], sub_labels[j]);
-	      
-	      if (struct_param_table.count(id) == 0)
-		{ struct_param_table[id] = 0; }
+      if (it == table.end())
+	{ return 0; }
 
-	      if (filter_type == UPDATE_COUNT)
-		{ ++update_count_map[id]; }
+      param = it->second * get_l2_scale(type, id);
 
-	      struct_param_table[get_struct_param_id(psub_labels[i], 
-						     sub_labels[j])] += ud;
-	    }
+      if (averaged_reads)
+	{ 
+	  param = get_summed_param(id, param, 
+				   (type == UNSTRUCT_PARAM ? 
+				    unstruct_sum_table : 
+				    struct_sum_table),
+				   time);
 	}
     }
+
+  return get_filtered_param(id, param);
 }
 
-void ParamTable::regularize_struct2(unsigned int plabel, 
-				    unsigned int label, 
-				    float sigma,
-				    Degree sublabel_order)
+void ParamTable::update_unstruct(unsigned int feature_template, 
+				 unsigned int label, 
+				 float ud,
+				 float sigma)
 {
-  size_t id = get_struct_param_id(plabel, label);
-  
-  if (struct_param_table.count(id) == 0)
-    { struct_param_table[id] = 0; }
+  if (compiled)
+    { clear_compiled(); }
 
-  if (filter_type == UPDATE_COUNT)
-    { ++update_count_map[id]; }
+  update_param(UNSTRUCT_PARAM, 
+	       get_unstruct_param_id(feature_template, label), ud, sigma);
+}
 
-  float ud = -1 * struct_param_table[id] * sigma;
-  struct_param_table[id] += ud;
+void ParamTable::update_struct1(unsigned int label, 
+				float ud, 
+				Degree sublabel_order,
+				float sigma)
+{
+  if (struct_compiled)
+    { clear_compiled(); }
 
-  if (label_extractor != 0 and sublabel_order > ZEROTH)
+  update_param(STRUCT_PARAM, get_struct_param_id(label), ud, sigma);
+
+  if (label_extractor != 0 and sublabel_order > NODEG)
     {
       const LabelVector &sub_labels = label_extractor->sub_labels(label);
-      const LabelVector &psub_labels = label_extractor->sub_labels(plabel);
 
-      for (unsigned int i = 0; i < psub_labels.size(); ++i)
+      for (unsigned int i = 0; i < sub_labels.size(); ++i)
 	{
-	  for (unsigned int j = 0; j < sub_labels.size(); ++j)
-	    {
-	      size_t id = get_struct_param_id(psub_labels[i], sub_labels[j]);
-	      
-	      if (struct_param_table.count(id) == 0)
-		{ struct_param_table[id] = 0; }
-
-	      if (filter_type == UPDATE_COUNT)
-		{ ++update_count_map[id]; }
-	      
-	      float ud = -1 * struct_param_table[id] * sigma;
-	      struct_param_table[id] += ud;
-	    }
+	  update_param(STRUCT_PARAM, get_struct_param_id(sub_labels[i]), ud, sigma);
 	}
     }
 }
 
-void ParamTable::update_struct3(unsigned int pplabel, 
-				unsigned int plabel, 
+void ParamTable::update_struct2(unsigned int plabel, 
 				unsigned int label, 
 				float ud,
-				Degree sublabel_order)
+				Degree sublabel_order,
+				float sigma)
 {
-  size_t id = get_struct_param_id(pplabel, plabel, label);
-  
-  if (struct_param_table.count(id) == 0)
-    { struct_param_table[id] = 0; }
-
-  if (filter_type == UPDATE_COUNT)
-    { ++update_count_map[id]; }
+  if (struct_compiled)
+    { clear_compiled(); }
 
-  struct_param_table[get_struct_param_id(pplabel, plabel, label)] += ud;
+  update_param(STRUCT_PARAM, get_struct_param_id(plabel, label), ud, sigma);
 
-  if (label_extractor != 0 and sublabel_order > FIRST)
+  if (label_extractor != 0 and sublabel_order > ZEROTH)
     {
       const LabelVector &sub_labels = label_extractor->sub_labels(label);
       const LabelVector &psub_labels = label_extractor->sub_labels(plabel);
-      const LabelVector &ppsub_labels = label_extractor->sub_labels(pplabel);
 
-      for (unsigned int i = 0; i < ppsub_labels.size(); ++i)
+      for (unsigned int i = 0; i < psub_labels.size(); ++i)
 	{
-	  for (unsigned int j = 0; j < psub_labels.size(); ++j)
+	  for (unsigned int j = 0; j < sub_labels.size(); ++j)
 	    {
-	      for (unsigned int k = 0; k < sub_labels.size(); ++k)
-		{
-		  size_t id = get_struct_param_id(ppsub_labels[i], psub_labels[j], sub_labels[k]);
-		  
-		  if (struct_param_table.count(id) == 0)
-		    { struct_param_table[id] = 0; }
-
-		  if (filter_type == UPDATE_COUNT)
-		    { ++update_count_map[id]; }
-
-		  struct_param_table[get_struct_param_id(ppsub_labels[i], 
-							 psub_labels[j],
-							 sub_labels[k])] += ud;
-		}
+	      update_param(STRUCT_PARAM, 
+			   get_struct_param_id(psub_labels[i], sub_labels[j]), 
+			   ud, sigma);
 	    }
 	}
     }
 }
 
-void ParamTable::regularize_struct3(unsigned int pplabel, 
-				    unsigned int plabel, 
-				    unsigned int label, 
-				    float sigma,
-				    Degree sublabel_order)
+void ParamTable::update_struct3(unsigned int pplabel, 
+				unsigned int plabel, 
+				unsigned int label, 
+				float ud,
+				Degree sublabel_order,
+				float sigma)
 {
-  size_t id = get_struct_param_id(pplabel, plabel, label);
-  
-  if (struct_param_table.count(id) == 0)
-    { struct_param_table[id] = 0; }
+  if (struct_compiled)
+    { clear_compiled(); }
 
-  if (filter_type == UPDATE_COUNT)
-    { ++update_count_map[id]; }
-
-  float ud = -1 * sigma * struct_param_table[id];
-  struct_param_table[id] += ud;
+  update_param(STRUCT_PARAM, get_struct_param_id(pplabel, plabel, label), 
+	       ud, sigma);
 
   if (label_extractor != 0 and sublabel_order > FIRST)
     {
@@ -623,16 +1488,11 @@ void ParamTable::regularize_struct3(unsigned int pplabel,
 	    {
 	      for (unsigned int k = 0; k < sub_labels.size(); ++k)
 		{
-		  size_t id = get_struct_param_id(ppsub_labels[i], psub_labels[j], sub_labels[k]);
-		  
-		  if (struct_param_table.count(id) == 0)
-		    { struct_param_table[id] = 0; }
-
-		  if (filter_type == UPDATE_COUNT)
-		    { ++update_count_map[id]; }
-
-		  float ud = -1* sigma* struct_param_table[id];
-		  struct_param_table[id] += ud;
+		  update_param(STRUCT_PARAM, 
+			       get_struct_param_id(ppsub_labels[i], 
+						   psub_labels[j],
+						   sub_labels[k]), 
+			       ud, sigma);
 		}
 	    }
 	}
@@ -659,11 +1519,11 @@ void ParamTable::update_all_struct_bw(unsigned int pplabel, unsigned int plabel,
   update_struct1(label, update, sublabel_order);
 }
 
-void ParamTable::update_all_unstruct(const Word &word, unsigned int label, float update, Degree sub_label_order)
+void ParamTable::update_all_unstruct(const Word &word, unsigned int label, float update, Degree sub_label_order, float sigma)
 {
   for (unsigned int i = 0; i < word.get_feature_template_count(); ++i)
     {
-      update_unstruct(word.get_feature_template(i), label, update);
+      update_unstruct(word.get_feature_template(i), label, update, sigma);
     }
 
   if (label_extractor != 0 and sub_label_order > NODEG)
@@ -674,37 +1534,244 @@ void ParamTable::update_all_unstruct(const Word &word, unsigned int label, float
 	{
 	  for (unsigned int j = 0; j < sub_labels.size(); ++j)
 	    {
-	      update_unstruct(word.get_feature_template(i), sub_labels[j], update);
+	      update_unstruct(word.get_feature_template(i), sub_labels[j], update, sigma);
 	    }
 	}
     }
 }
 
-void ParamTable::regularize_all_unstruct(const Word &word, unsigned int label, float sigma, Degree sub_label_order)
+void ParamTable::set_averaging(bool averaging)
 {
-  for (unsigned int i = 0; i < word.get_feature_template_count(); ++i)
+  this->averaging = averaging;
+
+  if (not averaging)
     {
-      float ud = -1 * get_unstruct(word.get_feature_template(i), label) * sigma;
-      update_unstruct(word.get_feature_template(i), label, ud);
+      unstruct_sum_table.clear();
+      struct_sum_table.clear();
     }
+}
 
-  if (label_extractor != 0 and sub_label_order > NODEG)
+void ParamTable::set_time(float time)
+{ this->time = time; }
+
+void ParamTable::set_averaged_reads(bool averaged_reads)
+{
+  if (averaged_reads and (compiled or struct_compiled))
+    { clear_compiled(); }
+
+  this->averaged_reads = averaged_reads;
+}
+
+// Set @p target to @p params, or to their summed values if @p sums is
+// not 0.
+static void copy_param_map(ParamMap &target, 
+			   const ParamMap &params, 
+			   const ParamMap * sums, 
+			   float time)
+{
+  if (&target == &params)
     {
-      const LabelVector &sub_labels = label_extractor->sub_labels(label);
-      
-      for (unsigned int i = 0; i < word.get_feature_template_count(); ++i)
-	{
-	  for (unsigned int j = 0; j < sub_labels.size(); ++j)
-	    {
-	      float ud = -1 * get_unstruct(word.get_feature_template(i), sub_labels[j]) * sigma;
-	      update_unstruct(word.get_feature_template(i), sub_labels[j], ud);
-	    }
-	}
+      for (ParamMap::iterator it = target.begin(); it != target.end(); ++it)
+	{ it->second = get_summed_param(it->first, it->second, *sums, time); }
+
+      return;
+    }
+
+  target.clear();
+  target.reserve(params.size());
+
+  for (ParamMap::const_iterator it = params.begin(); it != params.end(); ++it)
+    {
+      target[it->first] = 
+	(sums == 0 ? it->second : 
+	 get_summed_param(it->first, it->second, *sums, time));
+    }
+}
+
+void ParamTable::copy_params(const ParamTable &another, bool averaged)
+{
+  if (this == &another)
+    {
+      if (not averaged)
+	{ return; }
+
+      apply_l2_scales();
+      clear_compiled();
+      copy_param_map(unstruct_param_table, unstruct_param_table, 
+		     &unstruct_sum_table, time);
+      copy_param_map(struct_param_table, struct_param_table, 
+		     &struct_sum_table, time);
+      set_averaging(0);
+      averaged_reads = 0;
+      l1_penalty = 0;
+      unstruct_l1_table.clear();
+      struct_l1_table.clear();
+      return;
+    }
+
+  // The old parameters are freed before the new ones are written.
+  unstruct_released = 0;
+  clear_compiled();
+  unstruct_param_table.clear();
+  struct_param_table.clear();
+
+  copy_settings(another);
+  unstruct_released = 0;
+  clear_compiled();
+
+  // Without averaging the sum tables are empty and the weights are
+  // multiplied by time + 1, which does not change the argmax.
+  ParamMap buffer;
+  copy_param_map(unstruct_param_table, another.get_unstruct_map(buffer), 
+		 averaged ? &another.unstruct_sum_table : 0, time);
+  copy_param_map(struct_param_table, another.struct_param_table, 
+		 averaged ? &another.struct_sum_table : 0, time);
+
+  if (not another.struct_l2_scales.empty())
+    {
+      for (ParamMap::iterator it = struct_param_table.begin();
+	   it != struct_param_table.end();
+	   ++it)
+	{ it->second *= another.get_l2_scale(STRUCT_PARAM, it->first); }
+    }
+
+  // The copies receive the L1 penalties that are pending in another.
+  if (not averaged and another.l1_penalty != 0)
+    {
+      another.copy_l1_penalties(unstruct_param_table, 
+				another.unstruct_l1_table);
+      another.copy_l1_penalties(struct_param_table, 
+				another.struct_l1_table);
+    }
+}
+
+void ParamTable::set_params(const ParamTable &another)
+{ copy_params(another, 0); }
+
+void ParamTable::set_averaged_params(const ParamTable &another)
+{ copy_params(another, 1); }
+
+void ParamTable::set_concurrent(bool concurrent)
+{
+  if (concurrent == this->concurrent)
+    { return; }
+
+  if (concurrent)
+    {
+      apply_l2_scales();
+      clear_compiled();
+
+      concurrent_unstruct_table.reset(new ConcurrentParamMap);
+      concurrent_unstruct_table->assign(unstruct_param_table, 
+					unstruct_sum_table);
+      concurrent_struct_table.reset(new ConcurrentParamMap);
+      concurrent_struct_table->assign(struct_param_table, struct_sum_table);
+
+      unstruct_param_table.clear();
+      unstruct_sum_table.clear();
+      struct_param_table.clear();
+      struct_sum_table.clear();
+    }
+  else
+    {
+      concurrent_unstruct_table->get(unstruct_param_table, 
+				     averaging ? &unstruct_sum_table : 0);
+      concurrent_struct_table->get(struct_param_table, 
+				   averaging ? &struct_sum_table : 0);
+
+      concurrent_unstruct_table.reset();
+      concurrent_struct_table.reset();
+    }
+
+  this->concurrent = concurrent;
+}
+
+bool ParamTable::is_concurrent(void) const
+{ return concurrent; }
+
+void ParamTable::regularize_l1(float penalty)
+{
+  if (compiled or struct_compiled)
+    { clear_compiled(); }
+
+  l1_penalty += penalty;
+}
+
+static void remove_zeros(ParamMap &param_table)
+{
+  ParamMap nonzero_params;
+
+  for (ParamMap::const_iterator it = param_table.begin();
+       it != param_table.end();
+       ++it)
+    {
+      if (it->second != 0)
+	{ nonzero_params[it->first] = it->second; }
+    }
+
+  param_table = nonzero_params;
+}
+
+void ParamTable::apply_l1_penalties(void)
+{
+  if (l1_penalty == 0)
+    { return; }
+
+  if (unstruct_released)
+    { restore_unstruct_map(); }
+
+  if (compiled or struct_compiled)
+    { clear_compiled(); }
+
+  apply_l1_penalties(unstruct_param_table, unstruct_l1_table);
+  apply_l1_penalties(struct_param_table, struct_l1_table);
+}
+
+void ParamTable::apply_l1_penalties(ParamMap &params, 
+				    ParamMap &received_penalties)
+{
+  for (ParamMap::iterator it = params.begin(); it != params.end(); ++it)
+    {
+      float scale = get_l2_scale(&params == &unstruct_param_table ? 
+				 UNSTRUCT_PARAM : STRUCT_PARAM, it->first);
+      float value = it->second * scale;
+      apply_l1_penalty(value, received_penalties[it->first]);
+      it->second = (scale == 1 ? value : value / scale);
     }
 }
 
+void ParamTable::copy_l1_penalties(ParamMap &params, 
+				   const ParamMap &received_penalties) const
+{
+  for (ParamMap::iterator it = params.begin(); it != params.end(); ++it)
+    {
+      ParamMap::const_iterator jt = received_penalties.find(it->first);
+      float received_penalty = 
+	(jt == received_penalties.end() ? 0 : jt->second);
+      apply_l1_penalty(it->second, received_penalty);
+    }
+}
+
+void ParamTable::remove_zero_params(void)
+{
+  if (unstruct_released)
+    { restore_unstruct_map(); }
+
+  apply_l1_penalties();
+  apply_l2_scales();
+
+  // The received penalties of the erased parameters are kept.
+  // Otherwise a parameter that is updated again would be charged the
+  // whole total penalty.
+  remove_zeros(unstruct_param_table);
+  remove_zeros(struct_param_table);
+}
+
 ParamMap::iterator ParamTable::get_unstruct_begin(void)
 {
+  if (unstruct_released)
+    { restore_unstruct_map(); }
+
   return unstruct_param_table.begin();
 }
 
@@ -715,6 +1782,9 @@ ParamMap::iterator ParamTable::get_struct_begin(void)
 
 ParamMap::iterator ParamTable::get_unstruct_end(void)
 {
+  if (unstruct_released)
+    { restore_unstruct_map(); }
+
   return unstruct_param_table.end();
 }
 
@@ -730,42 +1800,355 @@ void ParamTable::store(std::ostream &out) const
   write_val(out, trained);
   write_map(out, feature_template_map);
 
-  if (filter_type == UPDATE_COUNT)
-    { write_filtered_map(out, unstruct_param_table, update_count_map, update_threshold, 1); }
+  ParamMap buffer;
+  ParamMap sparse_unstruct_map;
+  ParamMap sparse_struct_map;
+  const ParamMap &unstruct_map = 
+    get_sparse_map(get_unstruct_map(buffer), sparse_unstruct_map);
+  const ParamMap &struct_map = 
+    get_sparse_map(struct_param_table, sparse_struct_map);
+
+  if (quantization != NO_QUANT)
+    { write_quantized_unstruct(out, get_stored_map(unstruct_map)); }
+  else if (filter_type == UPDATE_COUNT)
+    { write_filtered_map(out, unstruct_map, update_count_map, update_threshold, 1); }
   else if (filter_type == AVG_VALUE)
-    { write_avg_filtered_map(out, unstruct_param_table, avg_mass_threshold, train_iters, 1); }
+    { write_avg_filtered_map(out, unstruct_map, avg_mass_threshold, train_iters, 1); }
   else
-    { write_map(out, unstruct_param_table, 1); }
+    { write_map(out, unstruct_map, 1); }
 
   if (filter_type == UPDATE_COUNT)
-    { write_filtered_map(out, struct_param_table, update_count_map, update_threshold, 1); }
+    { write_filtered_map(out, struct_map, update_count_map, update_threshold, 1); }
   else if (filter_type == AVG_VALUE)
-    { write_avg_filtered_map(out, struct_param_table, avg_mass_threshold, train_iters, 1); }
+    { write_avg_filtered_map(out, struct_map, avg_mass_threshold, train_iters, 1); }
   else
-    { write_map(out, struct_param_table, 1); }
+    { write_map(out, struct_map, 1); }
 }
 
 void ParamTable::load(std::istream &in, bool reverse_bytes)
 {
+  unstruct_released = 0;
+  clear_compiled();
+
   read_val<bool>(in, trained, reverse_bytes);
   std::cerr << trained << std::endl;
   read_map(in, feature_template_map, reverse_bytes);
-  read_map(in, unstruct_param_table, reverse_bytes);
+
+  if (quantization != NO_QUANT)
+    { read_quantized_unstruct(in, reverse_bytes); }
+  else
+    { read_map(in, unstruct_param_table, reverse_bytes); }
+
   read_map(in, struct_param_table, reverse_bytes);
   label_extractor = 0;
 }
 
+void ParamTable::write_quantized_unstruct(std::ostream &out, 
+					  const ParamMap &m) const
+{
+  std::vector<float> scales;
+
+  for (ParamMap::const_iterator it = m.begin(); it != m.end(); ++it)
+    {
+      unsigned int row = it->first / (MAX_LABEL + 1);
+
+      if (row >= scales.size())
+	{ scales.resize(row + 1, 0); }
+
+      scales[row] = std::max<float>(scales[row], fabs(it->second));
+    }
+
+  for (unsigned int i = 0; i < scales.size(); ++i)
+    { scales[i] = get_scale(scales[i], quantization); }
+
+  std::cerr << "Writing " << m.size() << " quantized parameters." << std::endl;
+
+  write_vector(out, scales);
+  write_val<unsigned int>(out, m.size());
+
+  const size_t code_size = (quantization == INT8 ? 1 : 2);
+  const size_t entry_size = sizeof(long) + code_size;
+  std::vector<char> buffer(m.size() * entry_size);
+  size_t pos = 0;
+
+  for (ParamMap::const_iterator it = m.begin(); it != m.end(); ++it)
+    {
+      float scale = scales[it->first / (MAX_LABEL + 1)];
+      memcpy(&buffer[pos], &it->first, sizeof(long));
+
+      if (quantization == INT8)
+	{ buffer[pos + sizeof(long)] = get_int8_code(it->second, scale); }
+      else
+	{
+	  unsigned short code = get_fp16_code(it->second, scale);
+	  memcpy(&buffer[pos + sizeof(long)], &code, code_size);
+	}
+
+      pos += entry_size;
+    }
+
+  out.write(buffer.data(), buffer.size());
+
+  if (out.fail())
+    { throw WriteFailed(); }
+}
+
+void ParamTable::read_quantized_unstruct(std::istream &in, bool reverse_bytes)
+{
+  std::vector<float> scales;
+  read_vector(in, scales, reverse_bytes);
+
+  unsigned int size;
+  read_val<unsigned int>(in, size, reverse_bytes);
+
+  const size_t code_size = (quantization == INT8 ? 1 : 2);
+  const size_t entry_size = sizeof(long) + code_size;
+  std::vector<char> buffer(size * entry_size);
+
+  in.read(buffer.data(), buffer.size());
+
+  if (in.fail())
+    { throw ReadFailed(); }
+
+  unstruct_param_table.reserve(unstruct_param_table.size() + size);
+
+  for (size_t pos = 0; pos < buffer.size(); pos += entry_size)
+    {
+      long id;
+      memcpy(&id, &buffer[pos], sizeof(long));
+
+      if (reverse_bytes)
+	{ id = reverse_num(id); }
+
+      unsigned int row = id / (MAX_LABEL + 1);
+
+      if (id < 0 or row >= scales.size())
+	{ throw BadBinary(); }
+
+      if (quantization == INT8)
+	{ 
+	  signed char code = buffer[pos + sizeof(long)];
+	  unstruct_param_table[id] = code * scales[row]; 
+	}
+      else
+	{
+	  unsigned short code;
+	  memcpy(&code, &buffer[pos + sizeof(long)], code_size);
+
+	  if (reverse_bytes)
+	    { code = reverse_num(code); }
+
+	  unstruct_param_table[id] = half_to_float(code) * scales[row];
+	}
+    }
+}
+
+void ParamTable::set_quantization(Quantization quantization)
+{ this->quantization = quantization; }
+
+void ParamTable::set_feature_hash_buckets(unsigned int buckets)
+{ feature_hash_buckets = buckets; }
+
+const ParamMap &ParamTable::get_sparse_map(const ParamMap &m,
+					   ParamMap &buffer) const
+{
+  bool has_zeros = 0;
+
+  for (ParamMap::const_iterator it = m.begin(); it != m.end(); ++it)
+    {
+      if (it->second == 0)
+	{
+	  has_zeros = 1;
+	  break;
+	}
+    }
+
+  if (not has_zeros)
+    { return m; }
+
+  buffer.clear();
+
+  for (ParamMap::const_iterator it = m.begin(); it != m.end(); ++it)
+    {
+      if (it->second != 0)
+	{ buffer[it->first] = it->second; }
+    }
+
+  return buffer;
+}
+
+ParamMap ParamTable::get_stored_map(const ParamMap &m) const
+{
+  if (filter_type == NO_FILTER)
+    { return m; }
+
+  ParamMap res;
+
+  for (ParamMap::const_iterator it = m.begin(); it != m.end(); ++it)
+    {
+      if (filter_type == UPDATE_COUNT)
+	{
+	  UpdateCountMap::const_iterator jt = update_count_map.find(it->first);
+
+	  if (jt == update_count_map.end() or jt->second < update_threshold)
+	    { continue; }
+	}
+      else if (fabs(it->second)/train_iters < avg_mass_threshold)
+	{ continue; }
+
+      res[it->first] = it->second;
+    }
+
+  return res;
+}
+
+void ParamTable::store_mapped(std::ostream &out) const
+{
+  std::ostringstream head_out;
+  write_val(head_out, trained);
+  write_map(head_out, feature_template_map);
+
+  std::string head = head_out.str();
+  head.append((8 - head.size() % 8) % 8, '\0');
+
+  write_val<unsigned long>(out, head.size());
+  out.write(head.data(), head.size());
+
+  ParamMap buffer;
+  ParamMap sparse_map;
+  ParamMap unstruct_map = 
+    get_stored_map(get_sparse_map(get_unstruct_map(buffer), sparse_map));
+
+  if (quantization == NO_QUANT)
+    { unstruct_map.store_mapped(out); }
+  else
+    { ParamMap().store_mapped(out); }
+
+  get_stored_map(get_sparse_map(struct_param_table, sparse_map))
+    .store_mapped(out);
+
+  // Quantized unstructured parameters follow as compiled rows.
+  if (quantization != NO_QUANT)
+    {
+      ParamTable rows;
+      rows.trained = 1;
+      rows.quantization = quantization;
+      rows.unstruct_param_table = unstruct_map;
+      rows.compile();
+
+      rows.unstruct_rows.store_mapped(out);
+      rows.unstruct_labels.store_mapped(out);
+      rows.unstruct_scales.store_mapped(out);
+
+      if (quantization == INT8)
+	{ rows.unstruct_int8_weights.store_mapped(out); }
+      else
+	{ rows.unstruct_fp16_weights.store_mapped(out); }
+    }
+}
+
+void ParamTable::load_mapped(const char * data, size_t size)
+{
+  unstruct_released = 0;
+  clear_compiled();
+
+  const char * data_end = data + size;
+
+  if (size < sizeof(unsigned long))
+    { throw BadBinary(); }
+
+  unsigned long head_size;
+  memcpy(&head_size, data, sizeof(unsigned long));
+  data += sizeof(unsigned long);
+
+  if (head_size > size - sizeof(unsigned long))
+    { throw BadBinary(); }
+
+  MemoryInputBuffer head_buffer(data, head_size);
+  std::istream head_in(&head_buffer);
+
+  read_val<bool>(head_in, trained, false);
+  feature_template_map.clear();
+  read_map(head_in, feature_template_map, false);
+
+  data = unstruct_param_table.load_mapped(data + head_size, data_end);
+  data = struct_param_table.load_mapped(data, data_end);
+
+  // Quantized models store the unstructured parameters as compiled
+  // rows after an empty map. Mapped models stored before that hold
+  // float parameters in the map and have no rows.
+  if (quantization != NO_QUANT and 
+      (data != data_end or unstruct_param_table.size() == 0))
+    { load_mapped_rows(data, data_end); }
+
+  label_extractor = 0;
+}
+
+void ParamTable::load_mapped_rows(const char * data, const char * data_end)
+{
+  data = unstruct_rows.load_mapped(data, data_end);
+  data = unstruct_labels.load_mapped(data, data_end);
+  data = unstruct_scales.load_mapped(data, data_end);
+
+  size_t code_count;
+
+  if (quantization == INT8)
+    { 
+      data = unstruct_int8_weights.load_mapped(data, data_end); 
+      code_count = unstruct_int8_weights.size();
+    }
+  else
+    { 
+      data = unstruct_fp16_weights.load_mapped(data, data_end); 
+      code_count = unstruct_fp16_weights.size();
+    }
+
+  // The row bounds are checked, so lookups stay inside the arrays. The
+  // rows are read through a const reference, which does not copy them.
+  const MappedVector<unsigned int> &rows = unstruct_rows;
+
+  if (data != data_end or 
+      rows.empty() or 
+      rows[0] != 0 or
+      rows[rows.size() - 1] != unstruct_labels.size() or
+      unstruct_scales.size() + 1 != rows.size() or
+      code_count != unstruct_labels.size())
+    { throw BadBinary(); }
+
+  for (unsigned int i = 0; i + 1 < rows.size(); ++i)
+    {
+      if (rows[i] > rows[i + 1])
+	{ throw BadBinary(); }
+    }
+
+  compiled = 1;
+  compiled_quantization = quantization;
+  unstruct_released = 1;
+}
+
 bool ParamTable::operator==(const ParamTable &another) const
 {
+  ParamMap buffer;
+  ParamMap another_buffer;
+  ParamMap sparse_map;
+  ParamMap another_sparse_map;
+  ParamMap sparse_struct_map;
+  ParamMap another_sparse_struct_map;
+
   //  if (this == &another)
   //    { return 1; }
 
+  // Zero parameters are not stored, so they are ignored here.
   return
     (label_extractor->operator==(*(another.label_extractor)) and
      trained == another.trained and
      feature_template_map == another.feature_template_map and
-     unstruct_param_table == another.unstruct_param_table and
-     struct_param_table == another.struct_param_table);
+     get_sparse_map(get_unstruct_map(buffer), sparse_map) == 
+     another.get_sparse_map(another.get_unstruct_map(another_buffer),
+			    another_sparse_map) and
+     get_sparse_map(struct_param_table, sparse_struct_map) == 
+     another.get_sparse_map(another.struct_param_table,
+			    another_sparse_struct_map));
 }
 
 std::ostream &operator<<(std::ostream &out, const ParamTable &table)
@@ -779,17 +2162,19 @@ std::ostream &operator<<(std::ostream &out, const ParamTable &table)
        ++it)
     { m[it->second] = it->first; }
 
-  out << "UNSTRUCTURED FEATURES" << std::endl;
-  for (ParamMap::const_iterator it = 
-	 table.unstruct_param_table.begin();
-       it != table.unstruct_param_table.end();
+  ParamMap buffer;
+  const ParamMap &unstruct_map = table.get_unstruct_map(buffer);
+
+  out << "UNSTRUCTURED FEATURES\n";
+  for (ParamMap::const_iterator it = unstruct_map.begin();
+       it != unstruct_map.end();
        ++it)
     {
       std::string feat_str = table.get_unstruct_feat_repr(it->first, m);
-      out << feat_str << ' ' << it->second << std::endl;
+      out << feat_str << ' ' << it->second << '\n';
     }
 
-  out << "STRUCTURED FEATURES" << std::endl;
+  out << "STRUCTURED FEATURES\n";
 
   for (ParamMap::const_iterator it = 
 	 table.struct_param_table.begin();
@@ -797,7 +2182,7 @@ std::ostream &operator<<(std::ostream &out, const ParamTable &table)
        ++it)
     {
       std::string feat_str = table.get_struct_feat_repr(it->first);
-      out << feat_str << ' ' << it->second << std::endl;
+      out << feat_str << ' ' << it->second << '\n';
     }
 
   return out;
@@ -807,8 +2192,10 @@ std::ostream &operator<<(std::ostream &out, const ParamTable &table)
 
 #include <sstream>
 #include <cassert>
+#include <cstring>
 
 #include "LabelExtractor.hh"
+#include "Word.hh"
 
 int main(void)
 {
@@ -826,6 +2213,11 @@ int main(void)
   assert(label_foo == pt.get_feat_template("FOO"));
   assert(label_bar == pt.get_feat_template("BAR"));
 
+  unsigned int found = -1;
+  assert(pt.find_feat_template("FOO", found));
+  assert(found == label_foo);
+  assert(not pt.find_feat_template("BAZ", found));
+
   assert(pt.get_unstruct(pt.get_feat_template("FOO"), 0) == 0);
   pt.update_unstruct(pt.get_feat_template("FOO"), 0, 1);
   assert(pt.get_unstruct(pt.get_feat_template("FOO"), 0) == 1);
@@ -874,6 +2266,397 @@ int main(void)
   pt_copy.set_label_extractor(le);
   assert(pt_copy == pt);
 
+  pt_copy.compile();
+  assert(pt_copy.is_compiled());
+  assert(pt_copy.get_unstruct(pt.get_feat_template("FOO"), 0) == 2);
+  assert(pt_copy.get_unstruct(pt.get_feat_template("FOO"), 1) == 3);
+  assert(pt_copy.get_unstruct(pt.get_feat_template("FOO"), 2) == 0);
+  assert(pt_copy.get_unstruct(pt.get_feat_template("BAR"), 0) == 2);
+  assert(pt_copy.get_unstruct(1000, 0) == 0);
+  pt_copy.update_unstruct(pt.get_feat_template("BAR"), 0, 1);
+  assert(not pt_copy.is_compiled());
+  assert(pt_copy.get_unstruct(pt.get_feat_template("BAR"), 0) == 3);
+
+  LabelExtractor sub_le;
+  static_cast<void>(sub_le.get_label("A|B"));
+  static_cast<void>(sub_le.get_label("A|C"));
+  static_cast<void>(sub_le.get_label("D"));
+
+  ParamTable sub_pt;
+  sub_pt.set_label_extractor(sub_le);
+
+  unsigned int sub_label_count = sub_le.label_count();
+
+  for (unsigned int i = 0; i < sub_label_count; ++i)
+    {
+      sub_pt.update_struct1(i, i + 1, SECOND);
+      
+      for (unsigned int j = 0; j < sub_label_count; ++j)
+	{
+	  sub_pt.update_struct2(i, j, i * j + 1, SECOND);
+
+	  for (unsigned int k = 0; k < sub_label_count; ++k)
+	    { sub_pt.update_struct3(i, j, k, i + j * k + 1, SECOND); }
+	}
+    }
+
+  std::vector<float> scores;
+
+  for (unsigned int i = 0; i < sub_label_count; ++i)
+    {
+      for (unsigned int j = 0; j < sub_label_count; ++j)
+	{
+	  for (unsigned int k = 0; k < sub_label_count; ++k)
+	    { scores.push_back(sub_pt.get_all_struct_fw(i, j, k, SECOND, SECOND)); }
+	}
+    }
+
+  sub_pt.compile_struct(SECOND, SECOND);
+
+  for (unsigned int i = 0; i < sub_label_count; ++i)
+    {
+      for (unsigned int j = 0; j < sub_label_count; ++j)
+	{
+	  for (unsigned int k = 0; k < sub_label_count; ++k)
+	    {
+	      float score = scores[(i * sub_label_count + j) * sub_label_count + k];
+	      assert(sub_pt.get_all_struct_fw(i, j, k, SECOND, SECOND) == score);
+	      assert(sub_pt.get_all_struct_bw(i, j, k, SECOND, SECOND) == score);
+	    }
+	}
+    }
+
+  sub_pt.update_struct1(0, 1, SECOND);
+  assert(sub_pt.get_all_struct_fw(0, 0, 0, SECOND, SECOND) == scores[0] + 1);
+
+  for (int q = FP16; q <= INT8; ++q)
+    {
+      Quantization quantization = static_cast<Quantization>(q);
+
+      ParamTable qpt;
+      qpt.set_label_extractor(le);
+      qpt.update_unstruct(qpt.get_feat_template("FOO"), 0, 100);
+      qpt.update_unstruct(qpt.get_feat_template("FOO"), 1, -0.5);
+      qpt.update_unstruct(qpt.get_feat_template("BAR"), 0, 0.25);
+      qpt.update_struct1(0, 1.5, NODEG);
+      qpt.set_quantization(quantization);
+
+      std::ostringstream qpt_out;
+      qpt.store(qpt_out);
+      std::istringstream qpt_in(qpt_out.str());
+      ParamTable qpt_copy;
+      qpt_copy.set_quantization(quantization);
+      qpt_copy.load(qpt_in, false);
+      qpt_copy.set_label_extractor(le);
+
+      unsigned int foo = qpt.get_feat_template("FOO");
+      unsigned int bar = qpt.get_feat_template("BAR");
+
+      assert(fabs(qpt_copy.get_unstruct(foo, 0) - 100) < 0.001);
+      assert(fabs(qpt_copy.get_unstruct(foo, 1) + 0.5) < 0.5);
+      assert(fabs(qpt_copy.get_unstruct(bar, 0) - 0.25) < 0.001);
+      assert(qpt_copy.get_struct1(0, NODEG) == 1.5);
+
+      float foo_1 = qpt_copy.get_unstruct(foo, 1);
+
+      qpt_copy.compile();
+      assert(fabs(qpt_copy.get_unstruct(foo, 0) - 100) < 0.001);
+      assert(fabs(qpt_copy.get_unstruct(foo, 1) - foo_1) < 0.001);
+      assert(fabs(qpt_copy.get_unstruct(bar, 0) - 0.25) < 0.001);
+      assert(qpt_copy.get_unstruct(bar, 1) == 0);
+
+      std::ostringstream qpt_copy_out;
+      qpt_copy.store(qpt_copy_out);
+      assert(qpt_copy_out.str().size() == qpt_out.str().size());
+
+      // Mapped models use the codes in place and give the same
+      // parameters as the compiled rows.
+      std::ostringstream qpt_mapped_out;
+      qpt_copy.store_mapped(qpt_mapped_out);
+      std::string qpt_mapped_str = qpt_mapped_out.str();
+      std::vector<long> qpt_mapped_data(qpt_mapped_str.size() / sizeof(long));
+      memcpy(qpt_mapped_data.data(), 
+	     qpt_mapped_str.data(), 
+	     qpt_mapped_str.size());
+      const char * qpt_mapped = 
+	reinterpret_cast<const char *>(qpt_mapped_data.data());
+
+      ParamTable qpt_mapped_copy;
+      qpt_mapped_copy.set_quantization(quantization);
+      qpt_mapped_copy.load_mapped(qpt_mapped, qpt_mapped_str.size());
+      qpt_mapped_copy.set_label_extractor(le);
+
+      assert(qpt_mapped_copy.is_compiled());
+      assert(qpt_mapped_copy.get_unstruct(foo, 0) == 
+	     qpt_copy.get_unstruct(foo, 0));
+      assert(qpt_mapped_copy.get_unstruct(foo, 1) == foo_1);
+      assert(qpt_mapped_copy.get_unstruct(bar, 0) == 
+	     qpt_copy.get_unstruct(bar, 0));
+      assert(qpt_mapped_copy.get_unstruct(bar, 1) == 0);
+      assert(qpt_mapped_copy.get_struct1(0, NODEG) == 1.5);
+
+      for (size_t size = 0; size < qpt_mapped_str.size(); size += 8)
+	{
+	  try
+	    {
+	      ParamTable truncated_pt;
+	      truncated_pt.set_quantization(quantization);
+	      truncated_pt.load_mapped(qpt_mapped, size);
+	      assert(false);
+	    }
+	  catch (const BadBinary &e)
+	    {}
+	}
+
+      qpt_mapped_copy.update_unstruct(bar, 0, 1);
+      assert(fabs(qpt_mapped_copy.get_unstruct(foo, 1) - foo_1) < 0.001);
+      assert(fabs(qpt_mapped_copy.get_unstruct(bar, 0) - 1.25) < 0.001);
+
+      qpt_copy.update_unstruct(bar, 0, 1);
+      assert(not qpt_copy.is_compiled());
+      assert(fabs(qpt_copy.get_unstruct(foo, 1) - foo_1) < 0.001);
+      assert(fabs(qpt_copy.get_unstruct(bar, 0) - 1.25) < 0.001);
+    }
+
+  ParamTable hpt;
+  hpt.set_feature_hash_buckets(16);
+
+  unsigned int hashed_foo = hpt.get_feat_template("FOO");
+  assert(hashed_foo < 16);
+  assert(hashed_foo == hpt.get_feat_template("FOO"));
+
+  // The 64-bit FNV-1a of "FOO" is 17521383103152487767.
+  assert(hashed_foo == 7);
+  assert(hpt.find_feat_template("FOO", found));
+  assert(found == hashed_foo);
+
+  StringVector feat_strings;
+  feat_strings.push_back("FOO");
+  feat_strings.push_back("UNSEEN");
+  hpt.set_trained();
+  assert(hpt.get_feat_templates(feat_strings).size() == 2);
+  assert(hpt.get_feat_templates(feat_strings)[0] == hashed_foo);
+
+  std::ostringstream hpt_out;
+  hpt.store(hpt_out);
+  std::istringstream hpt_in(hpt_out.str());
+  ParamTable hpt_copy;
+  hpt_copy.load(hpt_in, false);
+  hpt_copy.set_feature_hash_buckets(16);
+  assert(hpt_copy.get_feat_template("FOO") == hashed_foo);
+
+  // Updates with a nonzero sigma shrink the updated parameter.
+  ParamTable spt;
+  spt.set_label_extractor(le);
+  unsigned int rfoo = spt.get_feat_template("FOO");
+  spt.update_unstruct(rfoo, 0, 2);
+  spt.update_unstruct(rfoo, 0, 2, 0.5);
+  spt.update_struct1(0, 1, NODEG, 0.5);
+  assert(spt.get_unstruct(rfoo, 0) == 2);
+  assert(spt.get_struct1(0, NODEG) == 0.5);
+  spt.update_struct1(0, 1, NODEG, 0.5);
+  assert(spt.get_struct1(0, NODEG) == 0.75);
+
+  // L2 regularization shrinks the unstructured parameters of the
+  // feature templates of a word and a candidate label, and lazily the
+  // structured parameters of the label.
+  ParamTable l2pt;
+  l2pt.set_label_extractor(le);
+  assert(l2pt.get_feat_template("FOO") == rfoo);
+  unsigned int rbar = l2pt.get_feat_template("BAR");
+  l2pt.update_unstruct(rfoo, 0, 4);
+  l2pt.update_unstruct(rfoo, 1, 4);
+  l2pt.update_unstruct(rbar, 0, 4);
+  l2pt.update_struct1(0, 4, NODEG);
+
+  FeatureTemplateVector foo_templates(1, rfoo);
+  Word foo_word("foo", foo_templates, LabelVector(1, 0), "");
+  l2pt.regularize_l2_unstruct(foo_word, 0, 0.5, NODEG);
+  l2pt.regularize_l2_struct(0, 0.5, NODEG);
+  l2pt.regularize_l2_struct(0, 0.5, NODEG);
+  assert(l2pt.get_unstruct(rfoo, 0) == 2);
+  assert(l2pt.get_unstruct(rfoo, 1) == 4);
+  assert(l2pt.get_unstruct(rbar, 0) == 4);
+  assert(l2pt.get_struct1(0, NODEG) == 1);
+
+  // Missing parameters are not added.
+  l2pt.regularize_l2_unstruct(foo_word, 2, 0.5, NODEG);
+  unsigned int unstruct_count = 0;
+  for (ParamMap::iterator it = l2pt.get_unstruct_begin();
+       it != l2pt.get_unstruct_end();
+       ++it)
+    { ++unstruct_count; }
+  assert(unstruct_count == 3);
+
+  l2pt.update_unstruct(rfoo, 0, 1);
+  l2pt.update_unstruct(rfoo, 1, 1);
+  assert(l2pt.get_unstruct(rfoo, 0) == 3);
+  assert(l2pt.get_unstruct(rfoo, 1) == 5);
+
+  ParamTable l2pt_copy;
+  l2pt_copy.set_params(l2pt);
+  l2pt_copy.set_label_extractor(le);
+  assert(l2pt_copy.get_struct1(0, NODEG) == 1);
+
+  l2pt.apply_l2_scales();
+  assert(l2pt.get_unstruct(rfoo, 0) == 3);
+  assert(l2pt.get_struct1(0, NODEG) == 1);
+  assert(l2pt == l2pt_copy);
+
+  ParamTable apt;
+  apt.set_label_extractor(le);
+  apt.set_averaging(1);
+  apt.set_time(1);
+  apt.update_unstruct(rfoo, 0, 1);
+  apt.update_struct1(0, 1, NODEG);
+  apt.set_time(2);
+  apt.set_time(3);
+  apt.update_unstruct(rfoo, 0, -1);
+
+  // Sums over times 1, 2 and 3 are 1 + 1 + 0 and 1 + 1 + 1.
+  apt.set_averaged_reads(1);
+  assert(apt.get_unstruct(rfoo, 0) == 2);
+  assert(apt.get_struct1(0, NODEG) == 3);
+  apt.compile();
+  assert(not apt.is_compiled());
+  apt.set_averaged_reads(0);
+  assert(apt.get_unstruct(rfoo, 0) == 0);
+
+  ParamTable avg_pt;
+  avg_pt.update_struct1(1, 1, NODEG);
+  avg_pt.set_averaged_params(apt);
+  avg_pt.set_label_extractor(le);
+  assert(avg_pt.get_unstruct(rfoo, 0) == 2);
+  assert(avg_pt.get_struct1(0, NODEG) == 3);
+  assert(avg_pt.get_struct1(1, NODEG) == 0);
+  assert(apt.get_unstruct(rfoo, 0) == 0);
+
+  // operator= also copies the running sums.
+  ParamTable apt_copy;
+  apt_copy = apt;
+  apt_copy.set_label_extractor(le);
+  apt_copy.set_time(4);
+  apt_copy.update_struct1(0, 1, NODEG);
+  avg_pt.set_averaged_params(apt_copy);
+  assert(avg_pt.get_struct1(0, NODEG) == 5);
+  assert(avg_pt.get_unstruct(rfoo, 0) == 2);
+
+  ParamTable params_pt;
+  params_pt.set_params(apt_copy);
+  params_pt.set_label_extractor(le);
+  assert(params_pt.get_struct1(0, NODEG) == 2);
+  params_pt.set_averaged_reads(1);
+  assert(params_pt.get_struct1(0, NODEG) == 10);
+
+  ParamTable cpt;
+  cpt.set_label_extractor(le);
+  cpt.update_struct1(0, 1, NODEG);
+  cpt.set_concurrent(1);
+  assert(cpt.is_concurrent());
+  assert(cpt.get_struct1(0, NODEG) == 1);
+  cpt.update_unstruct(rfoo, 0, 2);
+  cpt.update_struct2(0, 0, 3, NODEG);
+  assert(cpt.get_unstruct(rfoo, 0) == 2);
+  assert(cpt.get_struct2(0, 0, NODEG) == 3);
+  cpt.update_unstruct(rfoo, 0, 0, 0.5);
+  assert(cpt.get_unstruct(rfoo, 0) == 1);
+
+  ParamTable cpt_copy;
+  cpt_copy = cpt;
+  cpt_copy.set_label_extractor(le);
+  assert(not cpt_copy.is_concurrent());
+  assert(cpt_copy.get_struct2(0, 0, NODEG) == 3);
+
+  cpt.set_concurrent(0);
+  assert(cpt.get_unstruct(rfoo, 0) == 1);
+  assert(cpt.get_struct1(0, NODEG) == 1);
+
+  cpt.set_concurrent(1);
+  cpt.update_struct1(0, 1.5, NODEG, 0.5);
+  assert(cpt.get_struct1(0, NODEG) == 1.25);
+  cpt.set_concurrent(0);
+  assert(cpt.get_struct1(0, NODEG) == 1.25);
+
+  ParamTable lpt;
+  lpt.set_label_extractor(le);
+  lpt.update_unstruct(rfoo, 0, 1);
+  lpt.update_unstruct(rfoo, 1, -3);
+  lpt.regularize_l1(2);
+  lpt.update_unstruct(rfoo, 0, 0.5);
+  lpt.update_unstruct(rfoo, 1, 0);
+  assert(lpt.get_unstruct(rfoo, 0) == 0);
+  assert(lpt.get_unstruct(rfoo, 1) == -1);
+
+  // The parameter has received the whole penalty of 2.
+  lpt.update_unstruct(rfoo, 1, -1);
+  assert(lpt.get_unstruct(rfoo, 1) == -2);
+  lpt.regularize_l1(0.5);
+  lpt.update_unstruct(rfoo, 1, 0);
+  assert(lpt.get_unstruct(rfoo, 1) == -1.5);
+
+  // Zero parameters are not stored.
+  std::ostringstream lpt_out;
+  lpt.store(lpt_out);
+  std::istringstream lpt_in(lpt_out.str());
+  ParamTable lpt_copy;
+  lpt_copy.load(lpt_in, false);
+  lpt_copy.set_label_extractor(le);
+  assert(lpt_copy.get_unstruct_end() != lpt_copy.get_unstruct_begin());
+  assert(++lpt_copy.get_unstruct_begin() == lpt_copy.get_unstruct_end());
+  assert(lpt_copy == lpt);
+
+  lpt.remove_zero_params();
+  assert(++lpt.get_unstruct_begin() == lpt.get_unstruct_end());
+
+  // Erasing zero parameters does not change training.
+  ParamTable pruned_pt;
+  ParamTable unpruned_pt;
+  ParamTable * l1_pts[] = { &pruned_pt, &unpruned_pt };
+
+  for (unsigned int i = 0; i < 2; ++i)
+    {
+      l1_pts[i]->set_label_extractor(le);
+      l1_pts[i]->update_unstruct(rfoo, 0, 1);
+      l1_pts[i]->regularize_l1(1.5);
+      l1_pts[i]->update_unstruct(rfoo, 0, 0);
+      assert(l1_pts[i]->get_unstruct(rfoo, 0) == 0);
+    }
+
+  pruned_pt.remove_zero_params();
+  assert(pruned_pt.get_unstruct_begin() == pruned_pt.get_unstruct_end());
+
+  for (unsigned int i = 0; i < 2; ++i)
+    {
+      l1_pts[i]->regularize_l1(0.1);
+      l1_pts[i]->update_unstruct(rfoo, 0, 1);
+      assert(fabs(l1_pts[i]->get_unstruct(rfoo, 0) - 0.4) < 0.0001);
+    }
+
+  // A truncated mapped parameter section is rejected.
+  std::ostringstream mapped_out;
+  lpt.store_mapped(mapped_out);
+  std::string mapped_str = mapped_out.str();
+  std::vector<long> mapped_data(mapped_str.size() / sizeof(long) + 1);
+  memcpy(mapped_data.data(), mapped_str.data(), mapped_str.size());
+  const char * mapped = reinterpret_cast<const char *>(mapped_data.data());
+
+  ParamTable mpt;
+  mpt.load_mapped(mapped, mapped_str.size());
+  mpt.set_label_extractor(le);
+  assert(mpt.get_unstruct(rfoo, 1) == -1.5);
+
+  for (size_t size = 0; size < mapped_str.size(); ++size)
+    {
+      try
+	{
+	  ParamTable truncated_pt;
+	  truncated_pt.load_mapped(mapped, size);
+	  assert(false);
+	}
+      catch (const BadBinary &e)
+	{}
+    }
+
   std::cout << pt << std::endl;
 }
 
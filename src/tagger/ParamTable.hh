@@ -28,6 +28,11 @@
 #include <vector>
 #include <string>
 #include "TaggerOptions.hh"
+#include "ParamMap.hh"
+#include "ConcurrentParamMap.hh"
+#include "MappedVector.hh"
+
+#include <memory>
 
 #include "io.hh"
 
@@ -35,11 +40,23 @@ typedef std::vector<unsigned int> FeatureTemplateVector;
 
 const long MAX_LABEL = 50000;
 
+// Labels of compiled unstructured parameters are stored in 2 bytes.
+static_assert(MAX_LABEL <= 0xffff, "MAX_LABEL does not fit in 2 bytes.");
+
+// Upper bound on the number of entries in the dense label pair
+// tables built by ParamTable::compile_struct.
+const long MAX_COMPILED_STRUCT_SIZE = 1 << 25;
+
+// Folded trigram rows may take up to this many floats per structured
+// parameter of the model, or one row per label if that is more.
+const long STRUCT3_FLOATS_PER_PARAM = 8;
+
+// Marks a label pair without a folded trigram row.
+const unsigned int NO_STRUCT3_ROW = -1;
+
 class Word;
 class LabelExtractor;
 
-typedef std::unordered_map<long, float> ParamMap;
-
 class ParamTable
 {
 public:
@@ -48,6 +65,11 @@ public:
   ParamTable &operator=(const ParamTable &another);
 
   unsigned int get_feat_template(const std::string &feat_template_string);
+
+  // Store the id of @p feat_template_string in @p feat_template and
+  // return true, or return false if the model has no such feature.
+  bool find_feat_template(const std::string &feat_template_string,
+			  unsigned int &feat_template) const;
   FeatureTemplateVector get_feat_templates(StringVector &feat_template_strings);
 
   float get_unstruct(unsigned int feature_template, unsigned int label) const;
@@ -59,19 +81,94 @@ public:
   float get_all_struct_bw(unsigned int pplabel, unsigned int plabel, unsigned int label, Degree sublabel_order, Degree model_order) const;
   float get_all_unstruct(const Word &word, unsigned int label, Degree sublabel_order) const;
 
+  // Versions of get_all_struct_fw and get_all_unstruct for the
+  // decoder, which are specialized on the model order and on whether
+  // sub labels are used (sublabel_order > NODEG), so the inner loops
+  // of the decoder do not test them. get_compiled_struct_fw requires
+  // is_struct_compiled(sublabel_order, MODEL_ORDER) for the sub label
+  // order it replaces. get_compiled_all_unstruct requires
+  // is_compiled().
+  template <Degree MODEL_ORDER>
+  float get_compiled_struct_fw(unsigned int pplabel, unsigned int plabel, unsigned int label) const;
+  template <bool SUBLABELS>
+  float get_compiled_all_unstruct(const Word &word, unsigned int label) const;
+
   void update_all_struct_fw(unsigned int pplabel, unsigned int plabel, unsigned int label, float update, Degree sublabel_order, Degree model_order);
   void update_all_struct_bw(unsigned int pplabel, unsigned int plabel, unsigned int label, float update, Degree sublabel_order, Degree model_order);
-  void update_all_unstruct(const Word &word, unsigned int label, float update, Degree sublabel_order);
+  // With a nonzero @p sigma, each updated parameter is also
+  // multiplied by 1 - @p sigma after the update (eager L2
+  // regularization of the active parameters). The shrinkage counts as
+  // an update of its own for update count filtering.
+  void update_all_unstruct(const Word &word, unsigned int label, float update, Degree sublabel_order, float sigma = 0);
+
+  void update_unstruct(unsigned int feature_template, unsigned int label, float ud, float sigma = 0);
+  void update_struct1(unsigned int label, float ud, Degree sublabel_order, float sigma = 0);
+  void update_struct2(unsigned int plabel, unsigned int label, float ud, Degree sublabel_order, float sigma = 0);
+  void update_struct3(unsigned int pplabel, unsigned int plabel, unsigned int label, float ud, Degree sublabel_order, float sigma = 0);
+
+  // Cumulative penalty L1 regularization (Tsuruoka et al. 2009). Add
+  // @p penalty to the total penalty. Each parameter receives the part
+  // of the total penalty it has not yet received when it is next
+  // updated, and is clipped at zero. Not for concurrent mode.
+  void regularize_l1(float penalty);
 
-  void update_unstruct(unsigned int feature_template, unsigned int label, float ud);
-  void update_struct1(unsigned int label, float ud, Degree sublabel_order);
-  void update_struct2(unsigned int plabel, unsigned int label, float ud, Degree sublabel_order);
-  void update_struct3(unsigned int pplabel, unsigned int plabel, unsigned int label, float ud, Degree sublabel_order);
+  // Give every parameter the part of the total L1 penalty it has not
+  // yet received. remove_zero_params does this first and set_params
+  // copies the penalized values.
+  void apply_l1_penalties(void);
 
-  void regularize_all_unstruct(const Word &word, unsigned int label, float sigma, Degree sublabel_order);
-  void regularize_struct1(unsigned int label, float sigma, Degree sublabel_order);
-  void regularize_struct2(unsigned int plabel, unsigned int label, float sigma, Degree sublabel_order);
-  void regularize_struct3(unsigned int pplabel, unsigned int plabel, unsigned int label, float sigma, Degree sublabel_order);
+  // L2 regularization of candidate label @p label. 
+  // regularize_l2_unstruct multiplies the unstructured parameters of
+  // the feature templates of @p word and @p label or one of its sub
+  // labels by 1 - @p sigma. It only changes parameters that exist.
+  // regularize_l2_struct does the same lazily to the structured
+  // parameters whose last label is @p label or one of its sub labels:
+  // the factors are kept per label and applied when a parameter is
+  // read or updated, so the cost does not depend on the number of
+  // label n-grams. Not for concurrent mode.
+  void regularize_l2_unstruct(const Word &word, unsigned int label, float sigma, Degree sublabel_order);
+  void regularize_l2_struct(unsigned int label, float sigma, Degree sublabel_order);
+
+  // Multiply the parameters by their pending L2 factors. store,
+  // store_mapped, operator== and operator<< need this first.
+  // Functions that compile, copy or erase parameters do it
+  // themselves.
+  void apply_l2_scales(void);
+
+  // Erase the parameters that are zero. Their received L1 penalties
+  // are kept.
+  void remove_zero_params(void);
+
+  // Averaged perceptron training. While averaging is on, an update ud
+  // at time t also adds -t * ud to the running sum of the parameter,
+  // so (t + 1) * w + sum is the sum of the values of w at times
+  // 1, ..., t.
+  void set_averaging(bool averaging);
+  void set_time(float time);
+
+  // While averaged reads are on, get_unstruct, get_struct1, ... return
+  // the summed parameters (time + 1) * w + sum instead of w, so an
+  // averaging table can be evaluated without building a copy of the
+  // averages. The table is not compiled meanwhile.
+  void set_averaged_reads(bool averaged_reads);
+
+  // operator= copies everything, including the running sums and the
+  // received L1 penalties. set_params and set_averaged_params leave
+  // those out and copy only what a trained model needs: the
+  // parameters of @p another or its summed parameters. Both write
+  // into this table directly.
+  void set_params(const ParamTable &another);
+  void set_averaged_params(const ParamTable &another);
+
+  // In concurrent mode the parameters are kept in ConcurrentParamMaps
+  // and several threads may call the get_* and update_* functions at
+  // the same time. Update counts are not kept. Other functions may
+  // only be called while no thread is reading or updating, and
+  // functions that iterate over the parameters (compile, store,
+  // set_averaged_params, ...) only after leaving concurrent mode.
+  // Copies of a table are never in concurrent mode.
+  void set_concurrent(bool concurrent);
+  bool is_concurrent(void) const;
 
   ParamMap::iterator get_unstruct_begin(void);
   ParamMap::iterator get_struct_begin(void);
@@ -79,9 +176,23 @@ public:
   ParamMap::iterator get_struct_end(void);
 
   void set_trained(void);
+  void compile(void);
+  void compile_struct(Degree sublabel_order, Degree model_order);
+  bool is_compiled(void) const;
+  bool is_struct_compiled(void) const;
+
+  // True if the structured scores are compiled for @p sublabel_order
+  // and a model order of at least @p model_order. The unigram and
+  // bigram tables of a higher order model also give the scores of the
+  // lower order models.
+  bool is_struct_compiled(Degree sublabel_order, Degree model_order) const;
   void set_param_filter(const TaggerOptions &options);
+  void set_quantization(Quantization quantization);
+  void set_feature_hash_buckets(unsigned int buckets);
   void store(std::ostream &out) const;
   void load(std::istream &in, bool reverse_bytes);
+  void store_mapped(std::ostream &out) const;
+  void load_mapped(const char * data, size_t size);
   bool operator==(const ParamTable &another) const;
 
   void set_label_extractor(const LabelExtractor &label_extractor);
@@ -101,14 +212,91 @@ private:
   const LabelExtractor * label_extractor;
   bool trained;
   FeatureTemplateMap feature_template_map;
+
+  // If nonzero, feature template strings are hashed directly into
+  // this many buckets and feature_template_map is not used.
+  unsigned int feature_hash_buckets;
+
   ParamMap unstruct_param_table;
   ParamMap struct_param_table;
 
+  // Running sums of the averaged perceptron (see set_averaging).
+  bool averaging;
+  bool averaged_reads;
+  float time;
+  ParamMap unstruct_sum_table;
+  ParamMap struct_sum_table;
+
+  // Total L1 penalty and the signed penalties already received by
+  // the parameters (see regularize_l1). The total grows by a small
+  // penalty at every token, so it needs double precision.
+  double l1_penalty;
+  ParamMap unstruct_l1_table;
+  ParamMap struct_l1_table;
+
+  // Pending lazy L2 factors (see regularize_l2_struct) of the
+  // structured parameters indexed by their last label. Stored
+  // parameters times their factor give the parameter values. Empty if
+  // there are none.
+  std::vector<double> struct_l2_scales;
+
+  // Parameters and running sums in concurrent mode. The maps above
+  // are empty while these are in use.
+  bool concurrent;
+  std::shared_ptr<ConcurrentParamMap> concurrent_unstruct_table;
+  std::shared_ptr<ConcurrentParamMap> concurrent_struct_table;
+
+  enum ParamType { UNSTRUCT_PARAM, STRUCT_PARAM };
+
+  // Read-only CSR layout of unstruct_param_table built by
+  // compile(). Row t holds the nonzero weights of feature template t
+  // sorted by label: labels and weights
+  // [unstruct_rows[t], unstruct_rows[t + 1]). compile() releases
+  // unstruct_param_table, which is rebuilt from the rows when it is
+  // updated, stored or iterated.
+  bool compiled;
+  MappedVector<unsigned int> unstruct_rows;
+  MappedVector<unsigned short> unstruct_labels;
+  MappedVector<float> unstruct_weights;
+
+  // With quantization, stored models hold int8 or fp16 codes of the
+  // unstructured parameters and every feature template has its own
+  // scale. compile() keeps the codes instead of unstruct_weights.
+  // Mapped models hold the rows, labels, scales and codes, which
+  // load_mapped() uses in place.
+  Quantization quantization;
+  Quantization compiled_quantization;
+  bool unstruct_released;
+  MappedVector<float> unstruct_scales;
+  MappedVector<signed char> unstruct_int8_weights;
+  MappedVector<unsigned short> unstruct_fp16_weights;
+
+  // Structured scores with sub label contributions folded in, built by
+  // compile_struct() for one (sublabel_order, model_order)
+  // combination. struct1_scores and struct2_scores are dense over
+  // labels. struct3_rows is dense over label pairs too and gives the
+  // offset of the row of (pplabel, plabel) in struct3_scores or
+  // NO_STRUCT3_ROW. A row holds the complete transition score
+  // (trigram + bigram + unigram) for every label. If
+  // struct3_full_labels is not empty, it marks the full labels and
+  // every pair of full labels with trigram weights has a row, so the
+  // other such pairs have no trigram score.
+  bool struct_compiled;
+  Degree compiled_sublabel_order;
+  Degree compiled_model_order;
+  unsigned int compiled_label_count;
+  std::vector<float> struct1_scores;
+  std::vector<float> struct2_scores;
+  std::vector<unsigned int> struct3_rows;
+  std::vector<float> struct3_scores;
+  std::vector<char> struct3_full_labels;
+
   float update_threshold;
   float avg_mass_threshold;
   Filtering filter_type;
   int train_iters;
 
+  unsigned int get_hashed_feat_template(const std::string &feat_template_string) const;
   long get_unstruct_param_id(unsigned int feature_template, unsigned int label) const;
   long get_struct_param_id(unsigned int label) const;
   long get_struct_param_id(unsigned int plabel, unsigned int label) const;
@@ -119,10 +307,93 @@ private:
   std::string get_struct_feat_repr(long feat_id) const;
 
   float get_filtered_param(long param_id, float param) const;
+  ParamMap get_stored_map(const ParamMap &m) const;
+  const ParamMap &get_sparse_map(const ParamMap &m, ParamMap &buffer) const;
+
+  float get_compiled_unstruct(unsigned int row,
+			      unsigned int row_begin,
+			      unsigned int row_end,
+			      unsigned int label) const;
+  float get_compiled_weight(unsigned int row, unsigned int i) const;
+  const ParamMap &get_unstruct_map(ParamMap &buffer) const;
+  void restore_unstruct_map(void);
+  void write_quantized_unstruct(std::ostream &out, const ParamMap &m) const;
+  void load_mapped_rows(const char * data, const char * data_end);
+  void read_quantized_unstruct(std::istream &in, bool reverse_bytes);
+  float get_compiled_struct(unsigned int pplabel, unsigned int plabel, unsigned int label) const;
+  template <Degree MODEL_ORDER>
+  float get_folded_struct(unsigned int pplabel, unsigned int plabel, unsigned int label) const;
+  void clear_compiled(void);
+
+  // Copy everything but the parameters, the running sums and the
+  // received L1 penalties of @p another.
+  void copy_settings(const ParamTable &another);
+  void copy_params(const ParamTable &another, bool averaged);
+  void update_param(ParamType type, long id, float ud, float sigma);
+  void apply_l1_penalty(float &param, float &received_penalty) const;
+  void apply_l1_penalties(ParamMap &params, ParamMap &received_penalties);
+
+  // Apply the pending L1 penalties of this table to @p params, which
+  // are copies of its parameters with the L2 factors applied.
+  void copy_l1_penalties(ParamMap &params, 
+			 const ParamMap &received_penalties) const;
+  double get_l2_scale(ParamType type, long id) const;
+  void scale_l2(unsigned int label, float sigma);
+  void shrink_unstruct(const Word &word, unsigned int label, float sigma);
+  float get_param(ParamType type, long id) const;
 
   friend std::ostream &operator<<(std::ostream &out, const ParamTable &table);
 };
 
 std::ostream &operator<<(std::ostream &out, const ParamTable &table);
 
+// The structured score of a model of order MODEL_ORDER from the
+// tables built by compile_struct. The labels have to be in range.
+template <Degree MODEL_ORDER>
+inline float ParamTable::get_folded_struct(unsigned int pplabel, 
+					   unsigned int plabel, 
+					   unsigned int label) const
+{
+  if (MODEL_ORDER > FIRST and not struct3_rows.empty())
+    {
+      unsigned int offset = 
+	struct3_rows[pplabel * compiled_label_count + plabel];
+
+      if (offset != NO_STRUCT3_ROW)
+	{ return struct3_scores[offset + label]; }
+    }
+
+  float res = struct1_scores[label];
+
+  if (MODEL_ORDER > ZEROTH)
+    {
+      res += 
+	(struct2_scores.empty() ? 
+	 get_struct2(plabel, label, compiled_sublabel_order) :
+	 struct2_scores[plabel * compiled_label_count + label]);
+    }
+
+  if (MODEL_ORDER > FIRST and 
+      (struct3_full_labels.empty() or 
+       not struct3_full_labels[pplabel] or 
+       not struct3_full_labels[plabel]))
+    { res += get_struct3(pplabel, plabel, label, compiled_sublabel_order); }
+
+  return res;
+}
+
+template <Degree MODEL_ORDER>
+inline float ParamTable::get_compiled_struct_fw(unsigned int pplabel, 
+						unsigned int plabel, 
+						unsigned int label) const
+{
+  if (pplabel < compiled_label_count and 
+      plabel < compiled_label_count and 
+      label < compiled_label_count)
+    { return get_folded_struct<MODEL_ORDER>(pplabel, plabel, label); }
+
+  return get_all_struct_fw(pplabel, plabel, label, 
+			   compiled_sublabel_order, MODEL_ORDER);
+}
+
 #endif // HEADER_ParamTable_hh
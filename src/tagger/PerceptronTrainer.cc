@@ -24,6 +24,8 @@
 #ifndef TEST_PerceptronTrainer_cc
 
 #include <cassert>
+#include <algorithm>
+#include <thread>
 
 #include "Trellis.hh"
 
@@ -47,10 +49,8 @@ PerceptronTrainer::PerceptronTrainer(unsigned int max_passes,
 {
   pt.set_param_filter(options);
   pos_params = pt;
-  neg_params = pt;
-
+  pos_params.set_averaging(1);
   pos_params.set_label_extractor(label_extractor);
-  neg_params.set_label_extractor(label_extractor);
 }
 
 void PerceptronTrainer::train(const Data &train_data, 
@@ -89,10 +89,6 @@ void PerceptronTrainer::train(const Data &train_data,
     }
 
   float best_dev_acc = -1;
-  ParamTable best_params;
-  best_params.set_param_filter(options);
-  best_params.set_label_extractor(label_extractor);
-
   unsigned int useless_passes = 0;
 
   for (unsigned int i = 0; i < max_passes; ++i)
@@ -103,27 +99,33 @@ void PerceptronTrainer::train(const Data &train_data,
       msg_out << "  Train pass " << i + 1 << std::endl;
 
       // Train pass.
-      for (unsigned int j = 0; j < train_trellises.size(); ++j)
+      if (train_threads > 1)
+	{ concurrent_train_pass(train_trellises, train_data, train_data_copy); }
+      else
 	{
-	  train_trellises[j]->set_maximum_a_posteriori_assignment
-	    (pos_params);
-
-	  update(train_data.at(j), train_data_copy.at(j));
-	  
-	  std::cerr << j << " of " << train_trellises.size() - 1 << "\r";
+	  for (unsigned int j = 0; j < train_trellises.size(); ++j)
+	    {
+	      train_trellises[j]->set_maximum_a_posteriori_assignment
+		(pos_params);
+	      
+	      update(train_data.at(j), train_data_copy.at(j));
+	      
+	      std::cerr << j << " of " << train_trellises.size() - 1 << "\r";
+	    }
 	}
 
       std::cerr << std::endl;
 
-      // Average.
-      set_avg_params();
+      // Tag dev data using the averaged parameters.
+      pos_params.set_averaged_reads(1);
 
-      // Tag dev data.
       for (unsigned int j = 0; j < dev_trellises.size(); ++j)
 	{
-	  dev_trellises[j]->set_maximum_a_posteriori_assignment(pt);
+	  dev_trellises[j]->set_maximum_a_posteriori_assignment(pos_params);
 	}
 
+      pos_params.set_averaged_reads(0);
+
       float acc = dev_data.get_acc(dev_data_copy, lemma_extractor).label_acc;
 
       msg_out << "    Dev acc: " << acc * 100.00 << "%" << std::endl;
@@ -132,7 +134,7 @@ void PerceptronTrainer::train(const Data &train_data,
 	{
 	  useless_passes = 0;
 	  best_dev_acc = acc;
-	  best_params = pt;
+	  set_avg_params();
 	}
       else
 	{
@@ -142,7 +144,6 @@ void PerceptronTrainer::train(const Data &train_data,
 
   msg_out << "  Final dev acc: " << best_dev_acc * 100.00 << "%" << std::endl;
 
-  pt = best_params;
   pt.set_label_extractor(label_extractor);
   pt.set_trained();
   pt.set_train_iters(iter);
@@ -239,7 +240,6 @@ void PerceptronTrainer::train_lemmatizer(const Data &train_data,
     }
 
   float best_dev_acc = -1;
-  ParamTable best_params;
   unsigned int useless_passes = 0;
 
   for (unsigned int i = 0; i < max_passes; ++i)
@@ -262,13 +262,12 @@ void PerceptronTrainer::train_lemmatizer(const Data &train_data,
 	  lemmatizer_update(w, sys_class, gold_class, lemma_e, label_e);
 	}
       
-      // Average.
-      set_avg_params();
-
-      // Tag dev data.
+      // Tag dev data using the averaged parameters.
       float correct = 0;
       float total = 0; 
 
+      pos_params.set_averaged_reads(1);
+
       for (unsigned int j = 0; j < dev_words.size(); ++j)
 	{
 	  Word &w = dev_words.at(j);
@@ -276,12 +275,14 @@ void PerceptronTrainer::train_lemmatizer(const Data &train_data,
 	  unsigned int gold_class = w.get_label();
 
 	  unsigned int sys_class = 
-	    lemma_e.get_lemma_candidate_class(w);
+	    lemma_e.get_lemma_candidate_class(w, &pos_params);
 
 	  correct += (sys_class == gold_class) ? 1 : 0;
 	  ++total;
 	}
 
+      pos_params.set_averaged_reads(0);
+
       float acc = (total == 0 ? 0 : correct / total);
 
       msg_out << "    Dev acc: " << acc * 100.00 << "%" << std::endl;
@@ -290,7 +291,7 @@ void PerceptronTrainer::train_lemmatizer(const Data &train_data,
 	{
 	  useless_passes = 0;
 	  best_dev_acc = acc;
-	  best_params = pt;
+	  set_avg_params();
 	}
       else
 	{
@@ -300,7 +301,6 @@ void PerceptronTrainer::train_lemmatizer(const Data &train_data,
 
   msg_out << "  Final dev acc: " << best_dev_acc * 100.0 << "%" << std::endl;
   
-  pt = best_params;
   pt.set_trained();
 }
 
@@ -308,7 +308,66 @@ void PerceptronTrainer::update(const Sentence &gold_s,
 			       const Sentence &sys_s)
 {
   ++iter;
+  pos_params.set_time(iter);
+
+  update_params(gold_s, sys_s);
+}
+
+void PerceptronTrainer::concurrent_train_pass(TrellisVector &train_trellises,
+					      const Data &gold_data,
+					      const Data &sys_data)
+{
+  pos_params.set_concurrent(1);
+
+  unsigned int round_size = train_threads * SENTENCES_PER_THREAD;
+
+  for (unsigned int begin = 0; 
+       begin < train_trellises.size(); 
+       begin += round_size)
+    {
+      unsigned int end = 
+	std::min<unsigned int>(train_trellises.size(), begin + round_size);
+
+      // All updates in a round share one time stamp.
+      iter += end - begin;
+      pos_params.set_time(iter);
+
+      std::vector<std::thread> threads;
+
+      for (unsigned int i = 0; i < train_threads; ++i)
+	{
+	  threads.push_back
+	    (std::thread(&PerceptronTrainer::train_sentences, this,
+			 &train_trellises, &gold_data, &sys_data,
+			 begin + i, end, train_threads));
+	}
 
+      for (unsigned int i = 0; i < threads.size(); ++i)
+	{ threads[i].join(); }
+
+      std::cerr << end - 1 << " of " << train_trellises.size() - 1 << "\r";
+    }
+
+  pos_params.set_concurrent(0);
+}
+
+void PerceptronTrainer::train_sentences(TrellisVector * train_trellises,
+					const Data * gold_data,
+					const Data * sys_data,
+					unsigned int begin,
+					unsigned int end,
+					unsigned int step)
+{
+  for (unsigned int j = begin; j < end; j += step)
+    {
+      (*train_trellises)[j]->set_maximum_a_posteriori_assignment(pos_params);
+      update_params(gold_data->at(j), sys_data->at(j));
+    }
+}
+
+void PerceptronTrainer::update_params(const Sentence &gold_s, 
+				      const Sentence &sys_s)
+{
   for (unsigned int i = 0; i /*<= max_violation_id*/ < sys_s.size() ; ++i)
     {
       unsigned int gold_label = gold_s.at(i).get_label();
@@ -322,25 +381,17 @@ void PerceptronTrainer::update(const Sentence &gold_s,
 
       // Unstruct params.
       //pos_params.update_all_unstruct(gold_s.at(i), gold_label, 1, use_unstruct_sub_labels);
-      //neg_params.update_all_unstruct(gold_s.at(i), gold_label, -iter, use_unstruct_sub_labels);
       pos_params.update_all_unstruct(gold_s.at(i), gold_label, 1, sublabel_order);
-      neg_params.update_all_unstruct(gold_s.at(i), gold_label, -iter, sublabel_order);
 
       //pos_params.update_all_unstruct(sys_s.at(i), sys_label, -1, use_unstruct_sub_labels);
-      //neg_params.update_all_unstruct(sys_s.at(i), sys_label, iter, use_unstruct_sub_labels);
       pos_params.update_all_unstruct(sys_s.at(i), sys_label, -1, sublabel_order);
-      neg_params.update_all_unstruct(sys_s.at(i), sys_label, iter, sublabel_order);
 
       // Struct params.
       //pos_params.update_all_struct_fw(ppgold_label, pgold_label, gold_label, 1, use_struct_sub_labels);
-      //neg_params.update_all_struct_fw(ppgold_label, pgold_label, gold_label, -iter, use_struct_sub_labels);
       pos_params.update_all_struct_fw(ppgold_label, pgold_label, gold_label, 1, sublabel_order, model_order);
-      neg_params.update_all_struct_fw(ppgold_label, pgold_label, gold_label, -iter, sublabel_order, model_order);
       
       //pos_params.update_all_struct_fw(ppsys_label, psys_label, sys_label, -1, use_struct_sub_labels);
-      //neg_params.update_all_struct_fw(ppsys_label, psys_label, sys_label, iter, use_struct_sub_labels);
       pos_params.update_all_struct_fw(ppsys_label, psys_label, sys_label, -1, sublabel_order, model_order);
-      neg_params.update_all_struct_fw(ppsys_label, psys_label, sys_label, iter, sublabel_order, model_order);
     }
 }
 
@@ -351,61 +402,21 @@ void PerceptronTrainer::lemmatizer_update(const Word &w,
 					  const LabelExtractor &label_e)
 {
   ++iter;
+  pos_params.set_time(iter);
 
   static_cast<void>(lemma_e);
   static_cast<void>(label_e);
 
   pos_params.update_all_unstruct(w, gold_class, 1, NODEG);
-  neg_params.update_all_unstruct(w, gold_class, -iter, NODEG);
-
   pos_params.update_all_unstruct(w, sys_class, -1, NODEG);
-  neg_params.update_all_unstruct(w, sys_class, iter, NODEG);
 
   //delete lemma_feature_word;
 }
 
 void PerceptronTrainer::set_avg_params(void)
 {
-  pt = pos_params;
-  
-  ParamMap::iterator pt_it = pt.get_unstruct_begin();
-  ParamMap::iterator pos_it = pos_params.get_unstruct_begin();
-  ParamMap::iterator neg_it = neg_params.get_unstruct_begin();
-
-  ParamMap::iterator pt_end = pt.get_unstruct_end();
-  ParamMap::iterator pos_end = pos_params.get_unstruct_end();
-  ParamMap::iterator neg_end = neg_params.get_unstruct_end();
-
-  while (pt_it != pt_end)
-    {
-      assert(pos_it != pos_end);
-      assert(neg_it != neg_end);
-      pt_it->second = (iter + 1) * pos_it->second + neg_it->second;      
-      ++pt_it;
-      ++pos_it;
-      ++neg_it;
-    }
-
-  pt_it = pt.get_struct_begin();
-  pos_it = pos_params.get_struct_begin();
-  neg_it = neg_params.get_struct_begin();
-
-  pt_end = pt.get_struct_end();
-  pos_end = pos_params.get_struct_end();
-  neg_end = neg_params.get_struct_end();
-
-  while (pt_it != pt_end)
-    {
-      pt_it->second = (iter + 1) * pos_it->second + neg_it->second;
-      ++pt_it;
-      ++pos_it;
-      ++neg_it;
-    }
-
+  pt.set_averaged_params(pos_params);
   pt.set_label_extractor(label_extractor);
-
-  if (options.filter_type == UPDATE_COUNT)
-    { pt.set_update_counts(pos_params); }
 }
 
 #else // TEST_PerceptronTrainer_cc
@@ -448,7 +459,7 @@ class SillyLemmaExtractor : public LemmaExtractor
 {
 public:
   std::string get_lemma_candidate(const std::string &word_form, 
-				  const std::string &label)
+				  const std::string &label) const
   { 
     static_cast<void>(word_form);
     static_cast<void>(label);
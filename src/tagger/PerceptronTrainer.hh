@@ -31,6 +31,7 @@
 #include "Data.hh"
 #include "exceptions.hh"
 #include "TaggerOptions.hh"
+#include "Trellis.hh"
 
 class PerceptronTrainer : public Trainer
 {
@@ -56,7 +57,6 @@ private:
   float iter;
 
   ParamTable pos_params;
-  ParamTable neg_params;
 
   Degree sublabel_order;
   Degree model_order;
@@ -65,6 +65,22 @@ private:
   void update(const Sentence &gold_s, 
 	      const Sentence &sys_s);
 
+  void update_params(const Sentence &gold_s, 
+		     const Sentence &sys_s);
+
+  // Hogwild training pass using train_threads threads that share
+  // pos_params.
+  void concurrent_train_pass(TrellisVector &train_trellises,
+			     const Data &gold_data,
+			     const Data &sys_data);
+
+  void train_sentences(TrellisVector * train_trellises,
+		       const Data * gold_data,
+		       const Data * sys_data,
+		       unsigned int begin,
+		       unsigned int end,
+		       unsigned int step);
+
   void lemmatizer_update(const Word &w, 
 			 unsigned int sys_class, 
 			 unsigned int gold_class,
@@ -23,10 +23,17 @@
 
 #ifndef TEST_SGDTrainer_cc
 
+#include <algorithm>
+#include <thread>
+
 
 #define STRUCT_SL 1
 #define USTRUCT_SL 1
 
+// Expected count updates below this are skipped, so improbable label
+// n-grams get no parameters.
+static const float MIN_EXPECTED_UPDATE = 1e-5;
+
 SGDTrainer::SGDTrainer(unsigned int max_passes,
 		       unsigned int max_useless_passes,
 		       ParamTable &pt,
@@ -41,6 +48,7 @@ SGDTrainer::SGDTrainer(unsigned int max_passes,
   options(options),
   delta(options.delta),
   sigma(options.sigma),
+  l1_token_penalty(options.delta * options.sigma),
   bw(label_extractor.get_boundary_label())
 {
   std::cerr << delta << std::endl;
@@ -57,6 +65,14 @@ void SGDTrainer::train(const Data &train_data,
 {
   Data train_data_copy(train_data);
 
+  unsigned int token_count = 0;
+
+  for (unsigned int i = 0; i < train_data.size(); ++i)
+    { token_count += train_data.at(i).size(); }
+
+  if (token_count > 0)
+    { l1_token_penalty = delta * sigma / token_count; }
+
   Data dev_data_copy(dev_data);
   dev_data_copy.unset_label();
 
@@ -86,10 +102,6 @@ void SGDTrainer::train(const Data &train_data,
     }
 
   float best_dev_acc = -1;
-  ParamTable best_params;
-  best_params.set_param_filter(options);
-  best_params.set_label_extractor(label_extractor);
-
   unsigned int useless_passes = 0;
 
   for (unsigned int i = 0; i < max_passes; ++i)
@@ -100,19 +112,27 @@ void SGDTrainer::train(const Data &train_data,
       msg_out << "  Train pass " << i + 1 << std::endl;
 
       // Train pass.
-      for (unsigned int j = 0; j < train_trellises.size(); ++j)
+      if (train_threads > 1)
+	{ concurrent_train_pass(train_trellises, train_data_copy, train_data); }
+      else
 	{
-	  //	  train_trellises[j]->set_maximum_a_posteriori_assignment
-	  //  (pos_params);
-	  train_trellises[j]->set_marginals(pos_params);
-
-	  update(train_data_copy.at(j), train_data.at(j), *train_trellises[j]);
-	  
-	  std::cerr << j << " of " << train_trellises.size() - 1 << "\r";
+	  for (unsigned int j = 0; j < train_trellises.size(); ++j)
+	    {
+	      //	  train_trellises[j]->set_maximum_a_posteriori_assignment
+	      //  (pos_params);
+	      train_trellises[j]->set_marginals(pos_params);
+	      
+	      update(train_data_copy.at(j), train_data.at(j), *train_trellises[j]);
+	      
+	      std::cerr << j << " of " << train_trellises.size() - 1 << "\r";
+	    }
 	}
 
       std::cerr << std::endl;
 
+      if (options.regularization == L1)
+	{ pos_params.remove_zero_params(); }
+
       // Tag dev data.
       for (unsigned int j = 0; j < dev_trellises.size(); ++j)
 	{
@@ -127,7 +147,7 @@ void SGDTrainer::train(const Data &train_data,
 	{
 	  useless_passes = 0;
 	  best_dev_acc = acc;
-	  best_params = pos_params;
+	  pt.set_params(pos_params);
 	}
       else
 	{
@@ -137,7 +157,6 @@ void SGDTrainer::train(const Data &train_data,
 
   msg_out << "  Final dev acc: " << best_dev_acc * 100.00 << "%" << std::endl;
 
-  pt = best_params;
   pt.set_label_extractor(label_extractor);
   pt.set_trained();
   pt.set_train_iters(iter);
@@ -158,9 +177,95 @@ void SGDTrainer::update(const Sentence &gold_s,
 			const Trellis &trellis) 
 {
   ++iter;
+  update_params(gold_s, sys_s, trellis);
+}
+
+void SGDTrainer::concurrent_train_pass(TrellisVector &train_trellises,
+				       const Data &gold_data,
+				       const Data &sys_data)
+{
+  pos_params.set_concurrent(1);
+
+  unsigned int round_size = train_threads * SENTENCES_PER_THREAD;
+
+  for (unsigned int begin = 0; 
+       begin < train_trellises.size(); 
+       begin += round_size)
+    {
+      unsigned int end = 
+	std::min<unsigned int>(train_trellises.size(), begin + round_size);
+
+      iter += end - begin;
+
+      std::vector<std::thread> threads;
+
+      for (unsigned int i = 0; i < train_threads; ++i)
+	{
+	  threads.push_back
+	    (std::thread(&SGDTrainer::train_sentences, this,
+			 &train_trellises, &gold_data, &sys_data,
+			 begin + i, end, train_threads));
+	}
+
+      for (unsigned int i = 0; i < threads.size(); ++i)
+	{ threads[i].join(); }
+
+      std::cerr << end - 1 << " of " << train_trellises.size() - 1 << "\r";
+    }
+
+  pos_params.set_concurrent(0);
+
+  // The threads cannot share the cumulative L1 penalty, so the
+  // penalty of the whole pass is applied to all parameters at once.
+  if (options.regularization == L1)
+    {
+      unsigned int token_count = 0;
+
+      for (unsigned int i = 0; i < sys_data.size(); ++i)
+	{ token_count += sys_data.at(i).size(); }
+
+      pos_params.regularize_l1(l1_token_penalty * token_count);
+      pos_params.apply_l1_penalties();
+    }
+}
+
+void SGDTrainer::train_sentences(TrellisVector * train_trellises,
+				 const Data * gold_data,
+				 const Data * sys_data,
+				 unsigned int begin,
+				 unsigned int end,
+				 unsigned int step)
+{
+  for (unsigned int j = begin; j < end; j += step)
+    {
+      (*train_trellises)[j]->set_marginals(pos_params);
+      update_params(gold_data->at(j), sys_data->at(j), *(*train_trellises)[j]);
+    }
+}
+
+void SGDTrainer::update_params(const Sentence &gold_s,
+			       const Sentence &sys_s,
+			       const Trellis &trellis) 
+{
+  // By default, the updated parameters are shrunk as part of their
+  // updates. With regularization=L2 every token shrinks the existing
+  // unstructured parameters of its features and candidate labels, and
+  // lazily, through per label factors, the structured parameters of
+  // its candidate labels (except in concurrent mode, where the factors
+  // cannot be shared).
+  // L1 regularization uses cumulative penalties, which
+  // concurrent_train_pass applies after the pass in concurrent mode.
+  bool lazy_l2 = (options.regularization == L2 and 
+		  not pos_params.is_concurrent());
+  bool cumulative_l1 = (options.regularization == L1 and 
+			not pos_params.is_concurrent());
+  float l2_sigma = (options.regularization == L1 or lazy_l2 ? 0 : sigma);
 
   for (unsigned int i = 0; i < sys_s.size() ; ++i)
     {
+      if (cumulative_l1)
+	{ pos_params.regularize_l1(l1_token_penalty); }
+
       unsigned int gold_label = gold_s.at(i).get_label();
       unsigned int pgold_label = (i < 1 ? boundary_label : gold_s.at(i - 1).get_label());
       unsigned int ppgold_label = (i < 2 ? boundary_label : gold_s.at(i - 2).get_label());
@@ -176,13 +281,21 @@ void SGDTrainer::update(const Sentence &gold_s,
 	{
 	  unsigned int j_label = word->get_label(j);
 	  
+	  if (lazy_l2)
+	    { 
+	      pos_params.regularize_l2_unstruct(sys_s.at(i), j_label, sigma, sublabel_order);
+	      pos_params.regularize_l2_struct(j_label, sigma, sublabel_order); 
+	    }
+
 	  float ug_marginal = trellis.get_marginal(i, j);
 
-	  pos_params.update_all_unstruct(sys_s.at(i), j_label, -ug_marginal*delta, sublabel_order);
-	  pos_params.update_struct1(j_label, -ug_marginal*delta, sublabel_order);
+	  // The bigram and trigram marginals of label j are at most its
+	  // unigram marginal.
+	  if (ug_marginal * delta < MIN_EXPECTED_UPDATE)
+	    { continue; }
 
-	  pos_params.regularize_all_unstruct(sys_s.at(i), j_label, sigma, sublabel_order);
-	  pos_params.regularize_struct1(j_label, sigma, sublabel_order);
+	  pos_params.update_all_unstruct(sys_s.at(i), j_label, -ug_marginal*delta, sublabel_order, l2_sigma);
+	  pos_params.update_struct1(j_label, -ug_marginal*delta, sublabel_order, l2_sigma);
 
 	  for (unsigned int k = 0; k < pword->get_label_count(); ++k)
 	    {
@@ -193,9 +306,12 @@ void SGDTrainer::update(const Sentence &gold_s,
 		{ bg_marginal = ug_marginal; }
 	      else
 		{ bg_marginal = trellis.get_marginal(i, k, j); }
+
+	      if (bg_marginal * delta < MIN_EXPECTED_UPDATE)
+		{ continue; }
+
 	      //	      std::cerr << bg_marginal << std::endl;
-	      pos_params.update_struct2(k_label, j_label, -bg_marginal*delta, sublabel_order);
-	      pos_params.regularize_struct2(k_label, j_label, sigma, sublabel_order);
+	      pos_params.update_struct2(k_label, j_label, -bg_marginal*delta, sublabel_order, l2_sigma);
 
 	      for (unsigned int l = 0; l < ppword->get_label_count(); ++l)
 		{
@@ -208,9 +324,12 @@ void SGDTrainer::update(const Sentence &gold_s,
 		    { 
 		      tg_marginal = trellis.get_marginal(i, l, k, j); 
 		    }
+
+		  if (tg_marginal * delta < MIN_EXPECTED_UPDATE)
+		    { continue; }
+
 		  //std::cerr << tg_marginal << std::endl;
-		  pos_params.update_struct3(l_label, k_label, j_label, -tg_marginal*delta, sublabel_order);
-		  pos_params.regularize_struct3(l_label, k_label, j_label, sigma, sublabel_order);
+		  pos_params.update_struct3(l_label, k_label, j_label, -tg_marginal*delta, sublabel_order, l2_sigma);
 		}
 	    }
 	}
@@ -256,7 +375,7 @@ class SillyLemmaExtractor : public LemmaExtractor
 {
 public:
   std::string get_lemma_candidate(const std::string &word_form, 
-				  const std::string &label)
+				  const std::string &label) const
   { 
     static_cast<void>(word_form);
     static_cast<void>(label);
@@ -340,5 +459,52 @@ int main(void)
 
   std::cerr << pt << std::endl;
   assert(dev_data.get_acc(dev_data_copy, SillyLemmaExtractor()).label_acc == 1);
+
+  // L1 regularization with the default sigma keeps the model on a
+  // larger data set, also when the training is concurrent.
+  std::string l1_contents;
+
+  for (unsigned int i = 0; i < 200; ++i)
+    { l1_contents += contents; }
+
+  for (unsigned int threads = 1; threads <= 2; ++threads)
+    {
+      TaggerOptions l1_options;
+      l1_options.delta = 0.1;
+      l1_options.regularization = L1;
+      l1_options.train_threads = threads;
+
+      std::istringstream l1_in(l1_contents);
+      ParamTable l1_pt;
+
+      Data l1_train_data(l1_in, 1, label_extractor, l1_pt, 2);
+      l1_train_data.set_label_guesses(label_extractor, 
+				      0,
+				      0,
+				      label_extractor.label_count());
+
+      Data l1_dev_data(l1_train_data);
+      Data l1_dev_data_copy(l1_dev_data);
+      l1_dev_data_copy.unset_label();
+      l1_dev_data_copy.set_label_guesses(label_extractor, 
+					 0, 
+					 0,
+					 label_extractor.label_count());
+
+      SGDTrainer l1_trainer(3, 3, l1_pt, label_extractor, sle, null_out, 
+			    l1_options);
+      l1_trainer.train(l1_train_data, l1_dev_data);
+
+      for (unsigned int i = 0; i < l1_dev_data_copy.size(); ++i)
+	{
+	  Trellis trellis(l1_dev_data_copy.at(i), 
+			  label_extractor.get_boundary_label(), 
+			  NODEG, 
+			  SECOND);
+	  trellis.set_maximum_a_posteriori_assignment(l1_pt);      
+	}
+
+      assert(l1_dev_data.get_acc(l1_dev_data_copy, sle).label_acc == 1);
+    }
 }
 #endif // TEST_SGDTrainer_cc
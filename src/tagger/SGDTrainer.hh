@@ -48,12 +48,34 @@ private:
   const TaggerOptions &options;
   float delta;
   float sigma;
+
+  // L1 penalty of one token: delta * sigma / N for N training tokens,
+  // so one pass adds delta * sigma to the total penalty.
+  float l1_token_penalty;
+
   Word bw;
 
   void update(const Sentence &gold_s, 
 	      const Sentence &sys_s,
 	      const Trellis &trellis);
 
+  void update_params(const Sentence &gold_s, 
+		     const Sentence &sys_s,
+		     const Trellis &trellis);
+
+  // Hogwild training pass using train_threads threads that share
+  // pos_params.
+  void concurrent_train_pass(TrellisVector &train_trellises,
+			     const Data &gold_data,
+			     const Data &sys_data);
+
+  void train_sentences(TrellisVector * train_trellises,
+		       const Data * gold_data,
+		       const Data * sys_data,
+		       unsigned int begin,
+		       unsigned int end,
+		       unsigned int step);
+
 };
 
 #endif // HEADER_SGDTrainer_hh
@@ -39,6 +39,15 @@ Sentence::Sentence(const WordVector &words,
   sentence.insert(sentence.end(), /*degree*/2, bw);
 }
 
+Sentence::Sentence(const WordVector &words, 
+		   const LabelExtractor &label_extractor)
+{
+  Word bw(label_extractor.get_boundary_label());
+  sentence.insert(sentence.end(), 2, bw);
+  sentence.insert(sentence.end(), words.begin(), words.end());
+  sentence.insert(sentence.end(), 2, bw);
+}
+
 Sentence::Sentence(std::istream &ifile, 
 		   bool is_gold, 
 		   LabelExtractor &label_extractor, 
@@ -179,7 +188,7 @@ void Sentence::set_label_guesses(const LabelExtractor &g, bool use_label_dict, f
     }
 }
 
-void Sentence::predict_lemma(LemmaExtractor &g, const LabelExtractor &e)
+void Sentence::predict_lemma(const LemmaExtractor &g, const LabelExtractor &e)
 {
   for (unsigned int i = 0; i < sentence.size(); ++i)
     { 
@@ -260,7 +269,7 @@ class SillyLemmaExtractor : public LemmaExtractor
 {
 public:
   std::string get_lemma_candidate(const std::string &word_form, 
-				  const std::string &label)
+				  const std::string &label) const
   { 
     static_cast<void>(word_form);
     static_cast<void>(label);
@@ -42,6 +42,10 @@ class Sentence
 	   LabelExtractor &label_extractor, 
 	   unsigned int degree);
 
+  // Surround @p words by boundary words like the sentences read from
+  // a stream.
+  Sentence(const WordVector &words, const LabelExtractor &label_extractor);
+
   Sentence(std::istream &ifile, 
 	   bool is_gold, 
 	   LabelExtractor &label_extractor, 
@@ -58,7 +62,7 @@ class Sentence
 			 bool use_label_dict,
 			 float mass,
 			 int candidate_count = -1);
-  void predict_lemma(LemmaExtractor &g, const LabelExtractor &e);
+  void predict_lemma(const LemmaExtractor &g, const LabelExtractor &e);
 
   void unset_lemma(void);
   void unset_label(void);
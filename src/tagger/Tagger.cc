@@ -24,6 +24,12 @@
 #ifndef TEST_Tagger_cc
 
 #include <sstream>
+#include <fstream>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
 
 #include "PerceptronTrainer.hh"
 #include "SGDTrainer.hh"
@@ -46,19 +52,7 @@ Tagger::Tagger(const TaggerOptions &tagger_options,
   label_extractor(tagger_options),
   msg_out(msg_out)
 {
-  if (tagger_options.estimator == AVG_PERC)
-    {
-      if (tagger_options.regularization != NONE or 
-	  tagger_options.delta != -1            or 
-	  tagger_options.sigma != -1)
-	{ 
-	  msg_out << "Warning! Averaged perceptron doesn't utilize delta," 
-		  << std::endl
-		  << "sigma or regularization. Options will be discarded." 
-		  << std::endl 
-		  << std::endl;
-	}
-    }
+  warn_about_options();
 }
 
 Tagger::Tagger(std::istream &tagger_opt_in, std::ostream &msg_out):
@@ -66,6 +60,13 @@ Tagger::Tagger(std::istream &tagger_opt_in, std::ostream &msg_out):
   tagger_options(tagger_opt_in, line_counter),
   label_extractor(tagger_options),
   msg_out(msg_out)
+{
+  warn_about_options();
+
+  line_counter = 0;
+}
+
+void Tagger::warn_about_options(void)
 {
   if (tagger_options.estimator == AVG_PERC)
     {
@@ -81,20 +82,49 @@ Tagger::Tagger(std::istream &tagger_opt_in, std::ostream &msg_out):
 	}
     }
 
-  line_counter = 0;
+  if (tagger_options.coarse_threshold >= 0 and 
+      tagger_options.model_order == SECOND)
+    {
+      msg_out << "Warning! coarse_threshold prunes labels using a first"
+	      << std::endl
+	      << "order model. This can remove labels that the second"
+	      << std::endl
+	      << "order model would choose and lower accuracy."
+	      << std::endl
+	      << std::endl;
+    }
 }
 
 void Tagger::set_param_filter(const TaggerOptions &options)
 { param_table.set_param_filter(options); }
 
+void Tagger::set_quantization(Quantization quantization)
+{
+  tagger_options.quantization = quantization;
+  param_table.set_quantization(quantization);
+}
+
 void Tagger::set_options(const TaggerOptions &tagger_options)
-{ this->tagger_options = tagger_options; }
+{ 
+  // Feature hashing is a property of the model, not of the run.
+  unsigned int feature_hash_buckets = this->tagger_options.feature_hash_buckets;
+  this->tagger_options = tagger_options; 
+  this->tagger_options.feature_hash_buckets = feature_hash_buckets;
+
+  if (param_table.is_struct_compiled())
+    {
+      param_table.compile_struct(tagger_options.sublabel_order, 
+				 tagger_options.model_order);
+    }
+}
 
 #include <cassert>
 
 void Tagger::train(std::istream &train_in,
 		   std::istream &dev_in)
 {
+  param_table.set_feature_hash_buckets(tagger_options.feature_hash_buckets);
+
   msg_out << "Reading training data." << std::endl;
   Data train_data(train_in, 1, label_extractor, param_table, 
 		  tagger_options.degree);
@@ -161,6 +191,10 @@ void Tagger::train(std::istream &train_in,
     { throw NotImplemented(); }
 
   param_table.set_label_extractor(label_extractor);
+
+  // The stored model is quantized as the options say, so that load()
+  // reads it in the same format.
+  param_table.set_quantization(tagger_options.quantization);
 }
 
 void Tagger::evaluate(std::istream &in)
@@ -247,9 +281,9 @@ void Tagger::label(std::istream &in)
 		    << "\t_\t" << data.at(i).at(j).get_lemma() 
 		    << "\t" << label_extractor.
 	    get_label_string(data.at(i).at(j).get_label()) 
-		    << "\t" << data.at(i).at(j).get_annotations() << std::endl;
+		    << "\t" << data.at(i).at(j).get_annotations() << '\n';
 	}
-      std::cout << std::endl;
+      std::cout << '\n' << std::flush;
     }
 
   for (unsigned int i = 0; i < data.size(); ++i)
@@ -258,108 +292,573 @@ void Tagger::label(std::istream &in)
     }
 }
 
-void Tagger::label_stream(std::istream &in)
+// Sentences that may be in label_stream or lemmatize_stream at once
+// per worker thread.
+const unsigned int STREAM_SLOTS_PER_THREAD = 16;
+
+// A sentence on its way from the reader to the writer of a threaded
+// label_stream or lemmatize_stream.
+struct StreamSlot
 {
-  unsigned int line = 0;
+  StreamSlot(void):
+    line(0),
+    sentence(0),
+    done(0)
+  {}
+
+  std::string text;
+  unsigned int line;
+  Sentence * sentence;
+  std::string output;
+  bool done;
+};
+
+// State shared by the reader, the workers and the writer. Sentence
+// number i is kept in slot i % slots.size(), which bounds the number
+// of sentences waiting for a worker or for the writer.
+struct StreamQueue
+{
+  StreamQueue(unsigned int slot_count):
+    slots(slot_count),
+    read_count(0),
+    write_count(0),
+    eof(0)
+  {}
+
+  ~StreamQueue(void)
+  {
+    for (unsigned int i = 0; i < slots.size(); ++i)
+      { delete slots[i].sentence; }
+  }
+
+  std::vector<StreamSlot> slots;
+  std::deque<unsigned int> pending;
+  unsigned int read_count;
+  unsigned int write_count;
+  bool eof;
+  std::exception_ptr error;
+
+  std::mutex mutex;
+  std::condition_variable work_ready;
+  std::condition_variable output_ready;
+  std::condition_variable slot_free;
+
+  void set_error(std::exception_ptr e)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (not error)
+      { error = e; }
+
+    work_ready.notify_all();
+    output_ready.notify_all();
+    slot_free.notify_all();
+  }
+};
+
+// Return true if parsing @p line could add labels to @p
+// label_extractor. Other lines are parsed without modifying it.
+static bool line_has_new_labels(const std::string &line,
+				const LabelExtractor &label_extractor)
+{
+  size_t annotation_pos = line.rfind('\t');
 
-  while (in)
+  if (annotation_pos == std::string::npos or annotation_pos == 0)
+    { return 0; }
+
+  size_t label_pos = line.rfind('\t', annotation_pos - 1);
+
+  if (label_pos == std::string::npos)
+    { return 0; }
+
+  std::string label_field = 
+    line.substr(label_pos + 1, annotation_pos - label_pos - 1);
+
+  if (label_field != "_")
     {
-      Sentence s(in, 0, label_extractor, param_table, tagger_options.degree, line);
+      StringVector labels;
+      split(label_field, labels, ' ');
 
-      if (s.size() == 0)
-	{ continue; }
+      for (unsigned int i = 0; i < labels.size(); ++i)
+	{
+	  if (not label_extractor.has_label(labels[i]))
+	    { return 1; }
+	}
+    }
+
+  StringPairVector analyses;
+
+  try
+    {
+      finnposaux::parse_aux_field(line.substr(annotation_pos + 1), analyses);
+    }
+  catch (...)
+    {}
+
+  for (unsigned int i = 0; i < analyses.size(); ++i)
+    {
+      if (not label_extractor.has_label(analyses[i].first))
+	{ return 1; }
+    }
+
+  return 0;
+}
+
+static void write_stream(StreamQueue * queue, std::ostream * out)
+{
+  while (1)
+    {
+      std::string output;
+
+      {
+	std::unique_lock<std::mutex> lock(queue->mutex);
+	StreamSlot &slot = 
+	  queue->slots[queue->write_count % queue->slots.size()];
+
+	while (not slot.done and not queue->error and
+	       not (queue->eof and queue->write_count == queue->read_count))
+	  { queue->output_ready.wait(lock); }
+
+	if (queue->error or not slot.done)
+	  { return; }
+
+	output.swap(slot.output);
+	slot.done = 0;
+	++queue->write_count;
+	queue->slot_free.notify_one();
+      }
+
+      *out << output << std::flush;
+    }
+}
+
+Sentence * Tagger::read_stream_sentence(std::istream &in, 
+					bool lemmatize,
+					unsigned int &line)
+{
+  if (lemmatize)
+    { 
+      return new Sentence
+	(get_lemmatizer_input(in, label_extractor, param_table, line)); 
+    }
+
+  return new Sentence(in, 0, label_extractor, param_table, 
+		      tagger_options.degree, line);
+}
+
+void Tagger::set_label_guesses(Sentence &s, 
+			       Trellis &trellis, 
+			       bool prune) const
+{
+  s.set_label_guesses(label_extractor, 
+		      tagger_options.use_label_dictionary, 
+		      tagger_options.guess_mass,
+		      tagger_options.guesses);
 
-      s.set_label_guesses(label_extractor, 
-			  tagger_options.use_label_dictionary, 
-			  tagger_options.guess_mass,
-			  tagger_options.guesses);
+  trellis.set_sentence(s);
 
-      Trellis trellis(s, label_extractor.get_boundary_label(), 
-		      tagger_options.sublabel_order,
-		      tagger_options.model_order,
-		      tagger_options.beam);
-      trellis.set_beam_mass(tagger_options.beam_mass);
+  if (prune and tagger_options.coarse_threshold >= 0)
+    { trellis.prune_label_guesses(param_table, 
+				  tagger_options.coarse_threshold); }
+}
+
+void Tagger::set_map_assignment(Trellis &trellis) const
+{
+  if (tagger_options.split_at_anchors)
+    { trellis.set_anchored_maximum_a_posteriori_assignment(param_table); }
+  else
+    { trellis.set_maximum_a_posteriori_assignment(param_table); }
+}
+
+void Tagger::label_sentence(Sentence &s, 
+			    Trellis &trellis, 
+			    std::ostream &out) const
+{
+  set_label_guesses(s, trellis, tagger_options.inference != MARGINAL);
       
-      if (tagger_options.inference == MAP)
-	{
-	  trellis.set_maximum_a_posteriori_assignment(param_table);      
+  if (tagger_options.inference == MAP)
+    {
+      set_map_assignment(trellis);
   
-	  s.predict_lemma(lemma_extractor, label_extractor);
+      s.predict_lemma(lemma_extractor, label_extractor);
+
+      for (unsigned int j = 0; j < s.size(); ++j)
+	{
+	  if (s.at(j).get_word_form() == "_#_")
+	    { continue; }
+
+	  out << s.at(j).get_word_form() 
+	      << "\t_\t" << s.at(j).get_lemma() 
+	      << "\t" << label_extractor.
+	    get_label_string(s.at(j).get_label()) 
+	      << "\t" << s.at(j).get_annotations() << '\n';
+	}
+      out << '\n' << std::flush;
+    }
+  else if (tagger_options.inference == MARGINAL)
+    {
+      trellis.set_marginals(param_table);      
+      //s.predict_lemma(lemma_extractor, label_extractor);
+
+      for (unsigned int j = 0; j < s.size(); ++j)
+	{
+	  if (s.at(j).get_word_form() == "_#_")
+	    { continue; }
+
+	  std::vector<std::pair<float, std::string> > candidates;
+
+	  for (unsigned int k = 0; k < s.at(j).get_label_count(); ++k)
+	    {
+	      float marginal = trellis.get_marginal(j,k);
+	      std::string label = label_extractor.get_label_string(s.at(j).get_label(k));		  
+	      candidates.push_back(std::pair<float,std::string>(marginal,label));
+	    }
+	  std::sort(candidates.begin(), candidates.end());
+	  std::reverse(candidates.begin(), candidates.end());
 
-	  for (unsigned int j = 0; j < s.size(); ++j)
+	  out << s.at(j).get_word_form();
+	  for (unsigned int k = 0; k < candidates.size(); ++k)
 	    {
-	      if (s.at(j).get_word_form() == "_#_")
-		{ continue; }
-
-	      std::cout << s.at(j).get_word_form() 
-			<< "\t_\t" << s.at(j).get_lemma() 
-			<< "\t" << label_extractor.
-		get_label_string(s.at(j).get_label()) 
-			<< "\t" << s.at(j).get_annotations() << std::endl;
+	      out << '\t' << candidates[k].second << ' ' << candidates[k].first << '\n'; 
 	    }
-	  std::cout << std::endl;
 	}
-      else if (tagger_options.inference == MARGINAL)
+      out << '\n' << std::flush;
+    }
+  else if (tagger_options.inference == NBEST)
+    {
+      // One line with the scores of the paths followed by one line
+      // per word with the label of the word in each path.
+      std::vector<LabelVector> paths;
+      std::vector<float> scores;
+
+      trellis.get_nbest_assignments(param_table, 
+				    tagger_options.nbest, 
+				    paths, 
+				    scores);
+
+      out << "#";
+      for (unsigned int k = 0; k < scores.size(); ++k)
+	{ out << '\t' << scores[k]; }
+      out << '\n';
+
+      for (unsigned int j = 0; j < s.size(); ++j)
 	{
-	  trellis.set_marginals(param_table);      
-	  //s.predict_lemma(lemma_extractor, label_extractor);
+	  if (s.at(j).get_word_form() == "_#_")
+	    { continue; }
 
-	  for (unsigned int j = 0; j < s.size(); ++j)
+	  out << s.at(j).get_word_form();
+	  for (unsigned int k = 0; k < paths.size(); ++k)
 	    {
-	      if (s.at(j).get_word_form() == "_#_")
-		{ continue; }
-
-	      std::vector<std::pair<float, std::string> > candidates;
-
-	      for (unsigned int k = 0; k < s.at(j).get_label_count(); ++k)
-		{
-		  float marginal = trellis.get_marginal(j,k);
-		  std::string label = label_extractor.get_label_string(s.at(j).get_label(k));		  
-		  candidates.push_back(std::pair<float,std::string>(marginal,label));
-		}
-	      std::sort(candidates.begin(), candidates.end());
-	      std::reverse(candidates.begin(), candidates.end());
-
-	      std::cout << s.at(j).get_word_form();
-	      for (unsigned int k = 0; k < candidates.size(); ++k)
-		{
-		  std::cout << '\t' << candidates[k].second << ' ' << candidates[k].first << std::endl; 
-		}
+	      out << '\t' 
+		  << label_extractor.get_label_string(paths[k][j]); 
 	    }
-	  std::cout << std::endl;
+	  out << '\n';
 	}
-      else
+      out << '\n' << std::flush;
+    }
+  else
+    {
+      throw NotImplemented();
+    }
+}
+
+void Tagger::lemmatize_sentence(Sentence &s, std::ostream &out) const
+{
+  s.predict_lemma(lemma_extractor, label_extractor);
+
+  for (unsigned int j = 0; j < s.size(); ++j)
+    {
+      if (s.at(j).get_word_form() == "_#_")
+	{ continue; }
+
+      out << s.at(j).get_word_form() 
+	  << "\t_\t" << s.at(j).get_lemma() 
+	  << "\t" << label_extractor.
+	get_label_string(s.at(j).get_label()) 
+	  << "\t" << s.at(j).get_annotations() << '\n';
+    }
+  out << '\n' << std::flush;
+}
+
+void Tagger::stream_worker(StreamQueue * queue, bool lemmatize)
+{
+  std::unique_ptr<Trellis> trellis(new_trellis());
+
+  while (1)
+    {
+      StreamSlot * slot = 0;
+
+      {
+	std::unique_lock<std::mutex> lock(queue->mutex);
+
+	while (queue->pending.empty() and not queue->eof and 
+	       not queue->error)
+	  { queue->work_ready.wait(lock); }
+
+	if (queue->pending.empty() or queue->error)
+	  { return; }
+
+	slot = &queue->slots[queue->pending.front() % queue->slots.size()];
+	queue->pending.pop_front();
+      }
+
+      try
 	{
-	  throw NotImplemented();
+	  if (slot->sentence == 0)
+	    {
+	      std::istringstream in(slot->text);
+	      slot->sentence = read_stream_sentence(in, lemmatize, slot->line);
+	    }
+
+	  std::ostringstream out;
+
+	  if (slot->sentence->size() != 0)
+	    {
+	      if (lemmatize)
+		{ lemmatize_sentence(*slot->sentence, out); }
+	      else
+		{ label_sentence(*slot->sentence, *trellis, out); }
+	    }
+
+	  delete slot->sentence;
+	  slot->sentence = 0;
+	  slot->output = out.str();
 	}
+      catch (...)
+	{
+	  queue->set_error(std::current_exception());
+	  return;
+	}
+
+      std::lock_guard<std::mutex> lock(queue->mutex);
+      slot->done = 1;
+      queue->output_ready.notify_one();
     }
 }
 
-void Tagger::lemmatize_stream(std::istream &in)
+void Tagger::process_stream(std::istream &in, 
+			    unsigned int threads, 
+			    bool lemmatize)
+{
+  StreamQueue queue(threads * STREAM_SLOTS_PER_THREAD);
+
+  // Reading std::cin flushes std::cout, which the writer uses.
+  std::ostream * tied_out = in.tie(0);
+
+  std::thread writer(write_stream, &queue, &std::cout);
+  std::vector<std::thread> workers;
+
+  for (unsigned int i = 0; i < threads; ++i)
+    { 
+      workers.push_back
+	(std::thread(&Tagger::stream_worker, this, &queue, lemmatize)); 
+    }
+
+  unsigned int line = 0;
+
+  try
+    {
+      while (in)
+	{
+	  // Read the lines of one sentence. Workers parse them unless
+	  // that could add labels to the label extractor, which they
+	  // all use.
+	  std::string text;
+	  std::string line_string;
+	  unsigned int first_line = line;
+	  bool new_labels = 0;
+
+	  while (in.peek() != EOF)
+	    {
+	      std::getline(in, line_string);
+	      ++line;
+
+	      if (line_string.empty())
+		{ break; }
+
+	      new_labels = 
+		new_labels or line_has_new_labels(line_string, label_extractor);
+	      text += line_string;
+	      text += '\n';
+	    }
+
+	  std::unique_lock<std::mutex> lock(queue.mutex);
+
+	  // Wait for a free slot. New labels are added only when all
+	  // earlier sentences have been processed.
+	  while (not queue.error and 
+		 (queue.read_count - queue.write_count == queue.slots.size() or
+		  (new_labels and queue.write_count != queue.read_count)))
+	    { queue.slot_free.wait(lock); }
+
+	  if (queue.error)
+	    { break; }
+
+	  StreamSlot &slot = queue.slots[queue.read_count % queue.slots.size()];
+	  slot.text.swap(text);
+	  slot.line = first_line;
+
+	  if (new_labels)
+	    {
+	      lock.unlock();
+	      std::istringstream sentence_in(slot.text);
+	      slot.sentence = 
+		read_stream_sentence(sentence_in, lemmatize, first_line);
+	      lock.lock();
+	    }
+
+	  queue.pending.push_back(queue.read_count);
+	  ++queue.read_count;
+	  queue.work_ready.notify_one();
+	}
+    }
+  catch (...)
+    {
+      queue.set_error(std::current_exception());
+    }
+
+  {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.eof = 1;
+    queue.work_ready.notify_all();
+    queue.output_ready.notify_all();
+  }
+
+  for (unsigned int i = 0; i < workers.size(); ++i)
+    { workers[i].join(); }
+
+  writer.join();
+  in.tie(tied_out);
+
+  if (queue.error)
+    { std::rethrow_exception(queue.error); }
+}
+
+void Tagger::label_stream(std::istream &in, unsigned int threads)
+{
+  if (threads > 1)
+    { process_stream(in, threads, 0); }
+  else
+    { label_stream(in, std::cout); }
+}
+
+void Tagger::label_stream(std::istream &in, std::ostream &out)
+{
+  // One trellis is reused for every sentence, so decoding does not
+  // allocate once the trellis has grown to the longest sentence.
+  std::unique_ptr<Trellis> trellis(new_trellis());
+  label_stream(in, out, *trellis);
+}
+
+void Tagger::label_stream(std::istream &in, 
+			  std::ostream &out, 
+			  Trellis &trellis)
 {
   unsigned int line = 0;
 
   while (in)
     {
-      Sentence s = get_lemmatizer_input(in, label_extractor, param_table, line);
+      Sentence s(in, 0, label_extractor, param_table, tagger_options.degree, line);
 
       if (s.size() == 0)
 	{ continue; }
 
-      s.predict_lemma(lemma_extractor, label_extractor);
+      label_sentence(s, trellis, out);
+    }
+}
 
-      for (unsigned int j = 0; j < s.size(); ++j)
-	{
-	  if (s.at(j).get_word_form() == "_#_")
-	    { continue; }
+Trellis * Tagger::new_trellis(void) const
+{
+  Trellis * trellis = new Trellis(label_extractor.get_boundary_label(), 
+				  tagger_options.sublabel_order,
+				  tagger_options.model_order,
+				  tagger_options.beam);
+  trellis->set_beam_mass(tagger_options.beam_mass);
+  return trellis;
+}
 
-	  std::cout << s.at(j).get_word_form() 
-		    << "\t_\t" << s.at(j).get_lemma() 
-		    << "\t" << label_extractor.
-	    get_label_string(s.at(j).get_label()) 
-		    << "\t" << s.at(j).get_annotations() << std::endl;
+void Tagger::tag_sentence(Sentence &s, 
+			  Trellis &trellis, 
+			  bool lemmatize,
+			  std::vector<float> * marginals) const
+{
+  set_label_guesses(s, trellis, 1);
+  set_map_assignment(trellis);
+
+  if (lemmatize)
+    { s.predict_lemma(lemma_extractor, label_extractor); }
+
+  if (marginals == 0)
+    { return; }
+
+  // Pruning would change the marginals, so they are computed over the
+  // unpruned label guesses. Resetting the guesses keeps the labels
+  // set above. The anchored assignment also leaves a segment of the
+  // sentence in the trellis.
+  if (tagger_options.coarse_threshold >= 0)
+    { set_label_guesses(s, trellis, 0); }
+  else
+    { trellis.set_sentence(s); }
+
+  trellis.set_marginals(param_table);
+
+  marginals->assign(s.size(), 0);
+
+  for (unsigned int j = 0; j < s.size(); ++j)
+    {
+      for (unsigned int k = 0; k < s.at(j).get_label_count(); ++k)
+	{
+	  if (s.at(j).get_label(k) == s.at(j).get_label())
+	    {
+	      (*marginals)[j] = trellis.get_marginal(j, k);
+	      break;
+	    }
 	}
-      std::cout << std::endl;
+    }
+}
+
+bool Tagger::find_feat_template(const std::string &feat_string,
+				unsigned int &feat_template) const
+{ return param_table.find_feat_template(feat_string, feat_template); }
+
+bool Tagger::has_new_labels(const std::string &text) const
+{
+  size_t begin = 0;
+
+  while (begin < text.size())
+    {
+      size_t end = text.find('\n', begin);
+
+      if (end == std::string::npos)
+	{ end = text.size(); }
+
+      if (line_has_new_labels(text.substr(begin, end - begin), label_extractor))
+	{ return 1; }
+
+      begin = end + 1;
+    }
+
+  return 0;
+}
+
+void Tagger::lemmatize_stream(std::istream &in, unsigned int threads)
+{
+  if (threads > 1)
+    { 
+      process_stream(in, threads, 1); 
+      return;
+    }
+
+  unsigned int line = 0;
+
+  while (in)
+    {
+      Sentence s = get_lemmatizer_input(in, label_extractor, param_table, line);
+
+      if (s.size() == 0)
+	{ continue; }
+
+      lemmatize_sentence(s, std::cout);
     }
 }
 
@@ -411,8 +910,75 @@ void Tagger::load(std::istream &in)
   label_extractor.load(in, reverse_bytes);
   label_extractor.set_options(tagger_options);
   lemma_extractor.load(in, reverse_bytes);
+  param_table.set_quantization(tagger_options.quantization);
+  param_table.set_feature_hash_buckets(tagger_options.feature_hash_buckets);
   param_table.load(in, reverse_bytes); 
   param_table.set_label_extractor(label_extractor);
+  param_table.compile();
+  param_table.compile_struct(tagger_options.sublabel_order, 
+			     tagger_options.model_order);
+}
+
+void Tagger::store_mapped(std::ostream &out) const
+{
+  msg_out << "Storing mapped model." << std::endl;
+
+  MappedModelWriter writer;
+
+  std::ostringstream options_out;
+  tagger_options.store(options_out);
+  writer.add_section(OPTIONS_SECTION, options_out.str());
+
+  std::ostringstream label_extractor_out;
+  label_extractor.store(label_extractor_out);
+  writer.add_section(LABEL_EXTRACTOR_SECTION, label_extractor_out.str());
+
+  lemma_extractor.store_mapped(writer);
+
+  std::ostringstream param_out;
+  param_table.store_mapped(param_out);
+  writer.add_section(TAGGER_PARAM_SECTION, param_out.str());
+
+  writer.write(out);
+}
+
+void Tagger::load(const std::string &model_fn)
+{
+  std::ifstream in(model_fn.c_str(), std::ios::binary);
+
+  if (not in.good())
+    { throw ReadFailed(); }
+
+  if (not MappedModel::is_mapped_model(in))
+    { 
+      load(in); 
+      return;
+    }
+
+  in.close();
+  mapped_model.reset(new MappedModel(model_fn));
+
+  size_t size;
+  const char * data = mapped_model->get_section(OPTIONS_SECTION, size);
+  MemoryInputBuffer options_buffer(data, size);
+  std::istream options_in(&options_buffer);
+  tagger_options.load(options_in, msg_out, false);
+
+  data = mapped_model->get_section(LABEL_EXTRACTOR_SECTION, size);
+  MemoryInputBuffer label_extractor_buffer(data, size);
+  std::istream label_extractor_in(&label_extractor_buffer);
+  label_extractor.load(label_extractor_in, false);
+  label_extractor.set_options(tagger_options);
+
+  lemma_extractor.load_mapped(*mapped_model);
+
+  data = mapped_model->get_section(TAGGER_PARAM_SECTION, size);
+  param_table.set_quantization(tagger_options.quantization);
+  param_table.set_feature_hash_buckets(tagger_options.feature_hash_buckets);
+  param_table.load_mapped(data, size);
+  param_table.set_label_extractor(label_extractor);
+  param_table.compile_struct(tagger_options.sublabel_order, 
+			     tagger_options.model_order);
 }
 
 bool Tagger::operator==(const Tagger &another) const
@@ -432,6 +998,9 @@ bool Tagger::operator==(const Tagger &another) const
 LabelExtractor &Tagger::get_label_extractor(void)
 { return label_extractor; }
 
+const LabelExtractor &Tagger::get_label_extractor(void) const
+{ return label_extractor; }
+
 LemmaExtractor &Tagger::get_lemma_extractor(void)
 { return lemma_extractor; }
 
@@ -514,6 +1083,56 @@ int main(void)
   Tagger tagger_copy(null_stream);
   tagger_copy.load(tagger_in);
   assert(tagger == tagger_copy);
+
+  // A large odd bucket count is stored exactly, so the hashed
+  // feature ids of a loaded model stay the same.
+  TaggerOptions hashed_options(tagger_options);
+  hashed_options.feature_hash_buckets = MAX_FEATURE_HASH_BUCKETS - 1;
+  Tagger hashed_tagger(hashed_options, null_stream);
+  std::istringstream hashed_train_in(train_contents);
+  std::istringstream hashed_dev_in(dev_contents);
+  hashed_tagger.train(hashed_train_in, hashed_dev_in);
+
+  std::ostringstream hashed_out;
+  hashed_tagger.store(hashed_out);
+  std::istringstream hashed_in(hashed_out.str());
+  Tagger hashed_copy(null_stream);
+  hashed_copy.load(hashed_in);
+  assert(hashed_tagger == hashed_copy);
+
+  // Larger bucket counts are rejected.
+  std::istringstream big_bucket_in("feature_hash_buckets=16777217\n");
+  unsigned int big_bucket_counter = 0;
+
+  try
+    {
+      TaggerOptions big_bucket_options(big_bucket_in, big_bucket_counter);
+      assert(0);
+    }
+  catch (const NumericalRangeError &e)
+    { static_cast<void>(e); }
+
+  // Threaded labeling gives the same output in the same order.
+  std::string stream_contents;
+
+  for (unsigned int i = 0; i < 50; ++i)
+    { stream_contents += test_contents + "\n"; }
+
+  std::streambuf * cout_buf = std::cout.rdbuf();
+  std::ostringstream serial_out;
+  std::ostringstream threaded_out;
+
+  std::istringstream serial_in(stream_contents);
+  std::cout.rdbuf(serial_out.rdbuf());
+  tagger.label_stream(serial_in);
+
+  std::istringstream threaded_in(stream_contents);
+  std::cout.rdbuf(threaded_out.rdbuf());
+  tagger.label_stream(threaded_in, 3);
+  std::cout.rdbuf(cout_buf);
+
+  assert(not serial_out.str().empty());
+  assert(threaded_out.str() == serial_out.str());
 }
 
 #endif // TEST_Tagger_cc
@@ -24,6 +24,7 @@
 
 #include <iostream>
 #include <exception>
+#include <memory>
 
 #include "Sentence.hh"
 #include "Data.hh"
@@ -31,10 +32,14 @@
 #include "LabelExtractor.hh"
 #include "LemmaExtractor.hh"
 #include "TaggerOptions.hh"
+#include "MappedModel.hh"
 
 struct NotImplemented : public std::exception
 {};
 
+class Trellis;
+struct StreamQueue;
+
 class Tagger
 {
 public:
@@ -49,15 +54,58 @@ public:
 	     std::istream &dev_in);
 
   void label(std::istream &in);
-  void label_stream(std::istream &in);
-  void lemmatize_stream(std::istream &in);
+  // Label or lemmatize the sentences in @p in and write them to
+  // STDOUT in input order. If @p threads > 1, a reader, @p threads
+  // workers and a writer run concurrently.
+  void label_stream(std::istream &in, unsigned int threads = 1);
+  void lemmatize_stream(std::istream &in, unsigned int threads = 1);
+
+  // Label the sentences in @p in and write them to @p out. Several
+  // threads may call this at once if has_new_labels is false for
+  // all of their input.
+  void label_stream(std::istream &in, std::ostream &out);
+
+  // As above but decode in @p trellis from new_trellis, which a
+  // thread can reuse for all of its input.
+  void label_stream(std::istream &in, std::ostream &out, Trellis &trellis);
+
+  // Return true if parsing the sentences in @p text could add labels
+  // to the model.
+  bool has_new_labels(const std::string &text) const;
+
+  // Decoding interface for embedding the tagger (see FinnPos.hh).
+  // Several threads may tag sentences at once, each with its own
+  // trellis from new_trellis.
+  Trellis * new_trellis(void) const;
+
+  // Set the labels of the words in @p s and their lemmas if
+  // @p lemmatize. If @p marginals is nonzero, store the marginal
+  // probability of the label of each word of @p s in it.
+  void tag_sentence(Sentence &s, 
+		    Trellis &trellis, 
+		    bool lemmatize,
+		    std::vector<float> * marginals) const;
+
+  // Store the id of feature @p feat_string in @p feat_template and
+  // return true, or return false if the model has no such feature.
+  bool find_feat_template(const std::string &feat_string,
+			  unsigned int &feat_template) const;
 
   void store(std::ostream &out) const;
   void load(std::istream &in);
 
+  // Store the model in the memory mapped format. Quantized parameters
+  // are stored as their codes.
+  void store_mapped(std::ostream &out) const;
+
+  // Load model file @p model_fn in either format. Parameters of a
+  // mapped model are used in place and shared with other processes.
+  void load(const std::string &model_fn);
+
   void evaluate(std::istream &in);
   bool operator==(const Tagger &another) const;
   LabelExtractor &get_label_extractor(void);
+  const LabelExtractor &get_label_extractor(void) const;
   LemmaExtractor &get_lemma_extractor(void);
 
   Data get_data(const std::string &filename, bool tagged);
@@ -68,6 +116,7 @@ public:
 
   void set_options(const TaggerOptions &tagger_options);
   void set_param_filter(const TaggerOptions &options);
+  void set_quantization(Quantization quantization);
 
 private:
   unsigned int line_counter;
@@ -79,9 +128,23 @@ private:
 
   ParamTable param_table;
 
+  std::shared_ptr<MappedModel> mapped_model;
+
   std::ostream &msg_out;
 
   StringVector labels_to_strings(const LabelVector &v);
+
+  void warn_about_options(void);
+
+  void set_label_guesses(Sentence &s, Trellis &trellis, bool prune) const;
+  void set_map_assignment(Trellis &trellis) const;
+  void label_sentence(Sentence &s, Trellis &trellis, std::ostream &out) const;
+  void lemmatize_sentence(Sentence &s, std::ostream &out) const;
+  Sentence * read_stream_sentence(std::istream &in, 
+				  bool lemmatize,
+				  unsigned int &line);
+  void stream_worker(StreamQueue * queue, bool lemmatize);
+  void process_stream(std::istream &in, unsigned int threads, bool lemmatize);
 };
 
 #endif // HEADER_Tagger_hh
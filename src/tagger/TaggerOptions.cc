@@ -27,6 +27,7 @@ std::string strip(const std::string &str, const std::string &prefix);
 Estimator get_estimator(const std::string &str);
 Inference get_inference(const std::string &str);
 Filtering get_filter_type(const std::string &str);
+Quantization get_quantization(const std::string &str);
 Degree get_degree(const std::string &str);
 Regularization get_regularization(const std::string &str);
 unsigned int get_uint(const std::string &str); 
@@ -67,6 +68,12 @@ const char * sublabel_order_id = "sublabel_order=";
 const char * model_order_id = "model_order=";
 const char * guesses_id = "guesses=";
 const char * param_threshold_id = "param_threshold=";
+const char * quantization_id = "quantization=";
+const char * feature_hash_buckets_id = "feature_hash_buckets=";
+const char * train_threads_id = "train_threads=";
+const char * nbest_id = "nbest=";
+const char * coarse_threshold_id = "coarse_threshold=";
+const char * split_at_anchors_id = "split_at_anchors=";
 
 std::string despace(const std::string &line)
 {
@@ -81,7 +88,35 @@ std::string despace(const std::string &line)
   return res;
 }
 
-TaggerOptions::TaggerOptions(void)
+TaggerOptions::TaggerOptions(void):
+  estimator(AVG_PERC),
+  inference(MAP),
+  suffix_length(10),
+  degree(2),
+  max_train_passes(50),
+  max_lemmatizer_passes(50),
+  max_useless_passes(3),
+  guess_mass(0.99),
+  beam(-1),
+  beam_mass(-1),
+  regularization(NONE),
+  delta(0.01),
+  sigma(0.001),
+  use_label_dictionary(1),
+  guess_count_limit(50),
+  use_unstructured_sublabels(1),
+  use_structured_sublabels(1),
+  sublabel_order(FIRST),
+  model_order(SECOND),
+  guesses(-1),
+  param_threshold(-1),
+  filter_type(NO_FILTER),
+  quantization(NO_QUANT),
+  feature_hash_buckets(0),
+  train_threads(1),
+  nbest(1),
+  coarse_threshold(-1),
+  split_at_anchors(0)
 {}
 
 TaggerOptions::TaggerOptions(Estimator estimator, 
@@ -105,7 +140,13 @@ TaggerOptions::TaggerOptions(Estimator estimator,
 			     Degree model_order,
 			     int guesses,
 			     float param_threshold,
-			     Filtering filter_type):
+			     Filtering filter_type,
+			     Quantization quantization,
+			     unsigned int feature_hash_buckets,
+			     unsigned int train_threads,
+			     unsigned int nbest,
+			     float coarse_threshold,
+			     bool split_at_anchors):
   estimator(estimator),
   inference(inference),
   suffix_length(suffix_length),
@@ -127,7 +168,13 @@ TaggerOptions::TaggerOptions(Estimator estimator,
   model_order(model_order),
   guesses(guesses),
   param_threshold(param_threshold),
-  filter_type(filter_type)
+  filter_type(filter_type),
+  quantization(quantization),
+  feature_hash_buckets(feature_hash_buckets),
+  train_threads(train_threads),
+  nbest(nbest),
+  coarse_threshold(coarse_threshold),
+  split_at_anchors(split_at_anchors)
 {
 }
 
@@ -153,7 +200,13 @@ TaggerOptions::TaggerOptions(std::istream &in, unsigned int &counter):
   model_order(SECOND),
   guesses(-1),
   param_threshold(-1),
-  filter_type(NO_FILTER)
+  filter_type(NO_FILTER),
+  quantization(NO_QUANT),
+  feature_hash_buckets(0),
+  train_threads(1),
+  nbest(1),
+  coarse_threshold(-1),
+  split_at_anchors(0)
 {
   while (in)
     {
@@ -215,6 +268,23 @@ TaggerOptions::TaggerOptions(std::istream &in, unsigned int &counter):
 	{ guesses = get_int(strip(line, guesses_id)); }
       else if (line.find(param_threshold_id) != std::string::npos)
 	{ param_threshold = get_float(strip(line, param_threshold_id)); }
+      else if (line.find(quantization_id) != std::string::npos)
+	{ quantization = get_quantization(strip(line, quantization_id)); }
+      else if (line.find(feature_hash_buckets_id) != std::string::npos)
+	{ 
+	  feature_hash_buckets = get_uint(strip(line, feature_hash_buckets_id)); 
+
+	  if (feature_hash_buckets > MAX_FEATURE_HASH_BUCKETS)
+	    { throw NumericalRangeError(); }
+	}
+      else if (line.find(train_threads_id) != std::string::npos)
+	{ train_threads = get_uint(strip(line, train_threads_id)); }
+      else if (line.find(nbest_id) != std::string::npos)
+	{ nbest = get_uint(strip(line, nbest_id)); }
+      else if (line.find(coarse_threshold_id) != std::string::npos)
+	{ coarse_threshold = get_float(strip(line, coarse_threshold_id)); }
+      else if (line.find(split_at_anchors_id) != std::string::npos)
+	{ split_at_anchors = get_uint(strip(line, split_at_anchors_id)); }
       else
 	{ throw SyntaxError(); }
     }
@@ -252,6 +322,12 @@ void TaggerOptions::store(std::ostream &out) const
   field_names.push_back("guesses");
   field_names.push_back("param_threshold");
   field_names.push_back("filter_type");
+  field_names.push_back("quantization");
+  field_names.push_back("feature_hash_buckets");
+  field_names.push_back("train_threads");
+  field_names.push_back("nbest");
+  field_names.push_back("coarse_threshold");
+  field_names.push_back("split_at_anchors");
 
   fields.push_back(estimator);
   fields.push_back(inference);
@@ -275,6 +351,12 @@ void TaggerOptions::store(std::ostream &out) const
   fields.push_back(guesses);
   fields.push_back(param_threshold);
   fields.push_back(filter_type);
+  fields.push_back(quantization);
+  fields.push_back(feature_hash_buckets);
+  fields.push_back(train_threads);
+  fields.push_back(nbest);
+  fields.push_back(coarse_threshold);
+  fields.push_back(split_at_anchors);
 
   write_vector(out, field_names);
   write_vector(out, fields);
@@ -293,6 +375,15 @@ void TaggerOptions::load(std::istream &in, std::ostream &msg_out, bool reverse_b
 
   if (field_names.size() != fields.size())
     { throw BadBinary(); }
+
+  // Models stored before quantization, feature hashing and threaded
+  // training were added use none of them.
+  quantization = NO_QUANT;
+  feature_hash_buckets = 0;
+  train_threads = 1;
+  nbest = 1;
+  coarse_threshold = -1;
+  split_at_anchors = 0;
   
   for (unsigned int i = 0; i < field_names.size(); ++i)
     {
@@ -342,6 +433,23 @@ void TaggerOptions::load(std::istream &in, std::ostream &msg_out, bool reverse_b
 	{ guesses = static_cast<int>(fields[i]); }
       else if (field_names[i] == "param_threshold")
 	{ param_threshold = static_cast<float>(fields[i]); }
+      else if (field_names[i] == "quantization")
+	{ quantization = static_cast<Quantization>(fields[i]); }
+      else if (field_names[i] == "feature_hash_buckets")
+	{ 
+	  if (fields[i] < 0 or fields[i] > MAX_FEATURE_HASH_BUCKETS)
+	    { throw BadBinary(); }
+
+	  feature_hash_buckets = static_cast<unsigned int>(fields[i]); 
+	}
+      else if (field_names[i] == "train_threads")
+	{ train_threads = static_cast<unsigned int>(fields[i]); }
+      else if (field_names[i] == "nbest")
+	{ nbest = static_cast<unsigned int>(fields[i]); }
+      else if (field_names[i] == "coarse_threshold")
+	{ coarse_threshold = static_cast<float>(fields[i]); }
+      else if (field_names[i] == "split_at_anchors")
+	{ split_at_anchors = static_cast<unsigned int>(fields[i]); }
       else
 	{
 	  msg_out << "Found unknown parameter name " 
@@ -377,6 +485,8 @@ Inference get_inference(const std::string &str)
     { return MAP; }
   else if (str.find("MARGINAL") == 0)
     { return MARGINAL; }
+  else if (str.find("NBEST") == 0)
+    { return NBEST; }
   else
     { throw SyntaxError(); }
 }
@@ -393,6 +503,18 @@ Filtering get_filter_type(const std::string &str)
     { throw SyntaxError(); }
 }
 
+Quantization get_quantization(const std::string &str)
+{
+  if (str.find("NO_QUANT") == 0)
+    { return NO_QUANT; }
+  else if (str.find("FP16") == 0)
+    { return FP16; }
+  else if (str.find("INT8") == 0)
+    { return INT8; }
+  else
+    { throw SyntaxError(); }
+}
+
 Degree get_degree(const std::string &str)
 {
   if (str.find("NODEG") == 0)
@@ -472,7 +594,13 @@ bool TaggerOptions::operator==(const TaggerOptions &another) const
      guess_count_limit == another.guess_count_limit and
      guesses == another.guesses and
      param_threshold == another.param_threshold and
-     filter_type == another.filter_type)
+     filter_type == another.filter_type and
+     quantization == another.quantization and
+     feature_hash_buckets == another.feature_hash_buckets and
+     train_threads == another.train_threads and
+     nbest == another.nbest and
+     float_eq(coarse_threshold, another.coarse_threshold) and
+     split_at_anchors == another.split_at_anchors)
 ;
 }
 
@@ -514,7 +642,13 @@ int main(void)
 	 empty_options.model_order == SECOND &&
 	 empty_options.guesses == -1 &&
 	 empty_options.param_threshold == -1 and
-	 empty_options.filter_type == NO_FILTER
+	 empty_options.filter_type == NO_FILTER and
+	 empty_options.quantization == NO_QUANT and
+	 empty_options.feature_hash_buckets == 0 and
+	 empty_options.train_threads == 1 and
+	 empty_options.nbest == 1 and
+	 empty_options.coarse_threshold == -1 and
+	 empty_options.split_at_anchors == 0
 	 );
 
   counter = 0;
@@ -540,6 +674,12 @@ int main(void)
     "guesses=10\n"
     "param_threshold=11\n"
     "filter_type=UPDATE_COUNT\n"
+    "quantization=INT8\n"
+    "feature_hash_buckets=1024\n"
+    "train_threads=4\n"
+    "nbest=5\n"
+    "coarse_threshold=0.01\n"
+    "split_at_anchors=1\n"
     ;
 
   std::istringstream opt_file(opt_str);
@@ -567,6 +707,12 @@ int main(void)
   assert(options.guesses == 10);
   assert(options.param_threshold == 11);
   assert(options.filter_type == UPDATE_COUNT);
+  assert(options.quantization == INT8);
+  assert(options.feature_hash_buckets == 1024);
+  assert(options.train_threads == 4);
+  assert(options.nbest == 5);
+  assert(float_eq(options.coarse_threshold, 0.01));
+  assert(options.split_at_anchors == 1);
   counter = 0;
 
   try
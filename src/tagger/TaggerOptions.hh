@@ -28,8 +28,18 @@ enum Estimator
   { AVG_PERC, ML };
 
 enum Inference
-  { MAP, MARGINAL };
+  { MAP, MARGINAL, NBEST };
 
+// Regularization of ML training with penalty sigma. NONE still
+// shrinks each parameter that an update touches by 1 - sigma. L2
+// shrinks by 1 - sigma per token the unstructured parameters that pair
+// a feature of the word with one of its candidate labels (or their
+// sub labels), and lazily the structured parameters whose last label
+// is a candidate label, so its cost does not grow with the number of
+// parameters. L1 uses cumulative
+// penalties: each of the N training tokens adds delta * sigma / N to
+// the penalty, so a pass charges each parameter at most delta * sigma.
+// Concurrent training charges the penalty of a pass at its end.
 enum Regularization
   { NONE, L1, L2 };
 
@@ -39,6 +49,18 @@ enum Degree
 enum Filtering
   { AVG_VALUE, UPDATE_COUNT, NO_FILTER };
 
+// Quantization of the unstructured parameters of stored models. A
+// compiled model keeps a 2-byte label per parameter next to its 1-byte
+// int8 or 2-byte fp16 code, so it takes about 3 or 4 bytes per
+// parameter instead of 6. Mapped models hold the codes and use them in
+// place. Structured parameters are not quantized.
+enum Quantization
+  { NO_QUANT, FP16, INT8 };
+
+// Options are stored as floats in model files, which represent every
+// bucket count up to this value exactly.
+const unsigned int MAX_FEATURE_HASH_BUCKETS = 1 << 24;
+
 struct TaggerOptions
 {
   Estimator estimator;
@@ -63,6 +85,22 @@ struct TaggerOptions
   int guesses;
   float param_threshold;
   Filtering filter_type;
+  Quantization quantization;
+  unsigned int feature_hash_buckets;
+  unsigned int train_threads;
+  unsigned int nbest;
+
+  // If non-negative, labeling first computes the label marginals
+  // under the first order part of the model and removes the label
+  // guesses whose marginal is below coarse_threshold (see
+  // Trellis::prune_label_guesses). The best guess of each word is
+  // kept. This only makes decoding faster. The pruning pass ignores
+  // the trigram parameters, so it can remove labels that a second
+  // order model, especially one trained with the averaged perceptron,
+  // would choose. The MAP search is exact on the remaining guesses and
+  // can only lose accuracy.
+  float coarse_threshold;
+  bool split_at_anchors;
 
   TaggerOptions(void);
 
@@ -87,7 +125,13 @@ struct TaggerOptions
 		Degree model_order = SECOND,
 		int guesses = -1,
 		float param_threshold = -1,
-		Filtering filter_type = NO_FILTER);
+		Filtering filter_type = NO_FILTER,
+		Quantization quantization = NO_QUANT,
+		unsigned int feature_hash_buckets = 0,
+		unsigned int train_threads = 1,
+		unsigned int nbest = 1,
+		float coarse_threshold = -1,
+		bool split_at_anchors = 0);
   
   TaggerOptions(std::istream &in, unsigned int &counter);
 
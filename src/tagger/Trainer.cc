@@ -36,8 +36,17 @@ Trainer::Trainer(unsigned int max_passes,
   label_extractor(label_extractor),
   lemma_extractor(lemma_extractor),
   boundary_label(label_extractor.get_boundary_label()),
-  msg_out(msg_out)
-{ static_cast<void>(options); }
+  msg_out(msg_out),
+  train_threads(options.train_threads == 0 ? 1 : options.train_threads)
+{
+  // Update counts are not kept in concurrent mode.
+  if (train_threads > 1 and options.filter_type == UPDATE_COUNT)
+    {
+      msg_out << "Update count filtering requires train_threads=1. "
+	      << "Using one thread." << std::endl;
+      train_threads = 1;
+    }
+}
 
 #else // TEST_Trainer_cc
 
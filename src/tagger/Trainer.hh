@@ -29,6 +29,10 @@
 #include "ParamTable.hh"
 #include "TaggerOptions.hh"
 
+// Number of sentences each thread processes between two
+// synchronization points in multi-threaded training.
+const unsigned int SENTENCES_PER_THREAD = 8;
+
 class Trainer
 {
 public:
@@ -62,6 +66,8 @@ protected:
   unsigned int boundary_label;
 
   std::ostream &msg_out;
+
+  unsigned int train_threads;
 };
 
 #endif // HEADER_Trainer_hh
@@ -29,15 +29,14 @@
 #include <cfloat>
 
 #include "Word.hh"
+#include "LogSumExp.hh"
 
 void normalize(std::vector<float> &v)
 {
-  float total = -FLT_MAX;
+  if (v.empty())
+    { return; }
 
-  for (unsigned int i = 0; i < v.size(); ++i)
-    { 
-      total = expsumlog(total, v[i]);
-    }
+  float total = log_sum_exp(&v[0], v.size());
 
     for (unsigned int i = 0; i < v.size(); ++i)
     { 
@@ -50,33 +49,164 @@ Trellis::Trellis(Sentence &sent,
 		 Degree sublabel_order,
 		 Degree model_order,
 		 unsigned int beam):
-  s(&sent),
+  s(0),
+  marginals_set(0),
+  column_count(0),
+  bw(boundary_label),
+  boundary_label(boundary_label),
+  beam(beam),
+  use_beam_mass(0),
+  beam_mass(-1),
+  sublabel_order(sublabel_order),
+  model_order(model_order)
+{
+  set_sentence(sent);
+}
+
+Trellis::Trellis(unsigned int boundary_label,
+		 Degree sublabel_order,
+		 Degree model_order,
+		 unsigned int beam):
+  s(0),
   marginals_set(0),
+  column_count(0),
   bw(boundary_label),
+  boundary_label(boundary_label),
   beam(beam),
+  use_beam_mass(0),
+  beam_mass(-1),
   sublabel_order(sublabel_order),
   model_order(model_order)
+{}
+
+void Trellis::set_sentence(Sentence &sent)
 {
-  reserve(sent.size(), boundary_label);
+  s = &sent;
+  marginals_set = 0;
+
+  set_columns(0, sent.size());
+}
 
-  for (unsigned int i = 0; i < sent.size(); ++i)
+void Trellis::set_columns(unsigned int begin, unsigned int end)
+{
+  column_count = end - begin;
+
+  reserve(column_count);
+
+  for (unsigned int i = 0; i < column_count; ++i)
     { 
-      trellis[i].set_word(sent.at(i),
-			  i == 0 ? 1 : sent.at(i - 1).get_label_count());
+      trellis[i].set_word(s->at(begin + i),
+			  i == 0 ? 1 : s->at(begin + i - 1).get_label_count());
     }
 
-  for (unsigned int i = 0; i < sent.size() - 1; ++i)
+  for (unsigned int i = 0; i + 1 < column_count; ++i)
     { 
       trellis[i].set_ncol(&trellis[i+1]); 
     }
+
+  if (column_count > 0)
+    { trellis[column_count - 1].set_ncol(0); }
+}
+
+void Trellis::prune_label_guesses(const ParamTable &pt, float threshold)
+{
+  if (column_count == 0)
+    { return; }
+
+  set_emission_scores(pt);
+
+  if (coarse_fw.size() < column_count)
+    {
+      coarse_fw.resize(column_count);
+      coarse_bw.resize(column_count);
+    }
+
+  for (unsigned int i = 0; i < column_count; ++i)
+    {
+      unsigned int label_count = trellis[i].get_label_count();
+
+      coarse_fw[i].resize(label_count);
+      coarse_bw[i].resize(label_count);
+
+      for (unsigned int j = 0; j < label_count; ++j)
+	{
+	  unsigned int label = trellis[i].get_label(j);
+	  float em = trellis[i].get_emission_score(j);
+
+	  if (i == 0)
+	    {
+	      coarse_fw[i][j] = em + 
+		pt.get_all_struct_fw(boundary_label, boundary_label, label, 
+				     sublabel_order, FIRST);
+	      continue;
+	    }
+
+	  unsigned int plabel_count = trellis[i - 1].get_label_count();
+	  coarse_row.resize(plabel_count);
+
+	  for (unsigned int k = 0; k < plabel_count; ++k)
+	    {
+	      unsigned int plabel = trellis[i - 1].get_label(k);
+	      coarse_row[k] = coarse_fw[i - 1][k] + 
+		pt.get_all_struct_fw(boundary_label, plabel, label, 
+				     sublabel_order, FIRST);
+	    }
+
+	  coarse_fw[i][j] = em + log_sum_exp(&coarse_row[0], plabel_count);
+	}
+    }
+
+  for (unsigned int i = column_count; i > 0; --i)
+    {
+      unsigned int c = i - 1;
+      unsigned int label_count = trellis[c].get_label_count();
+
+      for (unsigned int j = 0; j < label_count; ++j)
+	{
+	  if (c + 1 == column_count)
+	    {
+	      coarse_bw[c][j] = 0;
+	      continue;
+	    }
+
+	  unsigned int label = trellis[c].get_label(j);
+	  unsigned int nlabel_count = trellis[c + 1].get_label_count();
+	  coarse_row.resize(nlabel_count);
+
+	  for (unsigned int k = 0; k < nlabel_count; ++k)
+	    {
+	      unsigned int nlabel = trellis[c + 1].get_label(k);
+	      coarse_row[k] = coarse_bw[c + 1][k] + 
+		trellis[c + 1].get_emission_score(k) + 
+		pt.get_all_struct_fw(boundary_label, label, nlabel, 
+				     sublabel_order, FIRST);
+	    }
+
+	  coarse_bw[c][j] = log_sum_exp(&coarse_row[0], nlabel_count);
+	}
+    }
+
+  std::vector<float> &last_fw = coarse_fw[column_count - 1];
+  float total = log_sum_exp(&last_fw[0], last_fw.size());
+
+  for (unsigned int i = 0; i < column_count; ++i)
+    {
+      for (unsigned int j = 0; j < coarse_fw[i].size(); ++j)
+	{ coarse_fw[i][j] = exp(coarse_fw[i][j] + coarse_bw[i][j] - total); }
+
+      s->at(i).prune_label_guesses(coarse_fw[i], threshold);
+    }
+
+  set_sentence(*s);
 }
 
 LabelVector Trellis::get_maximum_a_posteriori_assignment(const ParamTable &pt)
 {
   LabelVector res;
 
-  trellis.back().compute_viterbi(pt);
-  trellis.back().set_labels(res);
+  set_emission_scores(pt);
+  compute_viterbi(pt);
+  trellis[column_count - 1].set_labels(res);
 
   return res;
 }
@@ -120,6 +250,57 @@ void Trellis::set_maximum_a_posteriori_assignment(const ParamTable &pt)
     }
 }
 
+bool Trellis::is_anchor(unsigned int position) const
+{
+  // Boundary words may list the boundary label more than once.
+  return (s->at(position).get_label_count() == 1 or 
+	  s->at(position).get_word_form() == BOUNDARY_WF);
+}
+
+void Trellis::set_segment_assignment(const ParamTable &pt,
+				     unsigned int begin,
+				     unsigned int end)
+{
+  bool anchored = 1;
+
+  for (unsigned int i = begin; i < end; ++i)
+    { anchored = anchored and is_anchor(i); }
+
+  if (anchored)
+    {
+      for (unsigned int i = begin; i < end; ++i)
+	{ s->at(i).set_label(s->at(i).get_label(0)); }
+
+      return;
+    }
+
+  set_columns(begin, end);
+
+  LabelVector labels = get_maximum_a_posteriori_assignment(pt);
+
+  assert(labels.size() == end - begin);
+
+  for (unsigned int i = 0; i < labels.size(); ++i)
+    { s->at(begin + i).set_label(labels[i]); }
+}
+
+void Trellis::set_anchored_maximum_a_posteriori_assignment
+(const ParamTable &pt)
+{
+  unsigned int begin = 0;
+
+  for (unsigned int i = 1; i + 1 < s->size(); ++i)
+    {
+      if (i > begin and is_anchor(i) and is_anchor(i + 1))
+	{
+	  set_segment_assignment(pt, begin, i + 2);
+	  begin = i;
+	}
+    }
+
+  set_segment_assignment(pt, begin, s->size());
+}
+
 void Trellis::set_marginalized_max_assignment(const ParamTable &pt)
 {
   LabelVector labels = get_marginalized_max_assignment(pt);
@@ -132,11 +313,16 @@ void Trellis::set_marginalized_max_assignment(const ParamTable &pt)
 
 void Trellis::reserve_marginals(void)
 {  
-  trigram_marginals.assign(trellis.size(), std::vector<float>());
-  bigram_marginals.assign(trellis.size(), std::vector<float>());
-  unigram_marginals.assign(trellis.size(), std::vector<float>());
+  // The vectors are only grown, so a reused trellis does not
+  // allocate.
+  if (trigram_marginals.size() < column_count)
+    {
+      trigram_marginals.resize(column_count);
+      bigram_marginals.resize(column_count);
+      unigram_marginals.resize(column_count);
+    }
 
-  for (unsigned int i = 0; i < trellis.size(); ++i)
+  for (unsigned int i = 0; i < column_count; ++i)
     {
       unsigned int labels = trellis[i].get_label_count();
       unigram_marginals[i].assign(labels, 0); 
@@ -147,7 +333,10 @@ void Trellis::reserve_marginals(void)
       bigram_marginals[i].assign(label_bigrams, 0); 
 
       if (i < 2)
-	{ continue; }
+	{ 
+	  trigram_marginals[i].clear();
+	  continue; 
+	}
 
       unsigned int label_trigrams = 
 	label_bigrams * trellis[i - 2].get_label_count();
@@ -159,7 +348,7 @@ void Trellis::reserve_marginals(void)
 
 void Trellis::set_unigram_marginals(void)
 {
-  for (unsigned int i = 0; i < trellis.size(); ++i)
+  for (unsigned int i = 0; i < column_count; ++i)
     {
       for (unsigned int l = 0; l < trellis[i].get_label_count(); ++l)
 	{
@@ -181,7 +370,7 @@ void Trellis::set_unigram_marginals(void)
 
 void Trellis::set_bigram_marginals(void)
 {
-  for (unsigned int i = 0; i < trellis.size(); ++i)
+  for (unsigned int i = 0; i < column_count; ++i)
     {
       for (unsigned int l = 0; l < trellis[i].get_label_count(); ++l)
 	{
@@ -198,27 +387,27 @@ void Trellis::set_bigram_marginals(void)
 
 void Trellis::set_trigram_marginals(const ParamTable &pt)
 {
-  for (unsigned int i = 2; i < trellis.size(); ++i)
+  for (unsigned int i = 2; i < column_count; ++i)
     {
       for (unsigned int l = 0; l < trellis[i].get_label_count(); ++l)
 	{
-	  unsigned int label = trellis[i].get_cell(0, l).label;
+	  unsigned int label = trellis[i].get_label(l);
 
 	  for (unsigned int pl = 0; pl < trellis[i-1].get_label_count(); ++pl)
 	    {
-	      unsigned int plabel = trellis[i - 1].get_cell(0, pl).label;
+	      unsigned int plabel = trellis[i - 1].get_label(pl);
 
 	      for (unsigned int ppl = 0; 
 		   ppl < trellis[i-2].get_label_count(); 
 		   ++ppl)
 		{		 
-		  unsigned int pplabel = trellis[i - 2].get_cell(0, ppl).label;
+		  unsigned int pplabel = trellis[i - 2].get_label(ppl);
 
 		  trigram_marginals[i][get_index(i, l, pl, ppl)] =
 		    trellis[i - 1].get_fw(ppl, pl) + 
 		    trellis[i].get_bw(pl, l) + 
 		    pt.get_all_struct_fw(pplabel, plabel, label, sublabel_order, model_order) +
-		    pt.get_all_unstruct(s->at(i), label, sublabel_order);
+		    trellis[i].get_emission_score(l);
 		}
 	    }
 	}
@@ -232,8 +421,9 @@ void Trellis::set_marginals(const ParamTable &pt)
 
   marginals_set = 1;
 
-  trellis[0].compute_bw(pt);
-  trellis.back().compute_fw(pt);
+  set_emission_scores(pt);
+  compute_bw(pt);
+  compute_fw(pt);
 
   reserve_marginals();
 
@@ -241,10 +431,10 @@ void Trellis::set_marginals(const ParamTable &pt)
   set_unigram_marginals();
   set_trigram_marginals(pt);
 
-  if (trellis.size() > 0)
+  if (column_count > 0)
     { normalize(unigram_marginals[0]); }
 
-  for (unsigned int i = 1; i < trellis.size(); ++i)
+  for (unsigned int i = 1; i < column_count; ++i)
     {
       normalize(unigram_marginals[i]);
       normalize(trigram_marginals[i]);
@@ -252,6 +442,49 @@ void Trellis::set_marginals(const ParamTable &pt)
     }
 }
 
+void Trellis::set_emission_scores(const ParamTable &pt)
+{
+  for (unsigned int i = 0; i < column_count; ++i)
+    { trellis[i].set_emission_scores(pt); }
+}
+
+void Trellis::compute_fw(const ParamTable &pt)
+{
+  for (unsigned int i = 0; i < column_count; ++i)
+    { trellis[i].compute_fw(pt); }
+}
+
+void Trellis::compute_bw(const ParamTable &pt)
+{
+  for (unsigned int i = column_count; i > 0; --i)
+    { trellis[i - 1].compute_bw(pt); }
+}
+
+void Trellis::compute_viterbi(const ParamTable &pt)
+{
+  for (unsigned int i = 0; i < column_count; ++i)
+    { trellis[i].compute_viterbi(pt); }
+}
+
+void Trellis::get_nbest_assignments(const ParamTable &pt,
+				    unsigned int nbest,
+				    std::vector<LabelVector> &paths,
+				    std::vector<float> &scores)
+{
+  paths.clear();
+  scores.clear();
+
+  if (column_count == 0 or nbest == 0)
+    { return; }
+
+  set_emission_scores(pt);
+
+  for (unsigned int i = 0; i < column_count; ++i)
+    { trellis[i].compute_nbest(pt, nbest); }
+
+  trellis[column_count - 1].set_nbest_labels(paths, scores);
+}
+
 float Trellis::get_marginal(unsigned int position, 
 			    unsigned int label) const
 {
@@ -280,29 +513,37 @@ float Trellis::get_marginal(unsigned int position,
 
 unsigned int Trellis::size(void) const
 { 
-  return trellis.size(); 
+  return column_count; 
 }
 
 void Trellis::set_beam_mass(float mass)
 {
+  use_beam_mass = 1;
+  beam_mass = mass;
+
   for (unsigned int i = 0; i < trellis.size(); ++i)
     { trellis.at(i).set_beam_mass(mass); }
 }
 
 void Trellis::set_beam(unsigned int beam)
 {
+  this->beam = beam;
+
   for (unsigned int i = 0; i < trellis.size(); ++i)
     { trellis.at(i).set_beam(beam); }
 }
 
-void Trellis::reserve(unsigned int n, unsigned int boundary_label)
+void Trellis::reserve(unsigned int n)
 { 
-  trellis.insert(trellis.end(), 
-		 n, 
-		 TrellisColumn(boundary_label, 
-			       beam,
-			       sublabel_order,
-			       model_order));
+  if (trellis.size() >= n)
+    { return; }
+
+  TrellisColumn column(boundary_label, beam, sublabel_order, model_order);
+
+  if (use_beam_mass)
+    { column.set_beam_mass(beam_mass); }
+
+  trellis.insert(trellis.end(), n - trellis.size(), column);
 }
 
 unsigned int Trellis::get_index(unsigned int position, 
@@ -366,8 +607,10 @@ public:
 #include <cassert>
 #include <cfloat>
 #include <cmath>
+#include <algorithm>
+#include <functional>
 
-bool float_eq(float f1, float f2)
+bool float_equals(float f1, float f2)
 {
   return fabs(f1 - f2) < 0.0001;
 }
@@ -433,24 +676,24 @@ int main(void)
   pt.update_unstruct(5, 1, 4.386);
   pt.update_unstruct(5, 9, 1.145);
 
-  pt.update_struct3(0,0,1,6.521);
-  pt.update_struct3(0,0,9,7.494);
-  pt.update_struct2(0,9,5.891, false);
-  pt.update_struct2(0,1,0.883, false);
-  pt.update_struct1(9,2.275);
-  pt.update_struct1(1,3.68);
+  pt.update_struct3(0,0,1,6.521, NODEG);
+  pt.update_struct3(0,0,9,7.494, NODEG);
+  pt.update_struct2(0,9,5.891, NODEG);
+  pt.update_struct2(0,1,0.883, NODEG);
+  pt.update_struct1(9,2.275, NODEG);
+  pt.update_struct1(1,3.68, NODEG);
 
-  pt.update_struct3(1,1,1,5.206);
-  pt.update_struct3(1,1,9,4.958);
-  pt.update_struct2(1,1,3.883, false);
-  pt.update_struct2(1,9,4.309, false);
+  pt.update_struct3(1,1,1,5.206, NODEG);
+  pt.update_struct3(1,1,9,4.958, NODEG);
+  pt.update_struct2(1,1,3.883, NODEG);
+  pt.update_struct2(1,9,4.309, NODEG);
 
-  pt.update_struct3(1,9,1,9.494);
-  pt.update_struct3(1,9,9,6.355);
-  pt.update_struct2(9,1,0.358, false);
-  pt.update_struct2(9,9,6.690, false);
+  pt.update_struct3(1,9,1,9.494, NODEG);
+  pt.update_struct3(1,9,9,6.355, NODEG);
+  pt.update_struct2(9,1,0.358, NODEG);
+  pt.update_struct2(9,9,6.690, NODEG);
 
-  Trellis trellis(s, 0);
+  Trellis trellis(s, 0, NODEG, SECOND);
   trellis.set_marginals(pt);
 
   LabelVector v = trellis.get_maximum_a_posteriori_assignment(pt);
@@ -470,7 +713,7 @@ int main(void)
   float pos_3_l_1_0_score = -FLT_MAX;
   float pos_3_l_1_0_1_score = -FLT_MAX;
 
-  std::vector<unsigned int> max_label_indices(3, -1);
+  std::vector<float> path_scores;
   
   for (unsigned int i = 0; i < 2; ++i)
     {
@@ -487,23 +730,24 @@ int main(void)
 	      f += pt.get_unstruct(4, labels[k]);
 	      f += pt.get_unstruct(5, labels[k]);
 
-	      f += pt.get_struct3(0, 0, labels[i]);
-	      f += pt.get_struct2(0, labels[i], false);
-	      f += pt.get_struct1(labels[i]);
+	      f += pt.get_struct3(0, 0, labels[i], NODEG);
+	      f += pt.get_struct2(0, labels[i], NODEG);
+	      f += pt.get_struct1(labels[i], NODEG);
 
-	      f += pt.get_struct3(0, labels[i], labels[j]);
-	      f += pt.get_struct2(labels[i], labels[j], false);
-	      f += pt.get_struct1(labels[j]);
+	      f += pt.get_struct3(0, labels[i], labels[j], NODEG);
+	      f += pt.get_struct2(labels[i], labels[j], NODEG);
+	      f += pt.get_struct1(labels[j], NODEG);
 
-	      f += pt.get_struct3(labels[i], labels[j], labels[k]);
-	      f += pt.get_struct2(labels[j], labels[k], false);
-	      f += pt.get_struct1(labels[k]);
+	      f += pt.get_struct3(labels[i], labels[j], labels[k], NODEG);
+	      f += pt.get_struct2(labels[j], labels[k], NODEG);
+	      f += pt.get_struct1(labels[k], NODEG);
 	      
-	      f += pt.get_struct3(labels[j], labels[k], 0);
-	      f += pt.get_struct3(labels[k], 0, 0);
-	      f += pt.get_struct2(labels[k], 0, false);
+	      f += pt.get_struct3(labels[j], labels[k], 0, NODEG);
+	      f += pt.get_struct3(labels[k], 0, 0, NODEG);
+	      f += pt.get_struct2(labels[k], 0, NODEG);
 
 	      tot_score = expsumlog(tot_score, f);
+	      path_scores.push_back(f);
 	      
 	      if (k == 1)
 		{
@@ -524,12 +768,162 @@ int main(void)
 	}
     }
 
-  assert(float_eq(exp(pos_3_l_1_score - tot_score), 
+  assert(float_equals(exp(pos_3_l_1_score - tot_score), 
 		  trellis.get_marginal(3,1)));
-  assert(float_eq(exp(pos_3_l_1_0_score - tot_score), 
+  assert(float_equals(exp(pos_3_l_1_0_score - tot_score), 
 		  trellis.get_marginal(3,0,1)));
-  assert(float_eq(exp(pos_3_l_1_0_1_score - tot_score), 
+  assert(float_equals(exp(pos_3_l_1_0_1_score - tot_score), 
 		  trellis.get_marginal(3,1,0,1)));  
+
+  // The best path equals the MAP assignment. The n-best list has one
+  // entry for each of the 8 label sequences in best first order and
+  // its scores are the brute force path scores.
+  std::vector<LabelVector> paths;
+  std::vector<float> scores;
+
+  trellis.get_nbest_assignments(pt, 1, paths, scores);
+
+  assert(paths.size() == 1);
+  assert(paths[0] == v);
+
+  trellis.get_nbest_assignments(pt, 10, paths, scores);
+
+  assert(paths.size() == 8);
+  assert(scores.size() == 8);
+  assert(paths[0] == v);
+
+  std::sort(path_scores.begin(), path_scores.end(), std::greater<float>());
+
+  for (unsigned int i = 0; i < paths.size(); ++i)
+    {
+      assert(paths[i].size() == s.size());
+      assert(float_equals(scores[i], path_scores[i]));
+      assert(i == 0 or scores[i] <= scores[i - 1]);
+
+      for (unsigned int j = 0; j < i; ++j)
+	{ assert(paths[i] != paths[j]); }
+    }
+
+  // Brute force label marginals of "dog cat horse" under the first
+  // order part of the model, which prune_label_guesses uses.
+  std::vector<std::vector<float> > coarse_marginals
+    (3, std::vector<float>(2, -FLT_MAX));
+  float coarse_tot_score = -FLT_MAX;
+
+  for (unsigned int i = 0; i < 2; ++i)
+    {
+      for (unsigned int j = 0; j < 2; ++j)
+	{
+	  for (unsigned int k = 0; k < 2; ++k)
+	    {
+	      float f = 0;
+
+	      f += pt.get_unstruct(0, labels[i]);
+	      f += pt.get_unstruct(1, labels[i]);
+	      f += pt.get_unstruct(2, labels[j]);
+	      f += pt.get_unstruct(3, labels[j]);
+	      f += pt.get_unstruct(4, labels[k]);
+	      f += pt.get_unstruct(5, labels[k]);
+
+	      f += pt.get_struct2(0, labels[i], NODEG);
+	      f += pt.get_struct1(labels[i], NODEG);
+	      f += pt.get_struct2(labels[i], labels[j], NODEG);
+	      f += pt.get_struct1(labels[j], NODEG);
+	      f += pt.get_struct2(labels[j], labels[k], NODEG);
+	      f += pt.get_struct1(labels[k], NODEG);
+	      f += pt.get_struct2(labels[k], 0, NODEG);
+
+	      coarse_tot_score = expsumlog(coarse_tot_score, f);
+	      coarse_marginals[0][i] = expsumlog(coarse_marginals[0][i], f);
+	      coarse_marginals[1][j] = expsumlog(coarse_marginals[1][j], f);
+	      coarse_marginals[2][k] = expsumlog(coarse_marginals[2][k], f);
+	    }
+	}
+    }
+
+  // A threshold of 0 keeps every guess. A threshold above every
+  // marginal leaves only the guess with the highest marginal in each
+  // word, and a threshold between the marginals of a word prunes the
+  // worse guess of that word only.
+  Sentence unpruned(words, label_extractor, 2);
+  Trellis unpruned_trellis(unpruned, 0, NODEG, SECOND);
+  unpruned_trellis.prune_label_guesses(pt, 0);
+
+  for (unsigned int i = 0; i < 3; ++i)
+    { assert(unpruned.at(i + 1).get_label_count() == 2); }
+
+  assert(unpruned_trellis.get_maximum_a_posteriori_assignment(pt) == v);
+
+  Sentence pruned(words, label_extractor, 2);
+  Trellis pruned_trellis(pruned, 0, NODEG, SECOND);
+  pruned_trellis.prune_label_guesses(pt, 1.1);
+
+  for (unsigned int i = 0; i < 3; ++i)
+    {
+      unsigned int best = 
+	(coarse_marginals[i][1] > coarse_marginals[i][0] ? 1 : 0);
+
+      assert(pruned.at(i + 1).get_label_count() == 1);
+      assert(pruned.at(i + 1).get_label(0) == labels[best]);
+    }
+
+  float dog_marginal = exp(coarse_marginals[0][0] - coarse_tot_score);
+  float threshold = (dog_marginal < 0.5 ? dog_marginal : 1 - dog_marginal);
+
+  Sentence dog_pruned(words, label_extractor, 2);
+  Trellis dog_pruned_trellis(dog_pruned, 0, NODEG, SECOND);
+  dog_pruned_trellis.prune_label_guesses(pt, threshold + 0.0001);
+
+  assert(dog_pruned.at(1).get_label_count() == 1);
+  assert(dog_pruned.at(1).get_label(0) == pruned.at(1).get_label(0));
+
+  for (unsigned int i = 1; i < 3; ++i)
+    {
+      float marginal = exp(coarse_marginals[i][0] - coarse_tot_score);
+
+      if (marginal > threshold + 0.0001 and 
+	  1 - marginal > threshold + 0.0001)
+	{ assert(dog_pruned.at(i + 1).get_label_count() == 2); }
+    }
+
+  // The anchors "a b" split "dog cat a b horse dog" in two segments,
+  // which are decoded separately. The labeling equals the MAP
+  // assignment of the whole sentence. The trigram (1, 9, 1) makes the
+  // label of "horse" depend on both anchors.
+  ParamTable anchored_pt;
+  anchored_pt.set_params(pt);
+  anchored_pt.update_struct3(1, 9, 1, 30, NODEG);
+
+  FeatureTemplateVector anchor_feats;
+  anchor_feats.push_back(1);
+
+  Word a("a", anchor_feats, LabelVector(1, 1), "foo");
+  Word b("b", anchor_feats, LabelVector(1, 9), "foo");
+
+  WordVector anchored_words;
+  anchored_words.push_back(dog);
+  anchored_words.push_back(cat);
+  anchored_words.push_back(a);
+  anchored_words.push_back(b);
+  anchored_words.push_back(horse);
+  anchored_words.push_back(dog);
+
+  Sentence unsegmented(anchored_words, label_extractor, 2);
+  Trellis unsegmented_trellis(unsegmented, 0, NODEG, SECOND);
+  unsegmented_trellis.set_maximum_a_posteriori_assignment(anchored_pt);
+
+  Sentence segmented(anchored_words, label_extractor, 2);
+  Trellis segmented_trellis(segmented, 0, NODEG, SECOND);
+  segmented_trellis.set_anchored_maximum_a_posteriori_assignment(anchored_pt);
+
+  assert(segmented.size() == unsegmented.size());
+
+  for (unsigned int i = 0; i < segmented.size(); ++i)
+    { assert(segmented.at(i).get_label() == unsegmented.at(i).get_label()); }
+
+  assert(segmented.at(3).get_label() == 1);
+  assert(segmented.at(4).get_label() == 9);
+  assert(segmented.at(5).get_label() == 1);
 }
 
 #endif // TEST_Trellis_cc
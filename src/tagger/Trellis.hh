@@ -35,10 +35,44 @@ class Trellis
 public:
   Trellis(Sentence &s, unsigned int boundary_label, Degree sublabel_order, Degree model_order, unsigned int beam=-1);
 
+  // Construct an empty trellis that is filled by set_sentence. 
+  Trellis(unsigned int boundary_label, Degree sublabel_order, Degree model_order, unsigned int beam=-1);
+
+  // Reuse the trellis for @p s. Columns and marginal tables are only
+  // ever grown, so a trellis that is reused for many sentences stops
+  // allocating memory once it has seen the longest sentence. Beam
+  // settings are kept.
+  void set_sentence(Sentence &s);
+
+  // Coarse-to-fine decoding. Compute the marginals of the labels of
+  // each word under the first order model given by the unigram and
+  // bigram parameters in @p pt. Then remove the label guesses of the
+  // words in the sentence whose marginal is below @p threshold and
+  // reset the trellis for the pruned sentence.
+  void prune_label_guesses(const ParamTable &pt, float threshold);
+
   LabelVector get_maximum_a_posteriori_assignment(const ParamTable &pt);
   LabelVector get_marginalized_max_assignment(const ParamTable &pt);
 
+  // Store the @p nbest best label sequences, best first, in @p paths
+  // and their unnormalized scores in @p scores. The sequences include
+  // the labels of the boundary words. Unlike the MAP assignment, the
+  // search is exact and ignores the beam.
+  void get_nbest_assignments(const ParamTable &pt,
+			     unsigned int nbest,
+			     std::vector<LabelVector> &paths,
+			     std::vector<float> &scores);
+
   void set_maximum_a_posteriori_assignment(const ParamTable &pt);
+
+  // Two consecutive words with one label guess each separate a second
+  // order model. Split the sentence into segments at such anchors and
+  // decode each segment separately, which gives the same result as
+  // set_maximum_a_posteriori_assignment. Segments that consist of
+  // anchors only are labeled without the trellis. Afterwards, the
+  // trellis holds the last segment and has to be reset with
+  // set_sentence before it is used for other inference.
+  void set_anchored_maximum_a_posteriori_assignment(const ParamTable &pt);
   void set_marginalized_max_assignment(const ParamTable &pt);
 
   void set_marginals(const ParamTable &pt);
@@ -64,20 +98,39 @@ private:
   Sentence * s;
   bool marginals_set;
 
+  // Number of columns in use. trellis may hold more columns, which
+  // are kept for later sentences.
+  unsigned int column_count;
   std::vector<TrellisColumn> trellis;
 
   std::vector<std::vector<float> > trigram_marginals;
   std::vector<std::vector<float> > bigram_marginals;
   std::vector<std::vector<float> > unigram_marginals;
 
+  // First order forward and backward scores for prune_label_guesses.
+  std::vector<std::vector<float> > coarse_fw;
+  std::vector<std::vector<float> > coarse_bw;
+  std::vector<float> coarse_row;
+
   Word bw;
+  unsigned int boundary_label;
 
   unsigned int beam;
+  bool use_beam_mass;
+  float beam_mass;
 
   Degree sublabel_order;
   Degree model_order;
 
-  void reserve(unsigned int n, unsigned int boundary_label);
+  void reserve(unsigned int n);
+
+  // Fill the columns with the words begin, ..., end - 1 of s.
+  void set_columns(unsigned int begin, unsigned int end);
+
+  bool is_anchor(unsigned int position) const;
+  void set_segment_assignment(const ParamTable &pt,
+			      unsigned int begin,
+			      unsigned int end);
 
   unsigned int get_index(unsigned int position, 
 			 unsigned int l_index,
@@ -86,6 +139,11 @@ private:
 
   void reserve_marginals(void);
 
+  void set_emission_scores(const ParamTable &pt);
+  void compute_fw(const ParamTable &pt);
+  void compute_bw(const ParamTable &pt);
+  void compute_viterbi(const ParamTable &pt);
+
   void set_unigram_marginals(void);
   void set_bigram_marginals(void);
   void set_trigram_marginals(const ParamTable &pt);
@@ -30,8 +30,137 @@ float expsumlog(float x, float y);
 #include <cmath>
 #include <cfloat>
 
+#include "LogSumExp.hh"
+
 #define STRUCT_SL 1
 #define UNSTRUCT_SL 1
+
+// The adaptive beam keeps between MIN_ADAPTIVE_BEAM_CELLS and
+// MAX_ADAPTIVE_BEAM_CELLS cells.
+static const unsigned int MIN_ADAPTIVE_BEAM_CELLS = 6;
+static const unsigned int MAX_ADAPTIVE_BEAM_CELLS = 202;
+
+CmpBeamPosition::CmpBeamPosition(const std::vector<unsigned int> &cells,
+				 const std::vector<float> &viterbi_scores):
+  cells(&cells),
+  viterbi_scores(&viterbi_scores)
+{}
+
+bool CmpBeamPosition::operator() (unsigned int pos1, 
+				  unsigned int pos2) const
+{
+  float score1 = (*viterbi_scores)[(*cells)[pos1]];
+  float score2 = (*viterbi_scores)[(*cells)[pos2]];
+
+  return (score1 > score2 or (score1 == score2 and pos1 < pos2));
+}
+
+bool CmpNBestEntry::operator() (const NBestEntry &e1, 
+				const NBestEntry &e2) const
+{
+  if (e1.score != e2.score)
+    { return e1.score < e2.score; }
+
+  if (e1.pcell != e2.pcell)
+    { return e1.pcell > e2.pcell; }
+
+  return e1.prank > e2.prank;
+}
+
+// Score policies for the decoding kernels. DynamicScores works for
+// any ParamTable. CompiledScores is used when the parameters are
+// compiled for the orders of the column and is specialized on the
+// model order and on whether sub labels are used.
+struct DynamicScores
+{
+  DynamicScores(const ParamTable &pt, 
+		Degree sublabel_order, 
+		Degree model_order):
+    pt(pt),
+    sublabel_order(sublabel_order),
+    model_order(model_order)
+  {}
+
+  float get_struct_fw(unsigned int pplabel, 
+		      unsigned int plabel, 
+		      unsigned int label) const
+  { 
+    return pt.get_all_struct_fw(pplabel, plabel, label, 
+				sublabel_order, model_order); 
+  }
+
+  float get_unstruct(const Word &word, unsigned int label) const
+  { return pt.get_all_unstruct(word, label, sublabel_order); }
+
+  const ParamTable &pt;
+  Degree sublabel_order;
+  Degree model_order;
+};
+
+template <Degree MODEL_ORDER, bool SUBLABELS>
+struct CompiledScores
+{
+  CompiledScores(const ParamTable &pt):
+    pt(pt)
+  {}
+
+  float get_struct_fw(unsigned int pplabel, 
+		      unsigned int plabel, 
+		      unsigned int label) const
+  { return pt.get_compiled_struct_fw<MODEL_ORDER>(pplabel, plabel, label); }
+
+  float get_unstruct(const Word &word, unsigned int label) const
+  { return pt.get_compiled_all_unstruct<SUBLABELS>(word, label); }
+
+  const ParamTable &pt;
+};
+
+struct TrellisColumn::EmissionKernel
+{
+  TrellisColumn * column;
+
+  template <class Scores> void operator() (const Scores &scores) const
+  { column->set_emission_scores_kernel(scores); }
+};
+
+struct TrellisColumn::ViterbiKernel
+{
+  TrellisColumn * column;
+
+  template <class Scores> void operator() (const Scores &scores) const
+  { column->compute_viterbi_kernel(scores); }
+};
+
+struct TrellisColumn::NBestKernel
+{
+  TrellisColumn * column;
+  unsigned int nbest;
+
+  template <class Scores> void operator() (const Scores &scores) const
+  { column->compute_nbest_kernel(scores, nbest); }
+};
+
+template <class Kernel>
+void TrellisColumn::with_scores(const ParamTable &pt, const Kernel &kernel)
+{
+  bool sublabels = sublabel_order > NODEG;
+
+  if (not pt.is_compiled() or 
+      not pt.is_struct_compiled(sublabel_order, model_order))
+    { kernel(DynamicScores(pt, sublabel_order, model_order)); }
+  else if (model_order == SECOND and sublabels)
+    { kernel(CompiledScores<SECOND, true>(pt)); }
+  else if (model_order == SECOND)
+    { kernel(CompiledScores<SECOND, false>(pt)); }
+  else if (model_order == FIRST and sublabels)
+    { kernel(CompiledScores<FIRST, true>(pt)); }
+  else if (model_order == FIRST)
+    { kernel(CompiledScores<FIRST, false>(pt)); }
+  else if (sublabels)
+    { kernel(CompiledScores<ZEROTH, true>(pt)); }
+  else
+    { kernel(CompiledScores<ZEROTH, false>(pt)); }
+}
  
 float expsumlog(float x, float y)
 {
@@ -54,13 +183,17 @@ TrellisColumn::TrellisColumn(unsigned int boundary_label,
   beam_width(beam_width),
   use_adaptive_beam(0),
   sublabel_order(sublabel_order),
-  model_order(model_order)
+  model_order(model_order),
+  beam_size(0),
+  nbest(0)
 {}  
 
 void TrellisColumn::set_ncol(TrellisColumn * ncol)
 {
   this->ncol = ncol;
-  ncol->pcol = this;
+
+  if (ncol != 0)
+    { ncol->pcol = this; }
 }
 
 void TrellisColumn::set_word(const Word &word, int plabels)
@@ -70,22 +203,19 @@ void TrellisColumn::set_word(const Word &word, int plabels)
   label_count  = word.get_label_count();  
   plabel_count = plabels; 
 
-  reserve(label_count * plabel_count);
+  unsigned int cell_count = label_count * plabel_count;
 
-  for (unsigned int plabel_index = 0; 
-       plabel_index < plabel_count; 
-       ++plabel_index)
-    {
-      for (unsigned int label_index = 0; 
-	   label_index < label_count; 
-	   ++label_index)
-	{
-	  get_cell(plabel_index, label_index).label = 
-	    word.get_label(label_index);
-	  get_cell(plabel_index, label_index).label_index = 
-	    label_index;
-	}
-    }
+  reserve(cell_count);
+
+  // The column may be reused for another sentence.
+  std::fill(fw_scores.begin(), fw_scores.begin() + cell_count, -FLT_MAX);
+  std::fill(bw_scores.begin(), bw_scores.begin() + cell_count, -FLT_MAX);
+  std::fill(viterbi_scores.begin(), viterbi_scores.begin() + cell_count, 
+	    -FLT_MAX);
+  std::fill(back_pointers.begin(), back_pointers.begin() + cell_count, 
+	    NO_TRELLIS_CELL);
+  cells_in_beam.clear();
+  beam_size = 0;
 }
 
 unsigned int TrellisColumn::get_label_count(void) const
@@ -93,40 +223,51 @@ unsigned int TrellisColumn::get_label_count(void) const
   return label_count;
 }
 
-void TrellisColumn::reserve(unsigned int label_count)
+void TrellisColumn::reserve(unsigned int cell_count)
 {
-  int diff = static_cast<int>(label_count) - cells.size();
-  cells.insert(cells.end(), diff, TrellisCell());
+  if (cell_count <= fw_scores.size())
+    { return; }
+
+  fw_scores.resize(cell_count, -FLT_MAX);
+  bw_scores.resize(cell_count, -FLT_MAX);
+  viterbi_scores.resize(cell_count, -FLT_MAX);
+  back_pointers.resize(cell_count, NO_TRELLIS_CELL);
 }
 
-TrellisCell &TrellisColumn::get_cell(unsigned int plabel_index, 
-				     unsigned int label_index)
+// The cell accessors are used in the innermost loops, so they do not
+// check bounds.
+unsigned int TrellisColumn::get_cell_index(unsigned int plabel_index, 
+					   unsigned int label_index) const
 {
-  return cells.at(plabel_count * label_index + plabel_index);
+  return plabel_count * label_index + plabel_index;
 }
 
-const TrellisCell &TrellisColumn::get_cell(unsigned int plabel_index, 
-					   unsigned int label_index) const
+unsigned int TrellisColumn::get_cell_label_index(unsigned int cell) const
+{
+  return cell / plabel_count;
+}
+
+unsigned int TrellisColumn::get_cell_label(unsigned int cell) const
 {
-  return cells.at(plabel_count * label_index + plabel_index);
+  return get_label(get_cell_label_index(cell));
 }
 
 float TrellisColumn::get_fw(unsigned int plabel_index, 
 			    unsigned int label_index) const
 {
-  return get_cell(plabel_index, label_index).fw;
+  return fw_scores[get_cell_index(plabel_index, label_index)];
 }
 
 float TrellisColumn::get_bw(unsigned int plabel_index, 
 			    unsigned int label_index) const
 {
-  return get_cell(plabel_index, label_index).bw;
+  return bw_scores[get_cell_index(plabel_index, label_index)];
 }
 
 float TrellisColumn::get_viterbi(unsigned int plabel_index, 
 				 unsigned int label_index) const
 {
-  return get_cell(plabel_index, label_index).viterbi;
+  return viterbi_scores[get_cell_index(plabel_index, label_index)];
 }
 
 unsigned int TrellisColumn::get_label(unsigned int label_index) const
@@ -148,55 +289,78 @@ unsigned int TrellisColumn::get_nlabel(unsigned int nlabel_index) const
   return (ncol == 0 ? boundary_label : ncol->get_label(nlabel_index));
 }
 
-float TrellisColumn::get_emission_score(const ParamTable &pt,
-					unsigned int label_index) const
+void TrellisColumn::set_emission_scores(const ParamTable &pt)
+{
+  if (word == 0)
+    {
+      throw WordNotSet();
+    }
+
+  EmissionKernel kernel = { this };
+  with_scores(pt, kernel);
+}
+
+template <class Scores>
+void TrellisColumn::set_emission_scores_kernel(const Scores &scores)
+{
+  emission_scores.resize(label_count);
+
+  for (unsigned int i = 0; i < label_count; ++i)
+    { emission_scores[i] = scores.get_unstruct(*word, word->get_label(i)); }
+}
+
+float TrellisColumn::get_emission_score(unsigned int label_index) const
 {
-  return pt.get_all_unstruct(*word, word->get_label(label_index), sublabel_order);
+  return emission_scores[label_index];
 }
 
 float TrellisColumn::get_transition_fw_score(const ParamTable &pt, 
 					     unsigned int label_index, 
-					     unsigned int plabel_index) const
+					     unsigned int plabel_index)
 {
-  float score = -FLT_MAX;
+  unsigned int pplabel_count = (pcol == 0 ? 1 : pcol->plabel_count);
+  unsigned int plabel        = get_plabel(plabel_index);      
+  unsigned int label         = get_label(label_index);
 
-  for (unsigned int k = 0; k < (pcol == 0 ? 1 : pcol->plabel_count); ++k)
+  score_row.resize(pplabel_count);
+
+  for (unsigned int k = 0; k < pplabel_count; ++k)
     {
       unsigned int pplabel = get_pplabel(k);
-      unsigned int plabel  = get_plabel(plabel_index);      
-      unsigned int label   = get_label(label_index);
       
       float pcol_fw = (pcol == 0 ? 0 : pcol->get_fw(k, plabel_index));
       
       float tr_score = pt.get_all_struct_fw(pplabel, plabel, label, sublabel_order, model_order);
       
-      score = expsumlog(score, tr_score + pcol_fw);
+      score_row[k] = tr_score + pcol_fw;
     }
 
-  return score;
+  return log_sum_exp(&score_row[0], pplabel_count);
 }
 
 float TrellisColumn::get_transition_bw_score(const ParamTable &pt, 
 					     unsigned int plabel_index, 
-					     unsigned int label_index) const
+					     unsigned int label_index)
 {
-  float score = -FLT_MAX;
+  unsigned int nlabel_count = (ncol == 0 ? 1 : ncol->label_count);
+  unsigned int plabel       = get_plabel(plabel_index);
+  unsigned int label        = get_label(label_index);
+
+  score_row.resize(nlabel_count);
 
-  for (unsigned int i = 0; i < (ncol == 0 ? 1 : ncol->label_count); ++i)
+  for (unsigned int i = 0; i < nlabel_count; ++i)
     {
-      float ncol_em = (ncol == 0 ? 0 : ncol->get_emission_score(pt, i));
+      float ncol_em = (ncol == 0 ? 0 : ncol->get_emission_score(i));
       float ncol_bw = (ncol == 0 ? 0 : ncol->get_bw(label_index, i));
       
-      unsigned int plabel = get_plabel(plabel_index);
-      unsigned int label  = get_label(label_index);
       unsigned int nlabel = get_nlabel(i);
 
       float tr_score = pt.get_all_struct_bw(plabel, label, nlabel, sublabel_order, model_order);
 
-      score = expsumlog(score, tr_score + ncol_em + ncol_bw);
+      score_row[i] = tr_score + ncol_em + ncol_bw;
     }
 
-  return score;
+  return log_sum_exp(&score_row[0], nlabel_count);
 }
 
 void TrellisColumn::compute_fw(const ParamTable &pt)
@@ -206,14 +370,9 @@ void TrellisColumn::compute_fw(const ParamTable &pt)
       throw WordNotSet();
     }
 
-  if (pcol != 0)
-    {
-      pcol->compute_fw(pt);
-    }
-
   for (unsigned int i = 0; i < label_count; ++i)
     {
-      float em = get_emission_score(pt, i); 
+      float em = get_emission_score(i); 
 
       for (unsigned int j = 0; j < plabel_count; ++j)
 	{
@@ -228,7 +387,7 @@ void TrellisColumn::compute_fw(const ParamTable &pt)
 	      tr = 0; 
 	    }
 
-	  get_cell(j, i).fw = em + tr;
+	  fw_scores[get_cell_index(j, i)] = em + tr;
 	}
     }
 }
@@ -240,34 +399,15 @@ void TrellisColumn::compute_bw(const ParamTable &pt)
       throw WordNotSet();
     }
 
-  if (ncol != 0)
-    {
-      ncol->compute_bw(pt);
-    }
-
   for (unsigned int i = 0; i < label_count; ++i)
     {
       for (unsigned int j = 0; j < plabel_count; ++j)
 	{
-	  TrellisCell &c = get_cell(j, i);
-	  
-	  c.bw = get_transition_bw_score(pt, j, i);
+	  bw_scores[get_cell_index(j, i)] = get_transition_bw_score(pt, j, i);
 	}
     }
 }
 
-void set_labels(LabelVector &res, TrellisCell * c, unsigned int boundary_label)
-{
-  res.push_back(c->label);
-
-  c = c->pcell;
-
-  if (c != 0)
-    { 
-      set_labels(res, c, boundary_label);
-    }
-}
-
 #include <cassert>
 
 void TrellisColumn::set_labels(LabelVector &res)
@@ -275,11 +415,17 @@ void TrellisColumn::set_labels(LabelVector &res)
   if (word == 0)
     { return; }
 
-  TrellisCell * c = &get_cell(0,0);
-  assert(c != 0);
-  assert(c->pcell != 0); 
+  assert(back_pointers[get_cell_index(0, 0)] != NO_TRELLIS_CELL); 
+
+  const TrellisColumn * col = this;
+  unsigned int cell = get_cell_index(0, 0);
 
-  ::set_labels(res, c, boundary_label);
+  while (cell != NO_TRELLIS_CELL)
+    {
+      res.push_back(col->get_cell_label(cell));
+      cell = col->back_pointers[cell];
+      col = col->pcol;
+    }
 
   std::reverse(res.begin(), res.end());
 }
@@ -292,27 +438,31 @@ void TrellisColumn::compute_viterbi(const ParamTable &pt)
       throw WordNotSet();
     }
 
-  if (pcol != 0)
-    {
-      pcol->compute_viterbi(pt);
-    }
+  ViterbiKernel kernel = { this };
+  with_scores(pt, kernel);
+}
 
+template <class Scores>
+void TrellisColumn::compute_viterbi_kernel(const Scores &scores)
+{ 
   for (unsigned int i = 0; i < label_count; ++i)
     {
-      float em = get_emission_score(pt, i); 
+      float em = get_emission_score(i); 
       
       if (pcol == 0)
 	{
-	  set_viterbi_tr_score(pt, 0, i);
+	  set_viterbi_tr_score(scores.pt, 0, i);
+
+	  unsigned int cell = get_cell_index(0, i);
 
-	  get_cell(0, i).viterbi += em;
-	  get_cell(0, i).fw += em;
+	  viterbi_scores[cell] += em;
+	  fw_scores[cell] += em;
 
-	  cells_in_beam.push_back(&get_cell(0,i));
+	  cells_in_beam.push_back(cell);
 	}
       else
 	{ 
-	  unsigned int p_col_beam_cell_count = pcol->beam_cell_count();
+	  unsigned int p_col_beam_cell_count = pcol->beam_size;
 
 	  for (unsigned int j = 0; j < beam_width; ++j)
 	    {
@@ -322,41 +472,196 @@ void TrellisColumn::compute_viterbi(const ParamTable &pt)
 		  break; 
 		}
 
-	      TrellisCell * pcell = pcol->get_beam_cell(j);
+	      unsigned int pcell = pcol->get_beam_cell(j);
+	      unsigned int ppcell = pcol->back_pointers[pcell];
 	      
-	      unsigned int pplabel = (pcell->pcell == 0 ? boundary_label : pcell->pcell->label);
-	      unsigned int plabel  = pcell->label;      
+	      unsigned int pplabel = (ppcell == NO_TRELLIS_CELL ? 
+				      boundary_label : 
+				      pcol->pcol->get_cell_label(ppcell));
+	      unsigned int plabel  = pcol->get_cell_label(pcell);
 	      unsigned int label   = get_label(i);
 	      
-	      float pcol_score = (pcol == 0 ? 0 : pcell->viterbi);
+	      float pcol_score = pcol->viterbi_scores[pcell];
 
-	      float tr_score = pt.get_all_struct_fw(pplabel, plabel, label, sublabel_order, model_order);
+	      float tr_score = scores.get_struct_fw(pplabel, plabel, label);
 	      
 	      float score = tr_score + pcol_score + em;
+
+	      unsigned int cell = 
+		get_cell_index(pcol->get_cell_label_index(pcell), i);
 	      	      
-	      get_cell(pcell->label_index, i).fw = expsumlog(get_cell(pcell->label_index, i).fw,
-							     pcell->fw + tr_score + em);
-	      if (get_cell(pcell->label_index, i).viterbi == -FLT_MAX)
+	      fw_scores[cell] = expsumlog(fw_scores[cell],
+					  pcol->fw_scores[pcell] + tr_score + em);
+
+	      if (viterbi_scores[cell] == -FLT_MAX)
 		{
-		  cells_in_beam.push_back(&get_cell(pcell->label_index, i));
+		  cells_in_beam.push_back(cell);
 		}
 
-	      if (score > get_cell(pcell->label_index, i).viterbi or 
-		  get_cell(pcell->label_index, i).pcell == 0)
+	      if (score > viterbi_scores[cell] or 
+		  back_pointers[cell] == NO_TRELLIS_CELL)
 		{
-		  get_cell(pcell->label_index, i).viterbi = score;
-		  get_cell(pcell->label_index, i).pcell = pcell;
+		  viterbi_scores[cell] = score;
+		  back_pointers[cell] = pcell;
 		}	      
 	    }
 	}
     }
 
-  std::stable_sort(cells_in_beam.begin(), cells_in_beam.end(), CmpTrellisCell());
+  select_beam();
 }
 
-TrellisCell * TrellisColumn::get_beam_cell(unsigned int i)
+void TrellisColumn::compute_nbest(const ParamTable &pt, unsigned int nbest)
 {
-  return cells_in_beam.at(i);
+  if (word == 0)
+    {
+      throw WordNotSet();
+    }
+
+  NBestKernel kernel = { this, nbest };
+  with_scores(pt, kernel);
+}
+
+template <class Scores>
+void TrellisColumn::compute_nbest_kernel(const Scores &scores, 
+					 unsigned int nbest)
+{
+  this->nbest = nbest;
+
+  unsigned int cell_count = label_count * plabel_count;
+
+  if (nbest_counts.size() < cell_count)
+    { nbest_counts.resize(cell_count); }
+
+  if (nbest_entries.size() < cell_count * nbest)
+    { nbest_entries.resize(cell_count * nbest); }
+
+  CmpNBestEntry cmp;
+
+  for (unsigned int i = 0; i < label_count; ++i)
+    {
+      float em = get_emission_score(i);
+      unsigned int label = get_label(i);
+
+      // Boundary words may list the boundary label more than once
+      // and the copies would only repeat the same paths.
+      if (i > 0 and label == boundary_label)
+	{
+	  for (unsigned int j = 0; j < plabel_count; ++j)
+	    { nbest_counts[get_cell_index(j, i)] = 0; }
+
+	  continue;
+	}
+
+      for (unsigned int j = 0; j < plabel_count; ++j)
+	{
+	  unsigned int cell = get_cell_index(j, i);
+	  unsigned int plabel = get_plabel(j);
+	  NBestEntry * entries = &nbest_entries[cell * nbest];
+
+	  if (pcol == 0)
+	    {
+	      entries[0].score = 
+		scores.get_struct_fw(boundary_label, plabel, label) + em;
+	      entries[0].pcell = NO_TRELLIS_CELL;
+	      entries[0].prank = 0;
+	      nbest_counts[cell] = 1;
+	      continue;
+	    }
+
+	  // Merge the sorted path lists of the previous cells (k, j)
+	  // using a heap that holds the best path of each list that
+	  // has not been used yet.
+	  unsigned int pplabel_count = pcol->plabel_count;
+
+	  nbest_transitions.resize(pplabel_count);
+	  nbest_heap.clear();
+
+	  for (unsigned int k = 0; k < pplabel_count; ++k)
+	    {
+	      unsigned int pcell = pcol->get_cell_index(k, j);
+
+	      if (pcol->nbest_counts[pcell] == 0)
+		{ continue; }
+
+	      nbest_transitions[k] = 
+		scores.get_struct_fw(get_pplabel(k), plabel, label) + em;
+
+	      NBestEntry e = 
+		{ pcol->nbest_entries[pcell * nbest].score + 
+		  nbest_transitions[k], pcell, 0 };
+
+	      nbest_heap.push_back(e);
+	    }
+
+	  std::make_heap(nbest_heap.begin(), nbest_heap.end(), cmp);
+
+	  unsigned int count = 0;
+
+	  while (count < nbest and not nbest_heap.empty())
+	    {
+	      std::pop_heap(nbest_heap.begin(), nbest_heap.end(), cmp);
+	      NBestEntry e = nbest_heap.back();
+	      nbest_heap.pop_back();
+
+	      entries[count] = e;
+	      ++count;
+
+	      if (e.prank + 1 < pcol->nbest_counts[e.pcell])
+		{
+		  unsigned int k = e.pcell % pplabel_count;
+
+		  e.score = 
+		    pcol->nbest_entries[e.pcell * nbest + e.prank + 1].score + 
+		    nbest_transitions[k];
+		  ++e.prank;
+
+		  nbest_heap.push_back(e);
+		  std::push_heap(nbest_heap.begin(), nbest_heap.end(), cmp);
+		}
+	    }
+
+	  nbest_counts[cell] = count;
+	}
+    }
+}
+
+void TrellisColumn::set_nbest_labels(std::vector<LabelVector> &paths,
+				     std::vector<float> &scores) const
+{
+  if (word == 0)
+    { return; }
+
+  unsigned int cell = get_cell_index(0, 0);
+
+  for (unsigned int r = 0; r < nbest_counts[cell]; ++r)
+    {
+      LabelVector path;
+
+      const TrellisColumn * col = this;
+      unsigned int c = cell;
+      unsigned int rank = r;
+
+      scores.push_back(nbest_entries[cell * nbest + r].score);
+
+      while (c != NO_TRELLIS_CELL)
+	{
+	  const NBestEntry &e = col->nbest_entries[c * nbest + rank];
+
+	  path.push_back(col->get_cell_label(c));
+	  c = e.pcell;
+	  rank = e.prank;
+	  col = col->pcol;
+	}
+
+      std::reverse(path.begin(), path.end());
+      paths.push_back(path);
+    }
+}
+
+unsigned int TrellisColumn::get_beam_cell(unsigned int i) const
+{
+  return cells_in_beam[i];
 }
 
 void TrellisColumn::set_beam_mass(float mass)
@@ -370,33 +675,65 @@ void TrellisColumn::set_beam(unsigned int beam)
   beam_width = beam;
 }
 
-unsigned int TrellisColumn::beam_cell_count(void)
+void TrellisColumn::select_beam(void)
 {
-  if (not use_adaptive_beam)
-    { 
-      return std::min(size_t(beam_width), cells_in_beam.size()); 
-    }
+  unsigned int cell_count = cells_in_beam.size();
+  unsigned int keep = std::min(cell_count, beam_width);
+
+  if (use_adaptive_beam)
+    { keep = std::min(keep, MAX_ADAPTIVE_BEAM_CELLS); }
 
-  float tot_mass = -FLT_MAX;
+  // Only the first keep cells are ever used, so only they are
+  // sorted. Ties are ranked by position like in a stable sort.
+  beam_positions.resize(cell_count);
 
-  for (size_t i = 0; i < cells_in_beam.size(); ++i)
+  for (unsigned int i = 0; i < cell_count; ++i)
+    { beam_positions[i] = i; }
+
+  CmpBeamPosition cmp(cells_in_beam, viterbi_scores);
+
+  if (keep < cell_count)
     {
-      tot_mass = expsumlog(tot_mass, cells_in_beam.at(i)->fw);
+      std::nth_element(beam_positions.begin(), 
+		       beam_positions.begin() + keep, 
+		       beam_positions.end(), 
+		       cmp);
     }
 
-  float prefix_mass = -FLT_MAX;
+  std::sort(beam_positions.begin(), beam_positions.begin() + keep, cmp);
+
+  beam_cells.assign(cells_in_beam.begin(), cells_in_beam.end());
 
-  for (size_t i = 0; i < cells_in_beam.size(); ++i)
+  for (unsigned int i = 0; i < cell_count; ++i)
+    { cells_in_beam[i] = beam_cells[beam_positions[i]]; }
+
+  beam_size = keep;
+
+  if (not use_adaptive_beam)
+    { return; }
+
+  // Keep the best cells until they hold beam_mass of the forward
+  // mass of the column.
+  score_row.resize(cell_count);
+
+  for (unsigned int i = 0; i < cell_count; ++i)
+    { score_row[i] = fw_scores[cells_in_beam[i]]; }
+
+  float tot_mass = log_sum_exp(&score_row[0], cell_count);
+
+  // Share of the total mass in the cells 0, ..., i.
+  float prefix_mass = 0;
+
+  for (unsigned int i = 0; i < keep; ++i)
     {
-      prefix_mass = expsumlog(prefix_mass, cells_in_beam.at(i)->fw);
+      prefix_mass += exp(score_row[i] - tot_mass);
 
-      if (i > 200 or (exp(prefix_mass - tot_mass) > beam_mass and i > 4))
+      if (prefix_mass > beam_mass and i + 1 >= MIN_ADAPTIVE_BEAM_CELLS)
 	{
-	  return i + 1; 
+	  beam_size = i + 1;
+	  return;
 	}
     }
-
-  return cells_in_beam.size(); 
 }
 
 void TrellisColumn::set_viterbi_tr_score(const ParamTable &pt, 
@@ -430,13 +767,15 @@ void TrellisColumn::set_viterbi_tr_score(const ParamTable &pt,
       tot_score = expsumlog(tot_score, fw_score);
     }
   
-  TrellisCell &c = get_cell(plabel_index, label_index);
+  unsigned int cell = get_cell_index(plabel_index, label_index);
 
-  c.viterbi = max_score;
-  c.fw = tot_score;
+  viterbi_scores[cell] = max_score;
+  fw_scores[cell] = tot_score;
 
-  c.pcell = 
-    (pcol == 0 ? 0 : &(pcol->get_cell(max_pplabel_index, plabel_index)));
+  back_pointers[cell] = 
+    (pcol == 0 ? 
+     NO_TRELLIS_CELL : 
+     pcol->get_cell_index(max_pplabel_index, plabel_index));
 }
 
 #else // TEST_TrellisColumn_cc
@@ -445,12 +784,39 @@ void TrellisColumn::set_viterbi_tr_score(const ParamTable &pt,
 #include <iostream>
 #include <cmath>
 #include <cfloat>
+#include <vector>
+#include <algorithm>
 
 bool float_equals(float f1, float f2)
 {
   return fabs(f1 - f2) < 0.0001;
 }
 
+// Set the words of the linked columns @p cols and compute their
+// scores in the order that Trellis uses.
+void compute_scores(const std::vector<TrellisColumn *> &cols,
+		    const std::vector<const Word *> &words,
+		    const ParamTable &pt)
+{
+  for (unsigned int i = 0; i < cols.size(); ++i)
+    { 
+      cols[i]->set_word(*words[i], 
+			i == 0 ? 1 : words[i - 1]->get_label_count());
+      cols[i]->set_emission_scores(pt);
+    }
+
+  // compute_viterbi also accumulates forward scores inside the beam,
+  // which compute_fw overwrites.
+  for (unsigned int i = 0; i < cols.size(); ++i)
+    { cols[i]->compute_viterbi(pt); }
+
+  for (unsigned int i = 0; i < cols.size(); ++i)
+    { cols[i]->compute_fw(pt); }
+
+  for (unsigned int i = cols.size(); i > 0; --i)
+    { cols[i - 1]->compute_bw(pt); }
+}
+
 int main(void)
 {
   TrellisColumn trellis_column0(0);
@@ -501,13 +867,6 @@ int main(void)
   col2.set_ncol(&rbcol1);
   rbcol1.set_ncol(&rbcol2);
   
-  lbcol.set_word(boundary);
-  col0.set_word(dog);
-  col1.set_word(cat);
-  col2.set_word(horse);
-  rbcol1.set_word(boundary);
-  rbcol2.set_word(boundary);
-
   ParamTable pt;
   
   // Random init parameters.
@@ -524,26 +883,40 @@ int main(void)
   pt.update_unstruct(5, 1, 4.386);
   pt.update_unstruct(5, 9, 1.145);
 
-  pt.update_struct3(0,0,1,6.521);
-  pt.update_struct3(0,0,9,7.494);
-  pt.update_struct2(0,9,5.891, false);
-  pt.update_struct2(0,1,0.883, false);
-  pt.update_struct1(9,2.275, false);
-  pt.update_struct1(1,3.68, false);
-
-  pt.update_struct3(1,1,1,5.206);
-  pt.update_struct3(1,1,9,4.958);
-  pt.update_struct2(1,1,3.883, false);
-  pt.update_struct2(1,9,4.309, false);
-
-  pt.update_struct3(1,9,1,9.494);
-  pt.update_struct3(1,9,9,6.355);
-  pt.update_struct2(9,1,0.358, false);
-  pt.update_struct2(9,9,6.690, false);
-
-  rbcol2.compute_fw(pt);
-  rbcol2.compute_viterbi(pt);
-  lbcol.compute_bw(pt);
+  pt.update_struct3(0,0,1,6.521, NODEG);
+  pt.update_struct3(0,0,9,7.494, NODEG);
+  pt.update_struct2(0,9,5.891, NODEG);
+  pt.update_struct2(0,1,0.883, NODEG);
+  pt.update_struct1(9,2.275, NODEG);
+  pt.update_struct1(1,3.68, NODEG);
+
+  pt.update_struct3(1,1,1,5.206, NODEG);
+  pt.update_struct3(1,1,9,4.958, NODEG);
+  pt.update_struct2(1,1,3.883, NODEG);
+  pt.update_struct2(1,9,4.309, NODEG);
+
+  pt.update_struct3(1,9,1,9.494, NODEG);
+  pt.update_struct3(1,9,9,6.355, NODEG);
+  pt.update_struct2(9,1,0.358, NODEG);
+  pt.update_struct2(9,9,6.690, NODEG);
+
+  std::vector<TrellisColumn *> cols;
+  cols.push_back(&lbcol);
+  cols.push_back(&col0);
+  cols.push_back(&col1);
+  cols.push_back(&col2);
+  cols.push_back(&rbcol1);
+  cols.push_back(&rbcol2);
+
+  std::vector<const Word *> words;
+  words.push_back(&boundary);
+  words.push_back(&dog);
+  words.push_back(&cat);
+  words.push_back(&horse);
+  words.push_back(&boundary);
+  words.push_back(&boundary);
+
+  compute_scores(cols, words, pt);
 
   // Manually compute total score for "dog cat horse".
   float tot_score = -FLT_MAX;
@@ -566,21 +939,21 @@ int main(void)
 	      f += pt.get_unstruct(4, labels[k]);
 	      f += pt.get_unstruct(5, labels[k]);
 
-	      f += pt.get_struct3(0, 0, labels[i]);
-	      f += pt.get_struct2(0, labels[i], false);
-	      f += pt.get_struct1(labels[i], false);
+	      f += pt.get_struct3(0, 0, labels[i], NODEG);
+	      f += pt.get_struct2(0, labels[i], NODEG);
+	      f += pt.get_struct1(labels[i], NODEG);
 
-	      f += pt.get_struct3(0, labels[i], labels[j]);
-	      f += pt.get_struct2(labels[i], labels[j], false);
-	      f += pt.get_struct1(labels[j], false);
+	      f += pt.get_struct3(0, labels[i], labels[j], NODEG);
+	      f += pt.get_struct2(labels[i], labels[j], NODEG);
+	      f += pt.get_struct1(labels[j], NODEG);
 
-	      f += pt.get_struct3(labels[i], labels[j], labels[k]);
-	      f += pt.get_struct2(labels[j], labels[k], false);
-	      f += pt.get_struct1(labels[k], false);
+	      f += pt.get_struct3(labels[i], labels[j], labels[k], NODEG);
+	      f += pt.get_struct2(labels[j], labels[k], NODEG);
+	      f += pt.get_struct1(labels[k], NODEG);
 	      
-	      f += pt.get_struct3(labels[j], labels[k], 0);
-	      f += pt.get_struct3(labels[k], 0, 0);
-	      f += pt.get_struct2(labels[k], 0, false);
+	      f += pt.get_struct3(labels[j], labels[k], 0, NODEG);
+	      f += pt.get_struct3(labels[k], 0, 0, NODEG);
+	      f += pt.get_struct2(labels[k], 0, NODEG);
 
 	      tot_score = expsumlog(tot_score, f);
 
@@ -596,7 +969,6 @@ int main(void)
 	}
     }
 
-  /*
   // Compute fw + bw score for postions 0, 1, 2 and boundaries. The
   // sums should all equal tot_score.
 
@@ -640,11 +1012,11 @@ int main(void)
   assert(float_equals(tot_score, scorerb2));
 
   assert(float_equals(max_score, rbcol2.get_viterbi(0, 0)));
-  */
+
   ParamTable foo_pt;
   foo_pt.update_unstruct(0,1,10);
-  foo_pt.update_struct3(2,2,2,1000);
-  foo_pt.update_struct2(2,2,-1, false);
+  foo_pt.update_struct3(2,2,2,1000, NODEG);
+  foo_pt.update_struct2(2,2,-1, NODEG);
 
   FeatureTemplateVector foo_feats(1,0);
 
@@ -670,14 +1042,24 @@ int main(void)
   foo_col4.set_ncol(&foo_col5);
   foo_col5.set_ncol(&foo_col6);
 
-  foo_col1.set_word(boundary);
-  foo_col2.set_word(foo);
-  foo_col3.set_word(foo);
-  foo_col4.set_word(foo);
-  foo_col5.set_word(boundary);
-  foo_col6.set_word(boundary);
+  std::vector<const Word *> foo_words;
+  foo_words.push_back(&boundary);
+  foo_words.push_back(&foo);
+  foo_words.push_back(&foo);
+  foo_words.push_back(&foo);
+  foo_words.push_back(&boundary);
+  foo_words.push_back(&boundary);
+
+  std::vector<TrellisColumn *> foo_cols;
+  foo_cols.push_back(&foo_col1);
+  foo_cols.push_back(&foo_col2);
+  foo_cols.push_back(&foo_col3);
+  foo_cols.push_back(&foo_col4);
+  foo_cols.push_back(&foo_col5);
+  foo_cols.push_back(&foo_col6);
+
+  compute_scores(foo_cols, foo_words, foo_pt);
 
-  foo_col6.compute_viterbi(foo_pt);
   assert(float_equals(foo_col6.get_viterbi(0,0), 1000 - 2));
 
   TrellisColumn bar_col1(0,4);
@@ -693,14 +1075,16 @@ int main(void)
   bar_col4.set_ncol(&bar_col5);
   bar_col5.set_ncol(&bar_col6);
 
-  bar_col1.set_word(boundary);
-  bar_col2.set_word(foo);
-  bar_col3.set_word(foo);
-  bar_col4.set_word(foo);
-  bar_col5.set_word(boundary);
-  bar_col6.set_word(boundary);
+  std::vector<TrellisColumn *> bar_cols;
+  bar_cols.push_back(&bar_col1);
+  bar_cols.push_back(&bar_col2);
+  bar_cols.push_back(&bar_col3);
+  bar_cols.push_back(&bar_col4);
+  bar_cols.push_back(&bar_col5);
+  bar_cols.push_back(&bar_col6);
+
+  compute_scores(bar_cols, foo_words, foo_pt);
 
-  bar_col6.compute_viterbi(foo_pt);
   assert(float_equals(bar_col6.get_viterbi(0,0), 1000 - 2));
 
   TrellisColumn baz_col1(0,2);
@@ -716,16 +1100,63 @@ int main(void)
   baz_col4.set_ncol(&baz_col5);
   baz_col5.set_ncol(&baz_col6);
 
-  baz_col1.set_word(boundary);
-  baz_col2.set_word(foo);
-  baz_col3.set_word(foo);
-  baz_col4.set_word(foo);
-  baz_col5.set_word(boundary);
-  baz_col6.set_word(boundary);
+  std::vector<TrellisColumn *> baz_cols;
+  baz_cols.push_back(&baz_col1);
+  baz_cols.push_back(&baz_col2);
+  baz_cols.push_back(&baz_col3);
+  baz_cols.push_back(&baz_col4);
+  baz_cols.push_back(&baz_col5);
+  baz_cols.push_back(&baz_col6);
+
+  compute_scores(baz_cols, foo_words, foo_pt);
 
-  baz_col6.compute_viterbi(foo_pt);
  
   assert(float_equals(baz_col6.get_viterbi(0,0), 30));
+
+  std::vector<float> viterbi_scores;
+  viterbi_scores.push_back(1);
+  viterbi_scores.push_back(100);
+  viterbi_scores.push_back(-1000);
+
+  std::vector<unsigned int> cells;
+  cells.push_back(2);
+  cells.push_back(0);
+  cells.push_back(1);
+  cells.push_back(0);
+
+  std::vector<unsigned int> positions;
+
+  for (unsigned int i = 0; i < cells.size(); ++i)
+    { positions.push_back(i); }
+
+  std::sort(positions.begin(), positions.end(), 
+	    CmpBeamPosition(cells, viterbi_scores));
+
+  assert(positions[0] == 2);
+  assert(positions[1] == 1);
+  assert(positions[2] == 3);
+  assert(positions[3] == 0);
+
+  std::vector<NBestEntry> heap;
+  NBestEntry e1 = { 1, 0, 1 };
+  NBestEntry e2 = { 3, 1, 0 };
+  NBestEntry e3 = { 1, 0, 0 };
+  heap.push_back(e1);
+  heap.push_back(e2);
+  heap.push_back(e3);
+
+  std::make_heap(heap.begin(), heap.end(), CmpNBestEntry());
+
+  std::pop_heap(heap.begin(), heap.end(), CmpNBestEntry());
+  assert(heap.back().score == 3);
+  heap.pop_back();
+
+  std::pop_heap(heap.begin(), heap.end(), CmpNBestEntry());
+  assert(heap.back().score == 1 and heap.back().prank == 0);
+  heap.pop_back();
+
+  std::pop_heap(heap.begin(), heap.end(), CmpNBestEntry());
+  assert(heap.back().score == 1 and heap.back().prank == 1);
 }
 
 #endif // TEST_TrellisColumn_cc
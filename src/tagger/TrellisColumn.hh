@@ -26,12 +26,45 @@
 
 #include "ParamTable.hh"
 #include "Word.hh"
-#include "TrellisCell.hh"
 #include "exceptions.hh"
 #include "TaggerOptions.hh"
 
 float expsumlog(float x, float y);
 
+// A TrellisColumn stores the scores of its cells in separate arrays
+// and refers to cells by their index in the arrays. This marks a
+// missing cell.
+const unsigned int NO_TRELLIS_CELL = -1;
+
+// Orders positions in @p cells by descending Viterbi score of the
+// cell and equal scores by position.
+struct CmpBeamPosition
+{
+  CmpBeamPosition(const std::vector<unsigned int> &cells,
+		  const std::vector<float> &viterbi_scores);
+  bool operator() (unsigned int pos1, unsigned int pos2) const;
+
+  const std::vector<unsigned int> * cells;
+  const std::vector<float> * viterbi_scores;
+};
+
+// One of the n best paths ending in a cell: its score and its cell
+// and rank in the previous column.
+struct NBestEntry
+{
+  float score;
+  unsigned int pcell;
+  unsigned int prank;
+};
+
+// Orders NBestEntries by ascending score, so a std heap keeps the
+// best entry on top. Equal scores are ordered by descending pcell and
+// prank, which makes the order of equally good paths deterministic.
+struct CmpNBestEntry
+{
+  bool operator() (const NBestEntry &e1, const NBestEntry &e2) const;
+};
+
 class TrellisColumn
 {
  public:
@@ -43,10 +76,23 @@ class TrellisColumn
   void set_ncol(TrellisColumn * pcol);
   void set_word(const Word &word, int plabels);
 
+  // Compute the emission scores of the labels. Has to be called
+  // before compute_fw, compute_bw and compute_viterbi whenever the
+  // parameters change.
+  void set_emission_scores(const ParamTable &pt);
+
+  // Compute the scores of this column only. Trellis calls compute_fw
+  // and compute_viterbi from left to right and compute_bw from right
+  // to left.
   void compute_fw(const ParamTable &pt);
   void compute_bw(const ParamTable &pt);
   void compute_viterbi(const ParamTable &pt);
 
+  // Compute the @p nbest best paths ending in each cell of this
+  // column. Like compute_viterbi, called from left to right after
+  // set_emission_scores. The search does not use the beam.
+  void compute_nbest(const ParamTable &pt, unsigned int nbest);
+
   float get_fw(unsigned int plabel_index, 
 	       unsigned int label_index) const;
   
@@ -57,14 +103,19 @@ class TrellisColumn
 		    unsigned int label_index) const;
   
   unsigned int get_label_count(void) const;
+  unsigned int get_label(unsigned int label_index) const;  
 
-  void set_labels(LabelVector &res);
+  // Emission score of label @p label_index. Valid after
+  // set_emission_scores.
+  float get_emission_score(unsigned int label_index) const;
 
-  TrellisCell &get_cell(unsigned int plabel_index, 
-			unsigned int label_index);
+  void set_labels(LabelVector &res);
 
-  const TrellisCell &get_cell(unsigned int plabel_index, 
-			      unsigned int label_index) const;
+  // Append the paths ending in the first cell of this column, best
+  // first, to @p paths and their scores to @p scores. Valid after
+  // compute_nbest.
+  void set_nbest_labels(std::vector<LabelVector> &paths,
+			std::vector<float> &scores) const;
 
   void set_beam_mass(float mass);
   void set_beam(unsigned int beam);
@@ -87,33 +138,87 @@ class TrellisColumn
   Degree sublabel_order;
   Degree model_order;
 
-  std::vector<TrellisCell> cells;
-  std::vector<TrellisCell*> cells_in_beam;
+  // Scores of the cells. Cell (plabel_index, label_index) is at index
+  // get_cell_index(plabel_index, label_index), so the cells of one
+  // label are contiguous.
+  std::vector<float> fw_scores;
+  std::vector<float> bw_scores;
+  std::vector<float> viterbi_scores;
 
-  TrellisCell * get_beam_cell(unsigned int i);
-  unsigned int beam_cell_count(void);
+  // For each cell, the index of the best previous cell in pcol or
+  // NO_TRELLIS_CELL.
+  std::vector<unsigned int> back_pointers;
 
-  void reserve(unsigned int label_count);
+  // Cells reached by compute_viterbi. After compute_viterbi, the
+  // first beam_size of them are the beam, best first.
+  std::vector<unsigned int> cells_in_beam;
+  unsigned int beam_size;
+
+  // Scratch vectors for select_beam.
+  std::vector<unsigned int> beam_positions;
+  std::vector<unsigned int> beam_cells;
+
+  std::vector<float> emission_scores;
+
+  // For each cell, the number of its n best paths and the paths
+  // themselves. Path r of cell c is nbest_entries[c * nbest + r].
+  unsigned int nbest;
+  std::vector<unsigned int> nbest_counts;
+  std::vector<NBestEntry> nbest_entries;
+
+  // Scratch vectors for compute_nbest. nbest_transitions[k] is the
+  // transition score from the pplabel with index k.
+  std::vector<NBestEntry> nbest_heap;
+  std::vector<float> nbest_transitions;
+
+  // Scratch row for log_sum_exp.
+  std::vector<float> score_row;
+
+  unsigned int get_beam_cell(unsigned int i) const;
+  void select_beam(void);
+
+  void reserve(unsigned int cell_count);
+
+  unsigned int get_cell_index(unsigned int plabel_index, 
+			      unsigned int label_index) const;
+  unsigned int get_cell_label_index(unsigned int cell) const;
+  unsigned int get_cell_label(unsigned int cell) const;
 
-  unsigned int get_label(unsigned int label_index) const;  
   unsigned int get_plabel(unsigned int plabel_index) const;
   unsigned int get_pplabel(unsigned int pplabel_index) const;
   unsigned int get_nlabel(unsigned int nlabel_index) const;
 
-  float get_emission_score(const ParamTable &pt, 
-			   unsigned int label_index) const;
-
   float get_transition_bw_score(const ParamTable &pt, 
 				unsigned int plabel_index, 
-				unsigned int label_index) const;
+				unsigned int label_index);
 
   float get_transition_fw_score(const ParamTable &pt, 
 				unsigned int label_index, 
-				unsigned int plabel_index) const;
+				unsigned int plabel_index);
 
   void set_viterbi_tr_score(const ParamTable &pt, 
 			    unsigned int plabel_index,
 			    unsigned int label_index);
+
+  // The decoding kernels are templates over the score policies in
+  // TrellisColumn.cc. with_scores picks the policy for pt and the
+  // orders of the column and calls kernel with it, so the orders are
+  // not tested in the inner loops.
+  struct EmissionKernel;
+  struct ViterbiKernel;
+  struct NBestKernel;
+
+  template <class Kernel> 
+  void with_scores(const ParamTable &pt, const Kernel &kernel);
+
+  template <class Scores> 
+  void set_emission_scores_kernel(const Scores &scores);
+
+  template <class Scores> 
+  void compute_viterbi_kernel(const Scores &scores);
+
+  template <class Scores> 
+  void compute_nbest_kernel(const Scores &scores, unsigned int nbest);
 };
 
 #endif // HEADER_TrellisColumn_hh
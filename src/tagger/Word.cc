@@ -49,6 +49,31 @@ void Word::clear_label_guesses(void)
   label_candidates.clear();
 }
 
+void Word::prune_label_guesses(const std::vector<float> &scores, 
+			       float threshold)
+{
+  unsigned int best = 0;
+
+  for (unsigned int i = 1; i < label_candidates.size(); ++i)
+    {
+      if (scores[i] > scores[best])
+	{ best = i; }
+    }
+
+  unsigned int kept = 0;
+
+  for (unsigned int i = 0; i < label_candidates.size(); ++i)
+    {
+      if (i == best or scores[i] >= threshold)
+	{ 
+	  label_candidates[kept] = label_candidates[i]; 
+	  ++kept;
+	}
+    }
+
+  label_candidates.resize(kept);
+}
+
 void Word::set_label_guesses(const LabelExtractor &g, 
 			     bool use_label_dict,
 			     float mass,
@@ -61,7 +86,7 @@ void Word::set_label_guesses(const LabelExtractor &g,
 			 candidate_count); 
 }
 
-void Word::predict_lemma(LemmaExtractor &g, const LabelExtractor &e)
+void Word::predict_lemma(const LemmaExtractor &g, const LabelExtractor &e)
 { 
   if (label == static_cast<unsigned int>(NO_LABEL))
     { throw NoLabel(); }
@@ -186,7 +211,7 @@ class SillyLemmaExtractor : public LemmaExtractor
 {
 public:
   std::string get_lemma_candidate(const std::string &word_form, 
-				  const std::string &label)
+				  const std::string &label) const
   { 
     static_cast<void>(word_form);
     static_cast<void>(label);
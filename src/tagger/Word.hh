@@ -59,7 +59,12 @@ public:
   
   void clear_label_guesses(void);
 
-  void predict_lemma(LemmaExtractor &g, const LabelExtractor &e);
+  // Remove the label guesses whose score in @p scores is below
+  // @p threshold. The guess with the highest score is always kept.
+  void prune_label_guesses(const std::vector<float> &scores, 
+			   float threshold);
+
+  void predict_lemma(const LemmaExtractor &g, const LabelExtractor &e);
 
   void set_lemma(const std::string &lemma);
   void set_label(unsigned int label);
@@ -0,0 +1,154 @@
+/**
+ * @file    finnpos-client.cc                                                
+ * @Author  Miikka Silfverberg                                               
+ * @brief   Send data to finnpos-server.                                    
+ */
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// (C) Copyright 2014, University of Helsinki                                //
+// Licensed under the Apache License, Version 2.0 (the "License");           //
+// you may not use this file except in compliance with the License.          //
+// You may obtain a copy of the License at                                   //
+// http://www.apache.org/licenses/LICENSE-2.0                                //
+// Unless required by applicable law or agreed to in writing, software       //
+// distributed under the License is distributed on an "AS IS" BASIS,         //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  //
+// See the License for the specific language governing permissions and       //
+// limitations under the License.                                            //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+const size_t COPY_SIZE = 1 << 16;
+
+// finnpos-server sends this byte before it closes a connection whose
+// input it could not process.
+const char SERVER_ERROR = '\0';
+
+// Write @p count bytes of @p data to @p fd. Return false on a write
+// error.
+static bool write_data(int fd, const char * data, size_t count)
+{
+  for (size_t pos = 0; pos < count; )
+    {
+      ssize_t written = write(fd, data + pos, count - pos);
+
+      if (written < 0 and errno == EINTR)
+	{ continue; }
+
+      if (written <= 0)
+	{ return 0; }
+
+      pos += written;
+    }
+
+  return 1;
+}
+
+enum CopyStatus
+  { COPIED, WRITE_FAILED, SERVER_FAILED };
+
+// Copy from @p from_fd to @p to_fd until end of input, or until
+// SERVER_ERROR if @p stop_at_error is set.
+static CopyStatus copy_data(int from_fd, int to_fd, bool stop_at_error)
+{
+  std::vector<char> buffer(COPY_SIZE);
+
+  while (1)
+    {
+      ssize_t count = read(from_fd, &buffer[0], buffer.size());
+
+      if (count < 0 and errno == EINTR)
+	{ continue; }
+
+      if (count <= 0)
+	{ return COPIED; }
+
+      const char * error = 
+	(stop_at_error ? 
+	 static_cast<const char *>(memchr(&buffer[0], SERVER_ERROR, count)) :
+	 0);
+
+      if (error != 0)
+	{ 
+	  write_data(to_fd, &buffer[0], error - &buffer[0]);
+	  return SERVER_FAILED;
+	}
+
+      if (not write_data(to_fd, &buffer[0], count))
+	{ return WRITE_FAILED; }
+    }
+}
+
+static void send_input(int socket_fd)
+{
+  copy_data(STDIN_FILENO, socket_fd, 0);
+  shutdown(socket_fd, SHUT_WR);
+}
+
+int main(int argc, char * argv[])
+{
+  if (argc != 2)
+    {
+      std::cerr <<  "USAGE: " << argv[0] << " socket_file" << std::endl;
+      exit(1);
+    }
+
+  std::string socket_fn = argv[1];
+
+  sockaddr_un address;
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+
+  if (socket_fn.size() >= sizeof(address.sun_path))
+    {
+      std::cerr << argv[0] << ": Socket file name " << socket_fn 
+		<< " is too long." << std::endl;
+      exit(1);
+    }
+
+  std::strcpy(address.sun_path, socket_fn.c_str());
+
+  int socket_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+  if (socket_fd < 0 or
+      connect(socket_fd, 
+	      reinterpret_cast<sockaddr *>(&address), 
+	      sizeof(address)) != 0)
+    {
+      std::cerr << argv[0] << ": Can't connect to " << socket_fn << ": " 
+		<< std::strerror(errno) << std::endl;
+      exit(1);
+    }
+
+  // Input is sent while output is received, so the server never
+  // waits for the client to read.
+  std::thread sender(send_input, socket_fd);
+  CopyStatus status = copy_data(socket_fd, STDOUT_FILENO, 1);
+
+  if (status == SERVER_FAILED)
+    { 
+      std::cerr << argv[0] << ": The server could not process the input." 
+		<< std::endl;
+      exit(1); 
+    }
+
+  if (status == WRITE_FAILED)
+    { exit(1); }
+
+  sender.join();
+  close(socket_fd);
+}
@@ -1,7 +1,7 @@
 /**
- * @file    TrellisCell.cc                                                   
+ * @file    finnpos-convert-model.cc                                                 
  * @Author  Miikka Silfverberg                                               
- * @brief   Represents one entry in a TrellisColumn.                        
+ * @brief   Convert a model to the memory mapped format.                               
  */
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -19,56 +19,40 @@
 //                                                                           //
 ///////////////////////////////////////////////////////////////////////////////
 
-#include "TrellisCell.hh"
 
-#ifndef TEST_TrellisCell_cc
+#include <iostream>
+#include <fstream>
 
-#include <cfloat>
+#include "io.hh"
+#include "Tagger.hh"
 
-bool CmpTrellisCell::operator() (const TrellisCell * tc1, 
-				 const TrellisCell * tc2) const
+int main(int argc, char * argv[])
 {
-  return (tc1->viterbi > tc2->viterbi);
-}
-
-TrellisCell::TrellisCell(void):
-  fw         (-FLT_MAX),
-  bw         (-FLT_MAX),
-  viterbi    (-FLT_MAX),
-  label      (-1),
-  label_index(-1),
-  pcell      (0)
-{}
+  if (argc != 3)
+    {
+      std::cerr <<  "USAGE: " << argv[0] << " model_file mapped_model_file"
+		<< std::endl;
 
-#else // TEST_TrellisCell_cc
+      exit(1);
+    }
 
-#include <cassert>
+  std::string model_fn = argv[1];  
+  std::ifstream model_in(model_fn.c_str());
 
-#include <vector>
-#include <algorithm>
+  if (not check(model_fn, model_in, std::cerr))
+    { exit(1); }
 
-int main(void)
-{
-  TrellisCell c1;
-  c1.viterbi = 1;
+  std::cerr << argv[0] << ": Loading tagger." << std::endl;
 
-  TrellisCell c2;
-  c2.viterbi = 100;
+  Tagger tagger(std::cerr);
+  tagger.load(model_fn);
 
-  TrellisCell c3;
-  c3.viterbi = -1000;
+  std::string mapped_model_fn = argv[2];
+  std::ofstream mapped_model_out(mapped_model_fn.c_str(), std::ios::binary);
 
-  std::vector<TrellisCell*> v;
-    
-  v.push_back(&c1);
-  v.push_back(&c2);
-  v.push_back(&c3);
+  if (not check(mapped_model_fn, mapped_model_out, std::cerr))
+    { exit(1); }
 
-  std::sort(v.begin(), v.end(), CmpTrellisCell());
-
-  assert(v[0] == &c2);
-  assert(v[1] == &c1);
-  assert(v[2] == &c3);
+  std::cerr << argv[0] << ": Storing mapped model." << std::endl;
+  tagger.store_mapped(mapped_model_out);
 }
-
-#endif // TEST_TrellisCell_cc
@@ -27,20 +27,29 @@
 
 int main(int argc, char * argv[])
 {
-  if (argc != 3 and argc != 4)
+  if (argc < 3 or argc > 5)
     {
       std::cerr << "USAGE: " << argv[0] << " sys_tagged_file gold_tagged_file "
-		<< "[ model ]"
+		<< "[ model [ reference_sys_tagged_file ] ]"
 		<< std::endl;
       exit(1);
     }
 
   bool read_model = 0;
 
-  if (argc == 4)
+  if (argc >= 4)
     { read_model = 1; }
 
+  // A reference system output, e.g. the output of an unquantized
+  // model, is compared against the same gold standard and the
+  // accuracy differences are reported.
+  bool read_reference = 0;
+
+  if (argc == 5)
+    { read_reference = 1; }
+
   Acc acc;
+  Acc ref_acc;
   
   // If a model is read, we can use its param_table, label_extractor
   // and lemma_extractor to get better statistics (broken down into
@@ -63,13 +72,18 @@ int main(int argc, char * argv[])
       if (not check(model_file_name, model_in, std::cerr))
 	{ exit(1); }
       
-      std::ifstream tagger_in(argv[3]);
-      tagger.load(tagger_in);
+      tagger.load(model_file_name);
 
       Data sys_data  = tagger.get_data(argv[1], 1);
       Data gold_data = tagger.get_data(argv[2], 1);
 
       acc = gold_data.get_acc(sys_data, tagger.get_lemma_extractor());
+
+      if (read_reference)
+	{
+	  Data ref_data = tagger.get_data(argv[4], 1);
+	  ref_acc = gold_data.get_acc(ref_data, tagger.get_lemma_extractor());
+	}
     }
   else
     {
@@ -96,6 +110,14 @@ int main(int argc, char * argv[])
 	    << (read_model ? acc.oov_lemma_acc : -1) 
 	    << std::endl;
 
+  if (read_reference)
+    {
+      std::cout << "Label accuracy delta to " << argv[4] << ": " 
+		<< acc.label_acc - ref_acc.label_acc << std::endl;
+      std::cout << "Lemma accuracy delta to " << argv[4] << ": " 
+		<< acc.lemma_acc - ref_acc.lemma_acc << std::endl;
+    }
+
   if (not read_model)
     { std::cout << "-1 denotes unknown value."; }
 }
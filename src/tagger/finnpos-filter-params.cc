@@ -50,7 +50,7 @@ int main(int argc, char * argv[])
   std::cerr << argv[0] << ": Loading tagger." << std::endl;
 
   Tagger tagger(std::cerr);
-  tagger.load(model_in);
+  tagger.load(model_fn);
 
   if (options.filter_type == AVG_VALUE)
     { tagger.set_param_filter(options); }
@@ -61,6 +61,14 @@ int main(int argc, char * argv[])
 		<< "           No filtering will happen."
 		<< std::endl; }
 
+  if (options.quantization != NO_QUANT)
+    {
+      std::cerr << argv[0] << ": Quantizing parameters to " 
+		<< (options.quantization == INT8 ? "INT8." : "FP16.")
+		<< std::endl;
+      tagger.set_quantization(options.quantization);
+    }
+
   std::cerr << argv[0] << ": Storing model." << std::endl;
   std::ofstream model_out(argv[3]);
   tagger.store(model_out);
@@ -24,16 +24,32 @@
 #include <string>
 #include <fstream>
 
+#include <unistd.h>
+
 #include "io.hh"
 #include "Tagger.hh"
+#include "OutputBuffer.hh"
 
 int main(int argc, char * argv[])
 {
   std::ios_base::sync_with_stdio(false);
 
-  if (argc < 2 or argc > 3)
+  size_t flush_size = get_flush_size(STDOUT_FILENO, argc, argv);
+  unsigned int threads = 1;
+
+  if (argc > 2 and std::string(argv[1]) == "--threads")
+    {
+      threads = parse_thread_count(argv[2]);
+      argv[2] = argv[0];
+      argv += 2;
+      argc -= 2;
+    }
+
+  if (argc < 2 or argc > 3 or threads == 0 or 
+      flush_size == INVALID_FLUSH_SIZE)
     {
-      std::cerr <<  "USAGE: " << argv[0] << " (conf_file)? model_file"
+      std::cerr <<  "USAGE: " << argv[0] 
+		<< " (--threads N)? (--flush-kb N)? (conf_file)? model_file"
 		<< std::endl;
 
       exit(1);
@@ -58,7 +74,7 @@ int main(int argc, char * argv[])
   std::cerr << argv[0] << ": Loading tagger." << std::endl;
 
   Tagger tagger(std::cerr);
-  tagger.load(model_in);
+  tagger.load(model_fn);
 
   if (argc == 3)
     {
@@ -74,5 +90,17 @@ int main(int argc, char * argv[])
     << ": Reading from STDIN. Writing to STDOUT." 
     << std::endl;
   
-  tagger.label_stream(std::cin);
+  bool output_ok = 1;
+
+  {
+    OutputBuffer output(std::cout, STDOUT_FILENO, flush_size);
+    tagger.label_stream(std::cin, threads);
+    output_ok = output.write_buffer() and std::cout;
+  }
+
+  if (not output_ok)
+    {
+      std::cerr << argv[0] << ": Error writing to STDOUT." << std::endl;
+      exit(1);
+    }
 }
@@ -20,15 +20,19 @@
 ///////////////////////////////////////////////////////////////////////////////
 
 #include <iostream>
+#include <unistd.h>
 
 #include "io.hh"
 #include "Tagger.hh"
+#include "OutputBuffer.hh"
 
 int main(int argc, char * argv[])
 {
-  if (argc != 2)
+  size_t flush_size = get_flush_size(STDOUT_FILENO, argc, argv);
+
+  if (argc != 2 or flush_size == INVALID_FLUSH_SIZE)
     {
-      std::cerr <<  "USAGE: " << argv[0] << " model_file"
+      std::cerr <<  "USAGE: " << argv[0] << " (--flush-kb N)? model_file"
 		<< std::endl;
 
       exit(1);
@@ -43,9 +47,21 @@ int main(int argc, char * argv[])
   std::cerr << argv[0] << ": Loading tagger." << std::endl;
 
   Tagger tagger(std::cerr);
-  tagger.load(model_in);
+  tagger.load(model_fn);
 
   std::cerr << argv[0] << ": Printing params to STDOUT." << std::endl;
 
-  tagger.print_params(std::cout);
+  bool output_ok = 1;
+
+  {
+    OutputBuffer output(std::cout, STDOUT_FILENO, flush_size);
+    tagger.print_params(std::cout);
+    output_ok = output.write_buffer() and std::cout;
+  }
+
+  if (not output_ok)
+    {
+      std::cerr << argv[0] << ": Error writing to STDOUT." << std::endl;
+      exit(1);
+    }
 }
@@ -0,0 +1,681 @@
+/**
+ * @file    finnpos-server.cc                                                
+ * @Author  Miikka Silfverberg                                               
+ * @brief   Label data sent over a Unix socket.                             
+ */
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// (C) Copyright 2014, University of Helsinki                                //
+// Licensed under the Apache License, Version 2.0 (the "License");           //
+// you may not use this file except in compliance with the License.          //
+// You may obtain a copy of the License at                                   //
+// http://www.apache.org/licenses/LICENSE-2.0                                //
+// Unless required by applicable law or agreed to in writing, software       //
+// distributed under the License is distributed on an "AS IS" BASIS,         //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  //
+// See the License for the specific language governing permissions and       //
+// limitations under the License.                                            //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "io.hh"
+#include "Tagger.hh"
+#include "Trellis.hh"
+
+// A connection with this many unanswered sentences or this many
+// bytes of unsent answers is not read until the workers or the client
+// catch up.
+const unsigned int MAX_PENDING_SENTENCES = 256;
+const size_t MAX_UNSENT_OUTPUT = 1 << 20;
+
+const size_t READ_SIZE = 1 << 16;
+
+// A connection whose unfinished sentence grows longer than this is
+// answered with SERVER_ERROR and closed, so that a client cannot make
+// the server buffer unbounded input.
+const size_t MAX_SENTENCE_SIZE = 1 << 22;
+
+// Sent before closing a connection whose input could not be
+// processed, so that clients can tell a failed request from a
+// complete one. Answers never contain this byte.
+const char SERVER_ERROR = '\0';
+
+struct Answer
+{
+  std::string text;
+  bool failed;
+};
+
+// A client connection. Sentences are numbered in the order they are
+// read and answered in the same order.
+struct Connection
+{
+  Connection(int fd):
+    fd(fd),
+    read_closed(0),
+    read_count(0),
+    answer_count(0),
+    failed(0)
+  {}
+
+  int fd;
+
+  // Used only by the thread that polls the connections. Input that
+  // does not form a complete sentence yet and answers taken for
+  // sending.
+  std::string input;
+  std::string sentence;
+  std::string send_buffer;
+  bool read_closed;
+
+  std::mutex mutex;
+  unsigned int read_count;
+  unsigned int answer_count;
+  bool failed;
+  std::map<unsigned int, Answer> answers;
+
+  // Answers in input order that the polling thread has not taken.
+  std::string output;
+};
+
+typedef std::shared_ptr<Connection> ConnectionPtr;
+
+struct Job
+{
+  ConnectionPtr connection;
+  unsigned int number;
+  std::string text;
+};
+
+/**
+ * @brief Reads sentences from any number of connections in one thread
+ * and labels them in a pool of worker threads.
+ *
+ * The sockets are non-blocking and only the polling thread reads and
+ * writes them, so a client that reads its answers slowly does not
+ * delay the others. Workers queue the answers on the connection and
+ * wake the polling thread through a pipe. Sentences that could add
+ * labels to the model (see Tagger::has_new_labels) are labeled while
+ * no other worker uses it.
+ */
+class Server
+{
+public:
+  Server(Tagger &tagger, unsigned int threads);
+
+  // Accept connections from @p listen_fd and serve them. Does not
+  // return.
+  void serve(int listen_fd);
+
+private:
+  Tagger &tagger;
+  std::vector<std::thread> workers;
+  std::vector<char> read_buffer;
+
+  int wake_fds[2];
+  std::atomic<bool> woken;
+
+  std::mutex job_mutex;
+  std::condition_variable job_ready;
+  std::deque<Job> jobs;
+
+  std::mutex model_mutex;
+  std::condition_variable model_free;
+  unsigned int model_readers;
+  unsigned int model_writers_waiting;
+  bool model_writer;
+
+  void work(void);
+  void wake(void);
+  void lock_model(bool exclusive);
+  void unlock_model(bool exclusive);
+  void read_connection(const ConnectionPtr &connection);
+  bool write_connection(const ConnectionPtr &connection);
+  void add_line(const ConnectionPtr &connection, const std::string &line);
+  void add_job(const ConnectionPtr &connection);
+  void reject_input(const ConnectionPtr &connection);
+  void answer(const ConnectionPtr &connection, 
+	      unsigned int number, 
+	      const std::string &output,
+	      bool failed);
+};
+
+static void set_nonblocking(int fd)
+{
+  if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) != 0)
+    {
+      std::perror("finnpos-server: fcntl");
+      exit(1);
+    }
+}
+
+Server::Server(Tagger &tagger, unsigned int threads):
+  tagger(tagger),
+  read_buffer(READ_SIZE),
+  woken(0),
+  model_readers(0),
+  model_writers_waiting(0),
+  model_writer(0)
+{
+  if (pipe(wake_fds) != 0)
+    {
+      std::perror("finnpos-server: pipe");
+      exit(1);
+    }
+
+  set_nonblocking(wake_fds[0]);
+  set_nonblocking(wake_fds[1]);
+
+  for (unsigned int i = 0; i < threads; ++i)
+    { workers.push_back(std::thread(&Server::work, this)); }
+}
+
+void Server::serve(int listen_fd)
+{
+  std::vector<ConnectionPtr> connections;
+
+  set_nonblocking(listen_fd);
+
+  while (1)
+    {
+      std::vector<pollfd> fds(2);
+      fds[0].fd = listen_fd;
+      fds[0].events = POLLIN;
+      fds[1].fd = wake_fds[0];
+      fds[1].events = POLLIN;
+
+      std::vector<ConnectionPtr> polled;
+
+      for (unsigned int i = 0; i < connections.size(); )
+	{
+	  Connection &connection = *connections[i];
+	  unsigned int pending = 0;
+	  bool failed = 0;
+
+	  {
+	    std::lock_guard<std::mutex> lock(connection.mutex);
+
+	    if (connection.send_buffer.empty())
+	      { connection.send_buffer.swap(connection.output); }
+	    else
+	      { 
+		connection.send_buffer += connection.output; 
+		connection.output.clear();
+	      }
+
+	    pending = connection.read_count - connection.answer_count;
+	    failed = connection.failed;
+	  }
+
+	  if (connection.send_buffer.empty() and 
+	      (failed or (connection.read_closed and pending == 0)))
+	    {
+	      close(connection.fd);
+	      connections.erase(connections.begin() + i);
+	      continue;
+	    }
+
+	  pollfd fd;
+	  fd.fd = connection.fd;
+	  fd.events = 0;
+	  fd.revents = 0;
+
+	  if (not connection.read_closed and not failed and 
+	      pending < MAX_PENDING_SENTENCES and
+	      connection.send_buffer.size() < MAX_UNSENT_OUTPUT)
+	    { fd.events |= POLLIN; }
+
+	  if (not connection.send_buffer.empty())
+	    { fd.events |= POLLOUT; }
+
+	  // A connection with nothing to do is woken by its answers.
+	  if (fd.events != 0)
+	    {
+	      fds.push_back(fd);
+	      polled.push_back(connections[i]);
+	    }
+
+	  ++i;
+	}
+
+      if (poll(&fds[0], fds.size(), -1) < 0)
+	{
+	  if (errno == EINTR)
+	    { continue; }
+
+	  std::perror("finnpos-server: poll");
+	  exit(1);
+	}
+
+      if (fds[1].revents & POLLIN)
+	{
+	  woken = 0;
+	  char buffer[64];
+
+	  while (read(wake_fds[0], buffer, sizeof(buffer)) > 0)
+	    {}
+	}
+
+      if (fds[0].revents & POLLIN)
+	{
+	  int fd = accept(listen_fd, 0, 0);
+
+	  if (fd >= 0)
+	    { 
+	      set_nonblocking(fd);
+	      connections.push_back(ConnectionPtr(new Connection(fd))); 
+	    }
+	}
+
+      for (unsigned int i = 0; i < polled.size(); ++i)
+	{
+	  const pollfd &fd = fds[i + 2];
+
+	  if ((fd.events & POLLOUT) and fd.revents != 0 and
+	      not write_connection(polled[i]))
+	    {
+	      // The client is gone, so its remaining answers are dropped.
+	      std::lock_guard<std::mutex> lock(polled[i]->mutex);
+	      polled[i]->failed = 1;
+	      polled[i]->send_buffer.clear();
+	      continue;
+	    }
+
+	  if ((fd.events & POLLIN) and fd.revents != 0)
+	    { read_connection(polled[i]); }
+	}
+    }
+}
+
+void Server::read_connection(const ConnectionPtr &connection)
+{
+  ssize_t count = read(connection->fd, &read_buffer[0], read_buffer.size());
+
+  if (count < 0 and 
+      (errno == EINTR or errno == EAGAIN or errno == EWOULDBLOCK))
+    { return; }
+
+  if (count > 0)
+    {
+      std::string &input = connection->input;
+      input.append(&read_buffer[0], count);
+
+      size_t begin = 0;
+      size_t end = 0;
+
+      while ((end = input.find('\n', begin)) != std::string::npos)
+	{
+	  add_line(connection, input.substr(begin, end - begin));
+	  begin = end + 1;
+	}
+
+      input.erase(0, begin);
+
+      if (connection->sentence.size() + input.size() > MAX_SENTENCE_SIZE)
+	{ reject_input(connection); }
+
+      return;
+    }
+
+  // End of input or an error. The last sentence does not need to be
+  // followed by an empty line.
+  if (not connection->input.empty())
+    { add_line(connection, connection->input); }
+
+  add_line(connection, "");
+  connection->read_closed = 1;
+}
+
+bool Server::write_connection(const ConnectionPtr &connection)
+{
+  std::string &send_buffer = connection->send_buffer;
+  ssize_t count = send(connection->fd, send_buffer.data(), send_buffer.size(), 
+		       MSG_NOSIGNAL);
+
+  if (count < 0)
+    { return errno == EINTR or errno == EAGAIN or errno == EWOULDBLOCK; }
+
+  send_buffer.erase(0, count);
+  return 1;
+}
+
+void Server::add_line(const ConnectionPtr &connection, const std::string &line)
+{
+  if (not line.empty())
+    {
+      connection->sentence += line;
+      connection->sentence += '\n';
+    }
+  else if (not connection->sentence.empty())
+    { add_job(connection); }
+}
+
+void Server::add_job(const ConnectionPtr &connection)
+{
+  Job job;
+  job.connection = connection;
+  job.text.swap(connection->sentence);
+
+  {
+    std::lock_guard<std::mutex> lock(connection->mutex);
+    job.number = connection->read_count;
+    ++connection->read_count;
+  }
+
+  std::lock_guard<std::mutex> lock(job_mutex);
+  jobs.push_back(job);
+  job_ready.notify_one();
+}
+
+void Server::reject_input(const ConnectionPtr &connection)
+{
+  std::cerr << "finnpos-server: Sentence longer than " << MAX_SENTENCE_SIZE 
+	    << " bytes." << std::endl;
+
+  connection->input.clear();
+  connection->sentence.clear();
+  connection->read_closed = 1;
+
+  unsigned int number;
+
+  {
+    std::lock_guard<std::mutex> lock(connection->mutex);
+    number = connection->read_count;
+    ++connection->read_count;
+  }
+
+  // The answers to the preceding sentences are still sent.
+  answer(connection, number, "", 1);
+}
+
+void Server::work(void)
+{
+  // The trellis is reused for every job of this worker.
+  std::unique_ptr<Trellis> trellis(tagger.new_trellis());
+
+  while (1)
+    {
+      Job job;
+
+      {
+	std::unique_lock<std::mutex> lock(job_mutex);
+
+	while (jobs.empty())
+	  { job_ready.wait(lock); }
+
+	job = jobs.front();
+	jobs.pop_front();
+      }
+
+      std::ostringstream out;
+      bool failed = 0;
+
+      lock_model(0);
+      bool exclusive = tagger.has_new_labels(job.text);
+
+      if (exclusive)
+	{
+	  unlock_model(0);
+	  lock_model(1);
+	}
+
+      // Input containing SERVER_ERROR would be echoed in the answer.
+      if (job.text.find(SERVER_ERROR) != std::string::npos)
+	{ failed = 1; }
+      else
+	{
+	  try
+	    {
+	      std::istringstream in(job.text);
+	      tagger.label_stream(in, out, *trellis);
+	    }
+	  catch (...)
+	    { failed = 1; }
+	}
+
+      unlock_model(exclusive);
+      answer(job.connection, job.number, out.str(), failed);
+    }
+}
+
+void Server::wake(void)
+{
+  // One byte in the pipe is enough to wake the polling thread.
+  if (woken.exchange(1))
+    { return; }
+
+  char byte = 0;
+  ssize_t count = write(wake_fds[1], &byte, 1);
+  static_cast<void>(count);
+}
+
+void Server::lock_model(bool exclusive)
+{
+  std::unique_lock<std::mutex> lock(model_mutex);
+
+  if (exclusive)
+    {
+      ++model_writers_waiting;
+
+      while (model_writer or model_readers > 0)
+	{ model_free.wait(lock); }
+
+      --model_writers_waiting;
+      model_writer = 1;
+    }
+  else
+    {
+      while (model_writer or model_writers_waiting > 0)
+	{ model_free.wait(lock); }
+
+      ++model_readers;
+    }
+}
+
+void Server::unlock_model(bool exclusive)
+{
+  std::lock_guard<std::mutex> lock(model_mutex);
+
+  if (exclusive)
+    { model_writer = 0; }
+  else
+    { --model_readers; }
+
+  model_free.notify_all();
+}
+
+void Server::answer(const ConnectionPtr &connection, 
+		    unsigned int number, 
+		    const std::string &output,
+		    bool failed)
+{
+  {
+    std::lock_guard<std::mutex> lock(connection->mutex);
+
+    Answer &answer = connection->answers[number];
+    answer.text = output;
+    answer.failed = failed;
+
+    std::map<unsigned int, Answer> &answers = connection->answers;
+
+    // The answers before a failed sentence are still sent.
+    while (not answers.empty() and 
+	   answers.begin()->first == connection->answer_count)
+      {
+	if (answers.begin()->second.failed and not connection->failed)
+	  {
+	    std::cerr << "finnpos-server: Syntax error in input. "
+		      << "Closing connection." << std::endl;
+	    connection->output += SERVER_ERROR;
+	    connection->failed = 1;
+	  }
+
+	if (not connection->failed)
+	  { connection->output += answers.begin()->second.text; }
+
+	answers.erase(answers.begin());
+	++connection->answer_count;
+      }
+  }
+
+  wake();
+}
+
+// Return true if a server accepts connections on @p address.
+// Otherwise errno tells why connecting failed.
+static bool accepts_connections(const sockaddr_un &address)
+{
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+  if (fd < 0)
+    { return 0; }
+
+  bool connected = 
+    connect(fd, reinterpret_cast<const sockaddr *>(&address), 
+	    sizeof(address)) == 0;
+
+  int connect_errno = errno;
+  close(fd);
+  errno = connect_errno;
+
+  return connected;
+}
+
+int main(int argc, char * argv[])
+{
+  std::ios_base::sync_with_stdio(false);
+
+  unsigned int threads = std::thread::hardware_concurrency();
+
+  if (threads == 0)
+    { threads = 1; }
+
+  if (argc > 2 and std::string(argv[1]) == "--threads")
+    {
+      threads = parse_thread_count(argv[2]);
+      argv[2] = argv[0];
+      argv += 2;
+      argc -= 2;
+    }
+
+  if (argc < 3 or argc > 4 or threads == 0)
+    {
+      std::cerr <<  "USAGE: " << argv[0] 
+		<< " (--threads N)? (conf_file)? model_file socket_file"
+		<< std::endl;
+
+      exit(1);
+    }
+
+  std::string model_fn = argv[argc - 2];
+  std::string socket_fn = argv[argc - 1];
+
+  std::ifstream model_in(model_fn.c_str());
+      
+  if (not check(model_fn, model_in, std::cerr))
+    { exit(1); }
+
+  sockaddr_un address;
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+
+  if (socket_fn.size() >= sizeof(address.sun_path))
+    {
+      std::cerr << argv[0] << ": Socket file name " << socket_fn 
+		<< " is too long." << std::endl;
+      exit(1);
+    }
+
+  std::strcpy(address.sun_path, socket_fn.c_str());
+
+  // Only a stale socket is replaced, never some other file or the
+  // socket of a running server.
+  struct stat socket_stat;
+  bool stale_socket = lstat(socket_fn.c_str(), &socket_stat) == 0;
+
+  if (stale_socket and not S_ISSOCK(socket_stat.st_mode))
+    {
+      std::cerr << argv[0] << ": " << socket_fn 
+		<< " exists and is not a socket." << std::endl;
+      exit(1);
+    }
+
+  // Checked before loading the model, so that a second server fails
+  // at once instead of after the load.
+  if (stale_socket)
+    { 
+      if (accepts_connections(address))
+	{
+	  std::cerr << argv[0] << ": Another server is listening on " 
+		    << socket_fn << "." << std::endl;
+	  exit(1);
+	}
+
+      if (errno != ECONNREFUSED)
+	{
+	  std::cerr << argv[0] << ": Can't check " << socket_fn << ": " 
+		    << std::strerror(errno) << std::endl;
+	  exit(1);
+	}
+
+      unlink(socket_fn.c_str()); 
+    }
+
+  std::cerr << argv[0] << ": Loading tagger." << std::endl;
+
+  Tagger tagger(std::cerr);
+  tagger.load(model_fn);
+
+  if (argc == 4)
+    {
+      std::cerr << argv[0] << ": Reading options." << std::endl;
+      unsigned int counter = 0;
+      std::ifstream opt_in(argv[1]);
+      TaggerOptions tagger_options(opt_in, counter);
+      tagger.set_options(tagger_options);
+    }
+
+  int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+  if (listen_fd < 0 or
+      bind(listen_fd, 
+	   reinterpret_cast<sockaddr *>(&address), 
+	   sizeof(address)) != 0 or
+      listen(listen_fd, SOMAXCONN) != 0)
+    {
+      std::cerr << argv[0] << ": Can't listen on " << socket_fn << ": " 
+		<< std::strerror(errno) << std::endl;
+      exit(1);
+    }
+
+  std::cerr << argv[0] << ": Listening on " << socket_fn << " with " 
+	    << threads << " threads." << std::endl;
+
+  Server server(tagger, threads);
+  server.serve(listen_fd);
+}
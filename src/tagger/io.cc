@@ -22,6 +22,11 @@
 #include "io.hh"
 #include "exceptions.hh"
 
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <thread>
+
 #ifndef TEST_io_cc
 
 Entry::Entry(void) {}
@@ -151,6 +156,21 @@ void init_string_stream(std::istream &in, std::istringstream &str_in, bool rever
   str_in.str(binary_string);
 }
 
+unsigned int parse_thread_count(const char * str)
+{
+  char * end = 0;
+  errno = 0;
+  long count = strtol(str, &end, 10);
+
+  if (end == str or *end != 0 or errno != 0 or count <= 0)
+    { return 0; }
+
+  unsigned int cores = std::thread::hardware_concurrency();
+  long max_count = 4 * (cores == 0 ? 1 : cores);
+
+  return count < max_count ? count : max_count;
+}
+
 template<> void read_val(std::istream &in, std::string &str, bool reverse_bytes)
 {
   // String byte order never needs to be reversed.
@@ -203,6 +223,65 @@ void read_char_buffer(std::istream &in, std::string &buffer, bool reverse_bytes)
   }
 }
 
+ParamMap &read_map(std::istream &in, ParamMap &m, bool reverse_bytes)
+{
+  unsigned int size;
+  read_val<unsigned int>(in, size, reverse_bytes);
+
+  const size_t entry_size = sizeof(long) + sizeof(float);
+  std::vector<char> buffer(size * entry_size);
+
+  in.read(buffer.data(), buffer.size());
+
+  if (in.fail())
+    { throw ReadFailed(); }
+
+  m.reserve(m.size() + size);
+
+  for (unsigned int i = 0; i < size; ++i)
+    {
+      long key;
+      float value;
+
+      memcpy(&key, &buffer[i * entry_size], sizeof(long));
+      memcpy(&value, &buffer[i * entry_size + sizeof(long)], sizeof(float));
+
+      if (reverse_bytes)
+	{
+	  key = reverse_num(key);
+	  value = reverse_num(value);
+	}
+
+      m[key] = value;
+    }
+
+  return m;
+}
+
+void write_map(std::ostream &out, const ParamMap &m, bool print)
+{
+  if (print)
+    { std::cerr << "Writing " << m.size() << " parameters." << std::endl; }
+
+  write_val<unsigned int>(out, m.size());
+
+  const size_t entry_size = sizeof(long) + sizeof(float);
+  std::vector<char> buffer(m.size() * entry_size);
+  size_t pos = 0;
+
+  for (ParamMap::const_iterator it = m.begin(); it != m.end(); ++it)
+    {
+      memcpy(&buffer[pos], &it->first, sizeof(long));
+      memcpy(&buffer[pos + sizeof(long)], &it->second, sizeof(float));
+      pos += entry_size;
+    }
+
+  out.write(buffer.data(), buffer.size());
+
+  if (out.fail())
+    { throw WriteFailed(); }
+}
+
 #else // TEST_io_cc
 
 #include <cassert>
@@ -210,10 +289,21 @@ void read_char_buffer(std::istream &in, std::string &buffer, bool reverse_bytes)
 #include <sstream>
 #include <iostream>
 #include <fstream>
+#include <thread>
 //#include <unordered_map>
 #include "UnorderedMapSet.hh"
 int main(void)
 {
+  assert(parse_thread_count("1") == 1);
+  assert(parse_thread_count("0") == 0);
+  assert(parse_thread_count("-1") == 0);
+  assert(parse_thread_count("abc") == 0);
+  assert(parse_thread_count("2x") == 0);
+  assert(parse_thread_count("") == 0);
+  assert(parse_thread_count("99999999999999999999") == 0);
+  assert(parse_thread_count("1000000") <= 
+	 4 * std::max(1u, std::thread::hardware_concurrency()));
+
   // Empty input string.
   // Splitting gives ("")
   // get_next_line throws EmptyLine.
@@ -576,6 +666,27 @@ int main(void)
   read_map<int, int, float>(map_in_6, m_copy2, false);
   assert(m2 == m_copy2);
 
+  // Test reading and writing of ParamMap. The format matches
+  // std::unordered_map<long, float>.
+  std::ostringstream map_out_param;
+  ParamMap pm;
+  pm[0] = 1.5;
+  pm[123456789] = -2;
+  write_map(map_out_param, pm);
+  std::istringstream map_in_param(map_out_param.str());
+  std::unordered_map<long, float> um;
+  read_map<long, float>(map_in_param, um, false);
+  assert(um.size() == 2);
+  assert(um[0] == 1.5);
+  assert(um[123456789] == -2);
+
+  std::ostringstream map_out_param_2;
+  write_map<long, float>(map_out_param_2, um);
+  std::istringstream map_in_param_2(map_out_param_2.str());
+  ParamMap pm_copy;
+  read_map(map_in_param_2, pm_copy, false);
+  assert(pm == pm_copy);
+
   // Test reading and writing a pair.
   std::ostringstream pair_out_1;
   std::pair<char, float> p('a', 0.55);
@@ -29,6 +29,7 @@
 #include <cmath>
 //#include <unordered_map>
 #include "UnorderedMapSet.hh"
+#include "ParamMap.hh"
 #include <sstream>
 
 #include "exceptions.hh"
@@ -77,6 +78,12 @@ bool check(std::string &fn, std::ostream &out, std::ostream &msg_out);
  */
 bool check(std::string &fn, std::istream &in, std::ostream &msg_out);
 
+/**
+ * @brief Return the thread count in @p str, or 0 if @p str is not a
+ * positive integer. Counts above four threads per core are capped.
+ */
+unsigned int parse_thread_count(const char * str);
+
 /**
  * @brief Return true, if the endianness of @p in and @p marker
  * match. Otherwise, return false. Throws ReadFailed.
@@ -273,19 +280,34 @@ template<class T, class U> void write_map(std::ostream &out,
     }
 }
 
+/**
+ * @brief Read a ParamMap from stream @p in. Store it in @p m. The
+ * entries are read in one block and @p m is sized for them up
+ * front. Reverse byte order, iff reverse_bytes == true. Throws
+ * ReadFailed.
+ */
+ParamMap &read_map(std::istream &in, ParamMap &m, bool reverse_bytes);
+
+/**
+ * @brief Write ParamMap @p m to stream @p out in one block. The
+ * format is the same as for std::unordered_map<long, float>. Throws
+ * WriteFailed.
+ */
+void write_map(std::ostream &out, const ParamMap &m, bool print = 0);
+
 /**
  * @brief Write map @p m to stream @p out. Instantiate with
  * std::string and numerical types only! Throws WriteFailed.
  */
-template<class T, class U> void write_avg_filtered_map(std::ostream &out, 
-						       const std::unordered_map<T, U> &m,
-						       float threshold,
-						       int train_iters,
-						       bool print = 0)
+template<class M> void write_avg_filtered_map(std::ostream &out, 
+					      const M &m,
+					      float threshold,
+					      int train_iters,
+					      bool print = 0)
 {
   size_t size = 0;
 
-  for (typename std::unordered_map<T, U>::const_iterator it = m.begin();
+  for (typename M::const_iterator it = m.begin();
        it != m.end();
        ++it)
     { 
@@ -300,15 +322,15 @@ template<class T, class U> void write_avg_filtered_map(std::ostream &out,
 
   write_val<unsigned int>(out, size);
 
-  for (typename std::unordered_map<T, U>::const_iterator it = m.begin();
+  for (typename M::const_iterator it = m.begin();
        it != m.end();
        ++it)
     {
       if (fabs(it->second)/train_iters < threshold)
 	{ continue; }
 
-      write_val<T>(out, it->first);
-      write_val<U>(out, it->second);
+      write_val<typename M::key_type>(out, it->first);
+      write_val<typename M::mapped_type>(out, it->second);
     }
 }
 
@@ -317,15 +339,15 @@ template<class T, class U> void write_avg_filtered_map(std::ostream &out,
  * @brief Write map @p m to stream @p out. Instantiate with
  * std::string and numerical types only! Throws WriteFailed.
  */
-template<class T, class U> void write_filtered_map(std::ostream &out,
-						   const std::unordered_map<T, U> &m,
-						   const std::unordered_map<T, int> &counter,
-						   int th,
-						   bool print = 0)
+template<class M, class T> void write_filtered_map(std::ostream &out,
+						  const M &m,
+						  const std::unordered_map<T, int> &counter,
+						  int th,
+						  bool print = 0)
 {
   size_t size = 0;
 
-  for (typename std::unordered_map<T, U>::const_iterator it = m.begin();
+  for (typename M::const_iterator it = m.begin();
        it != m.end();
        ++it)
     { 
@@ -340,7 +362,7 @@ template<class T, class U> void write_filtered_map(std::ostream &out,
 
   write_val<unsigned int>(out, size);
 
-  for (typename std::unordered_map<T, U>::const_iterator it = m.begin();
+  for (typename M::const_iterator it = m.begin();
        it != m.end();
        ++it)
     {
@@ -351,8 +373,8 @@ template<class T, class U> void write_filtered_map(std::ostream &out,
 	  continue; 
 	}
 
-      write_val<T>(out, it->first);
-      write_val<U>(out, it->second);
+      write_val<typename M::key_type>(out, it->first);
+      write_val<typename M::mapped_type>(out, it->second);
     }
 }
 